@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <memory>
+
+#include "async_writer.h"
+#include "output.h"
+#include "universe.h"
+#include "error.h"
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+namespace {
+	const std::size_t text_buffer_size = 1 << 20; // Bytes of text gathered before the stream writes them
+} // end namespace
+
+void async_writer::writer_loop() {
+	std::uint64_t done = tail.load(std::memory_order_relaxed);
+	for (;;) {
+		std::uint64_t last = head.load(std::memory_order_acquire);
+		if (last == done) {
+			// Everything handed over has been written, stop if close was called otherwise sleep
+			if (stopping.load()) {
+				if (head.load(std::memory_order_acquire) == done) break;
+				continue;
+			} // end if
+			std::unique_lock<std::mutex> guard(lock);
+			writer_waiting.store(true);
+			ready.wait(guard, [&] { return head.load() != done || stopping.load(); });
+			writer_waiting.store(false);
+			continue;
+		} // end if
+
+		// Write at most half the ring at once so buffers are freed while the rest are written
+		last = std::min(last, done + std::max<std::uint64_t>(1, capacity / 2));
+		// A batch that wraps around the end of the ring is written as two contiguous pieces
+		const std::uint64_t wrap = done + (capacity - done % capacity);
+		int retval = write_frames(done, std::min(last, wrap));
+		if (retval == NO_ERROR && last > wrap) retval = write_frames(wrap, last);
+		// After an error the frames are dropped so the integrating thread never waits forever
+		int expected = NO_ERROR;
+		if (retval != NO_ERROR) error.compare_exchange_strong(expected, retval);
+
+		done = last;
+		tail.store(done);
+		if (producer_waiting.load()) {
+			std::lock_guard<std::mutex> guard(lock);
+			space.notify_one();
+		} // end if
+	} // end for
+} // end writer_loop
+
+int async_writer::write_frames(std::uint64_t first, std::uint64_t last) {
+	if (error.load(std::memory_order_relaxed) != NO_ERROR) return NO_ERROR;
+	const double* frame = ring.data() + (first % capacity) * frame_size;
+	if (format != OUTPUT_TEXT) return binary.write_frames(frame, static_cast<std::size_t>(last - first));
+
+	// A buffer is laid out like a trajectory frame, so the batch can go straight to the encoder
+	encoder->write(frame, static_cast<std::size_t>(last - first), n, text, ",");
+	return text ? (int)NO_ERROR : (int)ERR_FILE_WRITE;
+} // end write_frames
+
+int async_writer::push(double time, const state_view& state, bool block) {
+	if (running == false) return ERR_FILE_NOT_OPEN;
+	if (state.n != n) return ERR_FILE_FORMAT;
+	const int retval = error.load(std::memory_order_relaxed);
+	if (retval != NO_ERROR) return retval;
+
+	// Backpressure, wait for the writer thread to free a buffer
+	const std::uint64_t next = head.load(std::memory_order_relaxed);
+	if (next - tail.load(std::memory_order_acquire) == capacity) {
+		if (block == false) return ERR_OUTPUT_FULL;
+		stalls++;
+		std::unique_lock<std::mutex> guard(lock);
+		producer_waiting.store(true);
+		space.wait(guard, [&] { return next - tail.load() < capacity; });
+		producer_waiting.store(false);
+	} // end if
+
+	double* frame = ring.data() + (next % capacity) * frame_size;
+	frame[0] = time;
+	std::copy(state.x, state.x + n, frame + 1);
+	std::copy(state.y, state.y + n, frame + 1 + n);
+	std::copy(state.z, state.z + n, frame + 1 + 2 * n);
+	std::copy(state.vx, state.vx + n, frame + 1 + 3 * n);
+	std::copy(state.vy, state.vy + n, frame + 1 + 4 * n);
+	std::copy(state.vz, state.vz + n, frame + 1 + 5 * n);
+	head.store(next + 1);
+
+	// Only take the lock if the writer thread is asleep
+	if (writer_waiting.load()) {
+		std::lock_guard<std::mutex> guard(lock);
+		ready.notify_one();
+	} // end if
+	return NO_ERROR;
+} // end push
+#pragma endregion
+
+#pragma region public functions
+/*****************************************************************************************************
+PUBLIC FUNCTIONS
+*****************************************************************************************************/
+async_writer::async_writer() : format(OUTPUT_TEXT), n(0), frame_size(0), capacity(0), running(false),
+	head(0), tail(0), stopping(false), writer_waiting(false), producer_waiting(false), error(0), stalls(0) {}
+
+async_writer::~async_writer() { close(); }
+
+int async_writer::open(const char* filename, const universe& u, OUTPUT_FORMAT file_format, std::size_t num_buffers, unsigned num_threads) {
+	close();
+	format = file_format;
+	n = u.get_num_of_bodies();
+	frame_size = 1 + 6 * n;
+	capacity = std::max<std::size_t>(2, num_buffers);
+	ring.assign(capacity * frame_size, 0.0);
+	head.store(0), tail.store(0), stopping.store(false), error.store(NO_ERROR);
+	stalls = 0;
+
+	if (format != OUTPUT_TEXT) {
+		const int retval = binary.open(filename, u, format == OUTPUT_COMPRESSED);
+		if (retval != NO_ERROR) return retval;
+	}
+	else {
+		encoder = std::make_unique<csv_encoder>(num_threads);
+		text.open(filename);
+		if (text.is_open() == false) return ERR_FILE_OPEN;
+		// The buffer is only taken once the file is open and before anything is written to it, MSVC ignores it before.
+		// If it is still refused the stream keeps its own small buffer, which is slower but writes the same file
+		text_buffer.resize(text_buffer_size);
+		if (text.rdbuf()->pubsetbuf(text_buffer.data(), static_cast<std::streamsize>(text_buffer.size())) == nullptr) {
+			text_buffer.clear();
+			text_buffer.shrink_to_fit();
+		} // end if
+		output_preamble(u, text);
+	} // end if
+
+	worker = std::thread(&async_writer::writer_loop, this);
+	running = true;
+	return NO_ERROR;
+} // end open
+
+int async_writer::close() {
+	if (running == false) return NO_ERROR;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping.store(true);
+	}
+	ready.notify_one();
+	worker.join();
+	running = false;
+
+	// Every frame has been written, finish the file
+	int retval = error.load();
+	if (format != OUTPUT_TEXT) {
+		const int closed = binary.close();
+		if (retval == NO_ERROR) retval = closed;
+	}
+	else {
+		output_number_of_steps(static_cast<int>(head.load()), text);
+		text.close();
+		if (retval == NO_ERROR && text.fail()) retval = ERR_FILE_WRITE;
+	} // end if
+	return retval;
+} // end close
+#pragma endregion
@@ -0,0 +1,145 @@
+// Contains the asynchronous output writer, which takes the file I/O off the integrating thread
+// The integrator copies each frame into a ring of preallocated frame buffers and a writer thread
+// formats and writes them in batches. The ring has one producer and one consumer so a frame is
+// handed over with two atomic counters and no lock, the lock is only taken to put a thread to sleep
+#ifndef ASYNC_WRITER_H
+#define ASYNC_WRITER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "integrator.h"
+#include "particle_store.h"
+#include "trajectory.h"
+
+class universe;
+class csv_encoder;
+
+/// <summary>
+/// The file formats the output writer can write
+/// </summary>
+enum OUTPUT_FORMAT : int {
+	OUTPUT_TEXT = 0,	// The text format of output.h, read by plot_2d.py and plot_3d.py
+	OUTPUT_BINARY = 1,	// The binary trajectory format of trajectory.h
+	OUTPUT_COMPRESSED = 2,	// The binary trajectory format with the frames in compressed blocks
+};
+
+/// <summary>
+/// Writes frames on its own thread. write_frame blocks while every buffer is waiting to be written
+/// (try_write_frame returns ERR_OUTPUT_FULL instead) so a slow disk slows the integrator down rather
+/// than using more memory. close waits for every frame to be written and then finishes the file
+/// </summary>
+class async_writer {
+private:
+	/*********************************************************
+	Member variables
+	*********************************************************/
+	OUTPUT_FORMAT format;				// Format of the file
+	std::ofstream text;					// The file when writing text
+	std::vector<char> text_buffer;		// Stream buffer of the text file, large so it is written in big blocks
+	std::unique_ptr<csv_encoder> encoder;	// Formats the rows of the text file
+	trajectory_writer binary;			// The file when writing the binary format
+	std::size_t n;						// Number of bodies in a frame
+	std::size_t frame_size;				// Doubles in a frame, time, x[n], y[n], z[n], vx[n], vy[n], vz[n]
+	std::size_t capacity;				// Number of frame buffers in the ring
+	aligned_vector<double> ring;		// The frame buffers, frame i is in slot i % capacity
+	std::thread worker;					// The writer thread
+	bool running;						// The writer thread has been started and not joined
+
+	/*********************************************************
+	Shared between the two threads
+	*********************************************************/
+	alignas(64) std::atomic<std::uint64_t> head;	// Frames handed over, only written by the integrating thread
+	alignas(64) std::atomic<std::uint64_t> tail;	// Frames written, only written by the writer thread
+	alignas(64) std::atomic<bool> stopping;			// Set by close once the last frame has been handed over
+	std::atomic<bool> writer_waiting;				// The writer thread is asleep waiting for frames
+	std::atomic<bool> producer_waiting;				// The integrating thread is asleep waiting for a free buffer
+	std::atomic<int> error;							// First error of the writer thread, see error.h
+	std::mutex lock;								// Only taken to sleep or wake a thread
+	std::condition_variable ready;					// Signals the writer thread that frames were handed over
+	std::condition_variable space;					// Signals the integrating thread that buffers were freed
+	std::uint64_t stalls;							// Times the integrating thread had to wait for a free buffer
+
+	/// <summary>
+	/// The loop the writer thread runs until close is called and every frame is written
+	/// </summary>
+	void writer_loop();
+
+	/// <summary>
+	/// Writes the frames [first, last) of the ring, which are contiguous in memory
+	/// </summary>
+	int write_frames(std::uint64_t first, std::uint64_t last);
+
+	/// <summary>
+	/// Copies a frame into the next buffer, waiting for one if block is true
+	/// </summary>
+	int push(double time, const state_view& state, bool block);
+
+public:
+	/*********************************************************
+	Constructors and destructors
+	*********************************************************/
+	/// <summary>
+	/// Default constructor
+	/// </summary>
+	async_writer();
+
+	/// <summary>
+	/// Destructor, writes every frame still waiting and closes the file
+	/// </summary>
+	~async_writer();
+
+	async_writer(const async_writer&) = delete;
+	async_writer& operator=(const async_writer&) = delete;
+
+	/// <summary>
+	/// Creates the file, writes the preamble of the bodies in a universe and starts the writer thread
+	/// </summary>
+	/// <param name="filename">The file to create, an existing file is overwritten</param>
+	/// <param name="u">The universe</param>
+	/// <param name="file_format">The format of the file</param>
+	/// <param name="num_buffers">Number of frame buffers, the integrator can be this many frames ahead of the disk</param>
+	/// <param name="num_threads">Threads formatting the text format, including the writer thread, 0 uses one per core</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int open(const char* filename, const universe& u, OUTPUT_FORMAT file_format, std::size_t num_buffers = 4096, unsigned num_threads = 1);
+
+	/// <summary>
+	/// Hands a frame over to the writer thread, waiting while every buffer is in use
+	/// </summary>
+	/// <param name="time">Time of the frame</param>
+	/// <param name="state">The state, e.g. universe::get_particles() or the state from universe::dense_output</param>
+	/// <returns>The error code, see error.h for more. Errors of the writer thread are returned here too</returns>
+	int write_frame(double time, const state_view& state) { return push(time, state, true); }
+
+	/// <summary>
+	/// Hands a frame over to the writer thread if a buffer is free
+	/// </summary>
+	/// <param name="time">Time of the frame</param>
+	/// <param name="state">The state, e.g. universe::get_particles() or the state from universe::dense_output</param>
+	/// <returns>The error code, see error.h for more. ERR_OUTPUT_FULL if every buffer is in use and nothing was copied</returns>
+	int try_write_frame(double time, const state_view& state) { return push(time, state, false); }
+
+	/// <summary>
+	/// Waits for every frame to be written, stops the writer thread and finishes the file,
+	/// NUM_STEPS for the text format or the frame count for the binary one. Does nothing if no file is open
+	/// </summary>
+	/// <returns>The error code, see error.h for more</returns>
+	int close();
+
+	/*********************************************************
+	Getters
+	*********************************************************/
+	bool is_open() const { return running; } // Get whether a file is open
+	std::uint64_t get_num_of_frames() const { return head.load(std::memory_order_relaxed); } // Get the number of frames handed over
+	std::uint64_t get_num_of_stalls() const { return stalls; } // Get the number of times write_frame had to wait for a free buffer
+	std::size_t get_capacity() const { return capacity; } // Get the number of frame buffers
+}; // end class async_writer
+
+#endif // ASYNC_WRITER_H
@@ -24,12 +24,45 @@ int body::compute_acceleration(point3 pos, double& ax, double& ay, double& az) {
 	return NO_ERROR;
 } // end compute_acceleration
 
+int body::compute_acceleration(universe* u, point3 offset, double& ax, double& ay, double& az) {
+	// A body that has been removed from the simulation feels no force
+	if (this->get_inlude() == false) return NO_ERROR;
+
+	const particle_store& s = *u->get_particles();
+	// Row of this body in the store, if it is in the universe it must not attract itself
+	const std::size_t self = (this->_store.get() == u->get_particles()) ? this->_index : s.size();
+	const double px = this->get_x(), py = this->get_y(), pz = this->get_z();
+
+	for (std::size_t i = 0; i < s.size(); i++) {
+		// Skip this body and any bodies no longer included in the simulation
+		if (i == self || s.included(i) == false) continue;
+
+		// Same as compute_acceleration on body i with distance_vector(body i, this) + offset
+		const double dx = (s.x[i] - px) + offset.x();
+		const double dy = (s.y[i] - py) + offset.y();
+		const double dz = (s.z[i] - pz) + offset.z();
+		const double r2 = dx * dx + dy * dy + dz * dz;
+		const double scale = -grav_constant * (s.mass[i] / r2);
+		const double inv_r = 1 / std::abs(std::sqrt(r2));
+		ax += scale * (inv_r * dx);
+		ay += scale * (inv_r * dy);
+		az += scale * (inv_r * dz);
+	} // end for
+
+	// if the acceleration applied on a body is NaN return an error
+	// NaN propagates through the sum so checking once after the loop is enough
+	if (ax != ax) return ERR_AX_NAN;
+	if (ay != ay) return ERR_AY_NAN;
+	if (az != az) return ERR_AZ_NAN;
+	return NO_ERROR;
+} // end compute_acceleration
+
 int body::error_check(body* acting_force) {
 	// If two bodies have collided, 'delete' them
 	// if both bodies include flags are true
-	if (this->_include == true && acting_force->_include == true)
+	if (this->get_inlude() == true && acting_force->get_inlude() == true)
 		// If the distance between two bodies in less than the two bodies radii they must have collided
-		if (distance(this->_centre, acting_force->_centre) <= this->_radius + acting_force->_radius) {
+		if (distance(this->get_pos(), acting_force->get_pos()) <= this->get_radius() + acting_force->get_radius()) {
 			std::cerr << "\nBody: " << this->name << " and body: " << acting_force->name << " have collided\n";
 			// Set member variables to zero
 			this->set_to_zero();
@@ -49,17 +82,21 @@ int body::error_check(body* acting_force) {
 } // end error_check
 
 int body::error_check(universe* u) {
+	particle_store& s = *u->get_particles();
+	// Row of this body in the store, if it is in the universe it cannot collide with itself
+	const std::size_t self = (this->_store.get() == u->get_particles()) ? this->_index : s.size();
+
 	// If two bodies have collided, 'delete' them
 	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
+	for (std::size_t i = 0; i < s.size(); i++)
 		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true)
+		if (i != self && this->get_inlude() == true && s.included(i) == true)
 			// If the distance between two bodies in less than the two bodies radii they must have collided
-			if (distance(this->_centre, u->body_at(i)->_centre) <= this->_radius + u->body_at(i)->_radius) {
-				std::cerr << "\nBody: " << this->name << " and body: " << u->body_at(i)->name << " have collided\n";
+			if (distance(this->get_pos(), s.pos(i)) <= this->get_radius() + s.radius[i]) {
+				std::cerr << "\nBody: " << this->name << " and body: " << u->body_at(static_cast<int>(i))->name << " have collided\n";
 				// Set member variables to zero
 				this->set_to_zero();
-				u->body_at(i)->set_to_zero();
+				s.set_to_zero(i);
 				//return ERR_BODIES_COLLIDED;
 			} // end if
 
@@ -140,89 +177,59 @@ int body::compute_rkf45_variables(universe* u, rkf45_variables& v, double dt) {
 	// Calculates Runge-Kutta variables 
 	// K1
 	v.k1x = this->vx, v.k1y = this->vy, v.k1z = this->vz;
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			retval = u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos), v.k1vx, v.k1vy, v.k1vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(0.0, 0.0, 0.0), v.k1vx, v.k1vy, v.k1vz);
+	if (retval != NO_ERROR) return retval;
 
 	// K2
 	v.k2x = this->vx + (v.k1vx * (dt / 4.0)), v.k2y = this->vy + (v.k1vy * (dt / 4.0)), v.k2z = this->vz + (v.k1vz * (dt / 4.0));
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			retval = u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(v.k1x * (dt / 4.0), v.k1y * (dt / 4.0), v.k1z * (dt / 4.0)), v.k2vx, v.k2vy, v.k2vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(v.k1x * (dt / 4.0), v.k1y * (dt / 4.0), v.k1z * (dt / 4.0)), v.k2vx, v.k2vy, v.k2vz);
+	if (retval != NO_ERROR) return retval;
 
 	// K3
 	v.k3x = this->vx + (((3.0 * v.k1vx) / 32.0) + ((9.0 * v.k2vx) / 32.0)) * ((3.0 * dt) / 8.0);
 	v.k3y = this->vy + (((3.0 * v.k1vy) / 32.0) + ((9.0 * v.k2vy) / 32.0)) * ((3.0 * dt) / 8.0);
 	v.k3z = this->vz + (((3.0 * v.k1vz) / 32.0) + ((9.0 * v.k2vz) / 32.0)) * ((3.0 * dt) / 8.0);
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			retval = u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(
-				((((3.0 * v.k1x) / 32.0) + ((9.0 * v.k2x) / 32.0)) * ((3.0 * dt) / 8.0)),
-				((((3.0 * v.k1y) / 32.0) + ((9.0 * v.k2y) / 32.0)) * ((3.0 * dt) / 8.0)),
-				((((3.0 * v.k1z) / 32.0) + ((9.0 * v.k2z) / 32.0)) * ((3.0 * dt) / 8.0))), v.k3vx, v.k3vy, v.k3vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(
+		((((3.0 * v.k1x) / 32.0) + ((9.0 * v.k2x) / 32.0)) * ((3.0 * dt) / 8.0)),
+		((((3.0 * v.k1y) / 32.0) + ((9.0 * v.k2y) / 32.0)) * ((3.0 * dt) / 8.0)),
+		((((3.0 * v.k1z) / 32.0) + ((9.0 * v.k2z) / 32.0)) * ((3.0 * dt) / 8.0))), v.k3vx, v.k3vy, v.k3vz);
+	if (retval != NO_ERROR) return retval;
 
 	// K4
 	v.k4x = this->vx + (((1932.0 * v.k1vx) / 2197.0) - ((7200.0 * v.k2vx) / 2197.0) + ((7296.0 * v.k3vx) / 2197.0)) * ((12.0 * dt) / 13.0);
 	v.k4y = this->vy + (((1932.0 * v.k1vy) / 2197.0) - ((7200.0 * v.k2vy) / 2197.0) + ((7296.0 * v.k3vy) / 2197.0)) * ((12.0 * dt) / 13.0);
 	v.k4z = this->vz + (((1932.0 * v.k1vz) / 2197.0) - ((7200.0 * v.k2vz) / 2197.0) + ((7296.0 * v.k3vz) / 2197.0)) * ((12.0 * dt) / 13.0);
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			retval = u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(
-				((((1932.0 * v.k1x) / 2197.0) - ((7200.0 * v.k2x) / 2197.0) + ((7296.0 * v.k3x) / 2197.0)) * ((12.0 * dt) / 13.0)),
-				((((1932.0 * v.k1y) / 2197.0) - ((7200.0 * v.k2y) / 2197.0) + ((7296.0 * v.k3y) / 2197.0)) * ((12.0 * dt) / 13.0)),
-				((((1932.0 * v.k1z) / 2197.0) - ((7200.0 * v.k2z) / 2197.0) + ((7296.0 * v.k3z) / 2197.0)) * ((12.0 * dt) / 13.0))), v.k4vx, v.k4vy, v.k4vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(
+		((((1932.0 * v.k1x) / 2197.0) - ((7200.0 * v.k2x) / 2197.0) + ((7296.0 * v.k3x) / 2197.0)) * ((12.0 * dt) / 13.0)),
+		((((1932.0 * v.k1y) / 2197.0) - ((7200.0 * v.k2y) / 2197.0) + ((7296.0 * v.k3y) / 2197.0)) * ((12.0 * dt) / 13.0)),
+		((((1932.0 * v.k1z) / 2197.0) - ((7200.0 * v.k2z) / 2197.0) + ((7296.0 * v.k3z) / 2197.0)) * ((12.0 * dt) / 13.0))), v.k4vx, v.k4vy, v.k4vz);
+	if (retval != NO_ERROR) return retval;
 
 	// K5
 	v.k5x = this->vx + (((439.0 * v.k1vx) / 216.0) - (8.0 * v.k2vx) + ((3680.0 * v.k3vx) / 513.0) - ((845.0 * v.k4vx) / 4104.0)) * dt;
 	v.k5y = this->vy + (((439.0 * v.k1vy) / 216.0) - (8.0 * v.k2vy) + ((3680.0 * v.k3vy) / 513.0) - ((845.0 * v.k4vy) / 4104.0)) * dt;
 	v.k5z = this->vz + (((439.0 * v.k1vz) / 216.0) - (8.0 * v.k2vz) + ((3680.0 * v.k3vz) / 513.0) - ((845.0 * v.k4vz) / 4104.0)) * dt;
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			retval = u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(
-				((((439.0 * v.k1x) / 216.0) - (8.0 * v.k2x) + ((3680.0 * v.k3x) / 513.0) - ((845.0 * v.k4x) / 4104.0)) * dt),
-				((((439.0 * v.k1y) / 216.0) - (8.0 * v.k2y) + ((3680.0 * v.k3y) / 513.0) - ((845.0 * v.k4y) / 4104.0)) * dt),
-				((((439.0 * v.k1z) / 216.0) - (8.0 * v.k2z) + ((3680.0 * v.k3z) / 513.0) - ((845.0 * v.k4z) / 4104.0)) * dt)), v.k5vx, v.k5vy, v.k5vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(
+		((((439.0 * v.k1x) / 216.0) - (8.0 * v.k2x) + ((3680.0 * v.k3x) / 513.0) - ((845.0 * v.k4x) / 4104.0)) * dt),
+		((((439.0 * v.k1y) / 216.0) - (8.0 * v.k2y) + ((3680.0 * v.k3y) / 513.0) - ((845.0 * v.k4y) / 4104.0)) * dt),
+		((((439.0 * v.k1z) / 216.0) - (8.0 * v.k2z) + ((3680.0 * v.k3z) / 513.0) - ((845.0 * v.k4z) / 4104.0)) * dt)), v.k5vx, v.k5vy, v.k5vz);
+	if (retval != NO_ERROR) return retval;
 
 	// K6
 	v.k6x = this->vx + (-(8.0 * v.k1vx) / 27.0) + (2.0 * v.k2vx) - ((3544.0 * v.k3vx) / 2565.0) + ((1859.0 * v.k4vx) / 4104.0) - ((11.0 * v.k5vx) / 40.0) * (dt / 2.0);
 	v.k6y = this->vy + (-(8.0 * v.k1vy) / 27.0) + (2.0 * v.k2vy) - ((3544.0 * v.k3vy) / 2565.0) + ((1859.0 * v.k4vy) / 4104.0) - ((11.0 * v.k5vy) / 40.0) * (dt / 2.0);
 	v.k6z = this->vz + (-(8.0 * v.k1vz) / 27.0) + (2.0 * v.k2vz) - ((3544.0 * v.k3vz) / 2565.0) + ((1859.0 * v.k4vz) / 4104.0) - ((11.0 * v.k5vz) / 40.0) * (dt / 2.0);
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			retval = u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(
-				(-(8.0 * v.k1x) / 27.0) + (2.0 * v.k2x) - ((3544.0 * v.k3x) / 2565.0) + ((1859.0 * v.k4x) / 4104.0) - ((11.0 * v.k5x) / 40.0) * (dt / 2.0),
-				(-(8.0 * v.k1y) / 27.0) + (2.0 * v.k2y) - ((3544.0 * v.k3y) / 2565.0) + ((1859.0 * v.k4y) / 4104.0) - ((11.0 * v.k5y) / 40.0) * (dt / 2.0),
-				(-(8.0 * v.k1z) / 27.0) + (2.0 * v.k2z) - ((3544.0 * v.k3z) / 2565.0) + ((1859.0 * v.k4z) / 4104.0) - ((11.0 * v.k5z) / 40.0) * (dt / 2.0)), v.k6vx, v.k6vy, v.k6vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(
+		(-(8.0 * v.k1x) / 27.0) + (2.0 * v.k2x) - ((3544.0 * v.k3x) / 2565.0) + ((1859.0 * v.k4x) / 4104.0) - ((11.0 * v.k5x) / 40.0) * (dt / 2.0),
+		(-(8.0 * v.k1y) / 27.0) + (2.0 * v.k2y) - ((3544.0 * v.k3y) / 2565.0) + ((1859.0 * v.k4y) / 4104.0) - ((11.0 * v.k5y) / 40.0) * (dt / 2.0),
+		(-(8.0 * v.k1z) / 27.0) + (2.0 * v.k2z) - ((3544.0 * v.k3z) / 2565.0) + ((1859.0 * v.k4z) / 4104.0) - ((11.0 * v.k5z) / 40.0) * (dt / 2.0)), v.k6vx, v.k6vy, v.k6vz);
+	if (retval != NO_ERROR) return retval;
 
 	return NO_ERROR;
 } // end compute_rkf45_variables
@@ -334,6 +341,12 @@ int body::update_params(pos_vel_params params) {
 } // end update_params
 
 void body::set_to_zero() {
+	// If the body is in a universe zero its row in the store
+	if (this->_store) {
+		this->_store->set_to_zero(this->_index);
+		return;
+	} // end if
+
 	this->_mass = 0;
 	this->_radius = 0;
 	this->_velocity = vel3(0.0, 0.0, 0.0);
@@ -358,6 +371,26 @@ int body::check_step(double err, double tol, double& dt, pos_vel_params p)
 
 	return NO_ERROR;
 } // end check_step
+
+void body::attach(const std::shared_ptr<particle_store>& store) {
+	// If the body is already in another universe take its current state with it
+	if (this->_store) this->detach();
+	this->_index = store->add(this->_centre, this->_velocity, this->_mass, this->_radius, this->_include);
+	this->_store = store;
+	return;
+} // end attach
+
+void body::detach() {
+	if (!this->_store) return;
+	this->_centre = this->_store->pos(this->_index);
+	this->_velocity = this->_store->vel(this->_index);
+	this->_mass = this->_store->mass[this->_index];
+	this->_radius = this->_store->radius[this->_index];
+	this->_include = this->_store->included(this->_index);
+	this->_store.reset();
+	this->_index = 0;
+	return;
+} // end detach
 #pragma endregion
 
 #pragma region public functions
@@ -403,20 +436,16 @@ int body::step_euler(universe* u, double dt) {
 
 	// Initialise local variables
 	double ax{}, ay{}, az{};
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			retval = u->body_at(i)->compute_acceleration(this->pos, ax, ay, az);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(0.0, 0.0, 0.0), ax, ay, az);
+	if (retval != NO_ERROR) return retval;
 
 	this->x += this->vx * dt;
 	this->y += this->vy * dt;
 	this->z += this->vz * dt;
-	this->vx += ax * dt;
-	this->vy += ay * dt;
-	this->vz += az * dt;
+	this->vx -= ax * dt;
+	this->vy -= ay * dt;
+	this->vz -= az * dt;
 
 	// Check for errors
 	retval = error_check(u);
@@ -492,48 +521,28 @@ int body::step_rk4(universe* u, double dt) {
 
 	// K1
 	double k1x = this->vx, k1y = this->vy, k1z = this->vz;
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos), k1vx, k1vy, k1vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(0.0, 0.0, 0.0), k1vx, k1vy, k1vz);
+	if (retval != NO_ERROR) return retval;
 
 	// Because k2x depends on k1vx they all have to be computed in different for loops
 	// K2
 	double k2x = this->vx + (k1vx * (dt / 2.0)), k2y = this->vy + (k1vy * (dt / 2.0)), k2z = this->vz + (k1vz * (dt / 2.0));
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(k1x * (dt / 2.0), k1y * (dt / 2.0), k1z * (dt / 2.0)), k2vx, k2vy, k2vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(k1x * (dt / 2.0), k1y * (dt / 2.0), k1z * (dt / 2.0)), k2vx, k2vy, k2vz);
+	if (retval != NO_ERROR) return retval;
 	
 	// K3
 	double k3x = this->vx + k2vx * (dt / 2.0), k3y = this->vy + k2vy * (dt / 2.0), k3z = this->vz + (k2vz * (dt / 2.0));
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(k2x * (dt / 2.0), k2y * (dt / 2.0), k2z * (dt / 2.0)), k3vx, k3vy, k3vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(k2x * (dt / 2.0), k2y * (dt / 2.0), k2z * (dt / 2.0)), k3vx, k3vy, k3vz);
+	if (retval != NO_ERROR) return retval;
 	
 	// K4
 	double k4x = this->vx + k3vx * dt, k4y = this->vy + k3vy * dt, k4z = this->vz + k3vz * dt;
-	// Loop through the bodies in the universe
-	for (auto i = 0; i < u->num_of_bodies; i++)
-		// if the body calling this is not the body at i in the list and both bodies include flags are true
-		if (this != u->body_at(i) && this->_include == true && u->body_at(i)->_include == true) {
-			// Compute acceleration
-			u->body_at(i)->compute_acceleration(distance_vector(u->body_at(i)->pos, this->pos) + point3(k3x * dt, k3y * dt, k3z * dt), k4vx, k4vy, k4vz);
-			if (retval != NO_ERROR) return retval;
-		} // end if 
+	// Sum the acceleration from every other body in the universe
+	retval = compute_acceleration(u, point3(k3x * dt, k3y * dt, k3z * dt), k4vx, k4vy, k4vz);
+	if (retval != NO_ERROR) return retval;
 
 	// Updates position and velocity
 	this->x += (dt / 6.0) * (k1x + (2.0 * k2x) + (2.0 * k3x) + k4x); // Update X
@@ -8,10 +8,12 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 
 #include "vec3.h"
 #include "utility.h"
 #include "error.h"
+#include "particle_store.h"
 
 class universe;
 
@@ -50,18 +52,20 @@ class body {
 	member variables for each body.
 	*********************************************************/
 	friend class universe;
-	friend void output_preamble(universe u, std::ostream& ofile); 
-	friend void output(double step_number, universe u, std::ofstream& ofile);
-	friend void output(double step_number, universe u, std::ofstream& ofile, const char* seperator);
-	friend void output_no_whitespace(double step_number, universe u, std::ofstream& ofile, const char* seperator);
-	friend void output(double step_number, body b, std::ofstream& ofile);
-	friend void output(double step_number, body b, std::ofstream& ofile, const char* seperator);
+	friend class trajectory_writer;
+	friend void output_preamble(const universe& u, std::ostream& ofile);
+	friend void output(double step_number, const body& b, std::ostream& ofile);
+	friend void output(double step_number, const body& b, std::ostream& ofile, const char* seperator);
 #pragma endregion
 
 private:
 #pragma region member variables
 	/*********************************************************
 	Member variables
+	The state below is only used while the body is not in a
+	universe. Once added, the body is a handle onto its row
+	of the universe's particle_store and every getter/setter
+	reads and writes the store instead
 	*********************************************************/
 	const std::string _name;	// Name of body
 	point3 _centre;				// Centre of star/planet in 3D space (x, y, z)
@@ -70,6 +74,8 @@ private:
 	vel3 _velocity;				// Velocity of star/planet (vx, vy, vz)
 	bool _include;				// Flag to determine whether the body should be included in the simulation
 								// By default this is true
+	std::shared_ptr<particle_store> _store;	// The store holding this body's state, nullptr if not in a universe
+	std::size_t _index;			// Index of this body in _store
 #pragma endregion
 		
 protected:
@@ -78,29 +84,29 @@ protected:
 	Getters
 	*********************************************************/
 	std::string get_name()	const { return _name; } // Get name of body
-	double	get_x()			const { return _centre.x(); } // Get X pos
-	double	get_y()			const { return _centre.y(); } // Get Y pos
-	double	get_z()			const { return _centre.z(); } // Get Z pos
-	point3	get_pos()		const { return _centre; } // Get position
-	double	get_vx()		const { return _velocity.x(); } // Get X vel
-	double	get_vy()		const { return _velocity.y(); } // Get Y vel
-	double	get_vz()		const { return _velocity.z(); } // Get Z vel
-	vel3	get_vel()		const { return _velocity; } // Get velocity
-	double	get_radius()	const { return _radius; } // Get radius
-	double	get_mass()		const { return _mass; } // Get mass
-	bool	get_inlude()	const { return _include; } // Get include flag
+	double	get_x()			const { return _store ? _store->x[_index] : _centre.x(); } // Get X pos
+	double	get_y()			const { return _store ? _store->y[_index] : _centre.y(); } // Get Y pos
+	double	get_z()			const { return _store ? _store->z[_index] : _centre.z(); } // Get Z pos
+	point3	get_pos()		const { return _store ? _store->pos(_index) : _centre; } // Get position
+	double	get_vx()		const { return _store ? _store->vx[_index] : _velocity.x(); } // Get X vel
+	double	get_vy()		const { return _store ? _store->vy[_index] : _velocity.y(); } // Get Y vel
+	double	get_vz()		const { return _store ? _store->vz[_index] : _velocity.z(); } // Get Z vel
+	vel3	get_vel()		const { return _store ? _store->vel(_index) : _velocity; } // Get velocity
+	double	get_radius()	const { return _store ? _store->radius[_index] : _radius; } // Get radius
+	double	get_mass()		const { return _store ? _store->mass[_index] : _mass; } // Get mass
+	bool	get_inlude()	const { return _store ? _store->included(_index) : _include; } // Get include flag
 
 	/*********************************************************
 	Setters
 	*********************************************************/
-	void set_x(double x) { _centre[0] = std::move(x); } // Set X pos
-	void set_y(double y) { _centre[1] = std::move(y); } // Set Y pos
-	void set_z(double z) { _centre[2] = std::move(z); } // Set Z pos
-	void set_pos(point3 position) { _centre = std::move(position); } // Set Position
-	void set_vx(double vx) { _velocity[0] = std::move(vx); } // Set X vel
-	void set_vy(double vy) { _velocity[1] = std::move(vy); } // Set Y vel
-	void set_vz(double vz) { _velocity[2] = std::move(vz); } // Set Z vel
-	void set_vel(vel3 vel) { _velocity = std::move(vel); } // Set velocity
+	void set_x(double x) { if (_store) _store->x[_index] = x; else _centre[0] = std::move(x); } // Set X pos
+	void set_y(double y) { if (_store) _store->y[_index] = y; else _centre[1] = std::move(y); } // Set Y pos
+	void set_z(double z) { if (_store) _store->z[_index] = z; else _centre[2] = std::move(z); } // Set Z pos
+	void set_pos(point3 position) { set_x(position.x()), set_y(position.y()), set_z(position.z()); } // Set Position
+	void set_vx(double vx) { if (_store) _store->vx[_index] = vx; else _velocity[0] = std::move(vx); } // Set X vel
+	void set_vy(double vy) { if (_store) _store->vy[_index] = vy; else _velocity[1] = std::move(vy); } // Set Y vel
+	void set_vz(double vz) { if (_store) _store->vz[_index] = vz; else _velocity[2] = std::move(vz); } // Set Z vel
+	void set_vel(vel3 vel) { set_vx(vel.x()), set_vy(vel.y()), set_vz(vel.z()); } // Set velocity
 #pragma endregion
 
 #pragma region private functions
@@ -182,6 +188,29 @@ protected:
 	/// </summary>
 	void set_to_zero();
 
+	/// <summary>
+	/// Sums the acceleration on this body from every other included body in the universe.
+	/// Reads the universe's particle_store directly rather than going through body_at
+	/// </summary>
+	/// <param name="u">The universe</param>
+	/// <param name="offset">Offset added to the distance vector of every pair</param>
+	/// <param name="ax">Acceleration in the x direction</param>
+	/// <param name="ay">Acceleration in the y direction</param>
+	/// <param name="az">Acceleration in the z direction</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int compute_acceleration(universe* u, point3 offset, double& ax, double& ay, double& az);
+
+	/// <summary>
+	/// Copies the state of the body onto the end of a particle store, after this the body is a handle onto that row
+	/// </summary>
+	/// <param name="store">The particle store</param>
+	void attach(const std::shared_ptr<particle_store>& store);
+
+	/// <summary>
+	/// Copies the state of the body back out of its particle store so it can be used on its own again
+	/// </summary>
+	void detach();
+
 	/// <summary>
 	/// Checks whether the error is small enough to compute the next step
 	/// </summary>
@@ -201,7 +230,7 @@ public:
 	/// <summary>
 	/// Default constructor
 	/// </summary>
-	body() : _name("NULL"), _centre(point3(0, 0, 0)), _radius(0), _mass(0), _velocity(vel3(0, 0, 0)), _include(true) {}
+	body() : _name("NULL"), _centre(point3(0, 0, 0)), _radius(0), _mass(0), _velocity(vel3(0, 0, 0)), _include(true), _store(nullptr), _index(0) {}
 
 	/// <summary>
 	/// Modified constructor
@@ -211,7 +240,7 @@ public:
 	/// <param name="r">Radius of body</param>
 	/// <param name="m">Mass of body</param>
 	/// <param name="vel">Velocity of body in 3D vector form</param>
-	body(const std::string name, point3 centre, double r, double m, vel3 vel) : _name(name), _centre(centre), _radius(r), _mass(m), _velocity(vel), _include(true) {}
+	body(const std::string name, point3 centre, double r, double m, vel3 vel) : _name(name), _centre(centre), _radius(r), _mass(m), _velocity(vel), _include(true), _store(nullptr), _index(0) {}
 
 	/// <summary>
 	/// Destructor
@@ -0,0 +1,167 @@
+// Contains the Butcher tableaus of the explicit Runge-Kutta methods and the templates that combine their stages
+// Every tableau is a type with constexpr coefficients, so when a stage is built the loop over the earlier stages
+// is unrolled at compile time, the zero coefficients drop out and the fractions are folded into constants.
+// order is the order of b, the error of an embedded tableau scales as dt^order. fsal marks a tableau whose
+// last row of a is b, so its last stage is the derivative at the end of the step
+#ifndef BUTCHER_H
+#define BUTCHER_H
+
+#include <cstddef>
+
+#pragma region tableaus
+/// <summary>
+/// Euler's method, first order
+/// </summary>
+struct euler_tableau {
+	static constexpr int stages = 1;
+	static constexpr int order = 1;
+	static constexpr bool fsal = false;
+	static constexpr double c[stages] = { 0.0 };
+	static constexpr double a[stages][stages] = { { 0.0 } };
+	static constexpr double b[stages] = { 1.0 };
+}; // end euler_tableau
+
+/// <summary>
+/// The classic fourth order Runge-Kutta method
+/// </summary>
+struct rk4_tableau {
+	static constexpr int stages = 4;
+	static constexpr int order = 4;
+	static constexpr bool fsal = false;
+	static constexpr double c[stages] = { 0.0, 1.0 / 2.0, 1.0 / 2.0, 1.0 };
+	static constexpr double a[stages][stages] = {
+		{ 0.0 },
+		{ 1.0 / 2.0 },
+		{ 0.0, 1.0 / 2.0 },
+		{ 0.0, 0.0, 1.0 },
+	};
+	static constexpr double b[stages] = { 1.0 / 6.0, 1.0 / 3.0, 1.0 / 3.0, 1.0 / 6.0 };
+}; // end rk4_tableau
+
+/// <summary>
+/// Runge-Kutta Fehlberg 4(5), b is the fifth order solution and b_hat the fourth order one
+/// </summary>
+struct rkf45_tableau {
+	static constexpr int stages = 6;
+	static constexpr int order = 5;
+	static constexpr bool fsal = false;
+	static constexpr double c[stages] = { 0.0, 1.0 / 4.0, 3.0 / 8.0, 12.0 / 13.0, 1.0, 1.0 / 2.0 };
+	static constexpr double a[stages][stages] = {
+		{ 0.0 },
+		{ 1.0 / 4.0 },
+		{ 3.0 / 32.0, 9.0 / 32.0 },
+		{ 1932.0 / 2197.0, -7200.0 / 2197.0, 7296.0 / 2197.0 },
+		{ 439.0 / 216.0, -8.0, 3680.0 / 513.0, -845.0 / 4104.0 },
+		{ -8.0 / 27.0, 2.0, -3544.0 / 2565.0, 1859.0 / 4104.0, -11.0 / 40.0 },
+	};
+	static constexpr double b[stages] = { 16.0 / 135.0, 0.0, 6656.0 / 12825.0, 28561.0 / 56430.0, -9.0 / 50.0, 2.0 / 55.0 };
+	static constexpr double b_hat[stages] = { 25.0 / 216.0, 0.0, 1408.0 / 2565.0, 2197.0 / 4104.0, -1.0 / 5.0, 0.0 };
+}; // end rkf45_tableau
+
+/// <summary>
+/// Cash-Karp 4(5), b is the fifth order solution and b_hat the fourth order one
+/// </summary>
+struct cash_karp_tableau {
+	static constexpr int stages = 6;
+	static constexpr int order = 5;
+	static constexpr bool fsal = false;
+	static constexpr double c[stages] = { 0.0, 1.0 / 5.0, 3.0 / 10.0, 3.0 / 5.0, 1.0, 7.0 / 8.0 };
+	static constexpr double a[stages][stages] = {
+		{ 0.0 },
+		{ 1.0 / 5.0 },
+		{ 3.0 / 40.0, 9.0 / 40.0 },
+		{ 3.0 / 10.0, -9.0 / 10.0, 6.0 / 5.0 },
+		{ -11.0 / 54.0, 5.0 / 2.0, -70.0 / 27.0, 35.0 / 27.0 },
+		{ 1631.0 / 55296.0, 175.0 / 512.0, 575.0 / 13824.0, 44275.0 / 110592.0, 253.0 / 4096.0 },
+	};
+	static constexpr double b[stages] = { 37.0 / 378.0, 0.0, 250.0 / 621.0, 125.0 / 594.0, 0.0, 512.0 / 1771.0 };
+	static constexpr double b_hat[stages] = { 2825.0 / 27648.0, 0.0, 18575.0 / 48384.0, 13525.0 / 55296.0, 277.0 / 14336.0, 1.0 / 4.0 };
+}; // end cash_karp_tableau
+
+/// <summary>
+/// Dormand-Prince 5(4), b is the fifth order solution and b_hat the fourth order one.
+/// The last row of a is b, so the last stage is the derivative at the end of the step
+/// and is the first stage of the next step (first same as last).
+/// d gives the fourth order dense output of Hairer, Norsett and Wanner
+/// </summary>
+struct dormand_prince_tableau {
+	static constexpr int stages = 7;
+	static constexpr int order = 5;
+	static constexpr bool fsal = true;
+	static constexpr double c[stages] = { 0.0, 1.0 / 5.0, 3.0 / 10.0, 4.0 / 5.0, 8.0 / 9.0, 1.0, 1.0 };
+	static constexpr double a[stages][stages] = {
+		{ 0.0 },
+		{ 1.0 / 5.0 },
+		{ 3.0 / 40.0, 9.0 / 40.0 },
+		{ 44.0 / 45.0, -56.0 / 15.0, 32.0 / 9.0 },
+		{ 19372.0 / 6561.0, -25360.0 / 2187.0, 64448.0 / 6561.0, -212.0 / 729.0 },
+		{ 9017.0 / 3168.0, -355.0 / 33.0, 46732.0 / 5247.0, 49.0 / 176.0, -5103.0 / 18656.0 },
+		{ 35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0 },
+	};
+	static constexpr double b[stages] = { 35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0, 0.0 };
+	static constexpr double b_hat[stages] = { 5179.0 / 57600.0, 0.0, 7571.0 / 16695.0, 393.0 / 640.0, -92097.0 / 339200.0, 187.0 / 2100.0, 1.0 / 40.0 };
+	static constexpr double d[stages] = { -12715105075.0 / 11282082432.0, 0.0, 87487479700.0 / 32700410799.0, -10690763975.0 / 1880347072.0,
+		701980252875.0 / 199316789632.0, -1453857185.0 / 822651844.0, 69997945.0 / 29380423.0 };
+}; // end dormand_prince_tableau
+#pragma endregion
+
+#pragma region rows
+/// <summary>
+/// Row I of the a matrix of a tableau
+/// </summary>
+template <class T, int I>
+struct tableau_a {
+	static constexpr double at(std::size_t j) { return T::a[I][j]; }
+};
+
+/// <summary>
+/// The weights of the solution of a tableau
+/// </summary>
+template <class T>
+struct tableau_b {
+	static constexpr double at(std::size_t j) { return T::b[j]; }
+};
+
+/// <summary>
+/// The weights of the embedded solution of a tableau
+/// </summary>
+template <class T>
+struct tableau_b_hat {
+	static constexpr double at(std::size_t j) { return T::b_hat[j]; }
+};
+
+/// <summary>
+/// The difference between the two solutions of an embedded tableau, the weights of its error estimate
+/// </summary>
+template <class T>
+struct tableau_error {
+	static constexpr double at(std::size_t j) { return T::b[j] - T::b_hat[j]; }
+};
+
+/// <summary>
+/// The dense output weights of a tableau
+/// </summary>
+template <class T>
+struct tableau_dense {
+	static constexpr double at(std::size_t j) { return T::d[j]; }
+};
+#pragma endregion
+
+#pragma region weighted sums
+/// <summary>
+/// Adds Row[j] * k[j][i] onto sum for the stages J to N - 1, unrolled at compile time.
+/// Stages with a coefficient of 0 add no instructions at all
+/// </summary>
+/// <param name="sum">The sum, passed by reference</param>
+/// <param name="k">The stages of one component</param>
+/// <param name="i">The body</param>
+template <class Row, int J, int N>
+inline void weighted_sum(double& sum, const double* const* k, std::size_t i) {
+	if constexpr (J < N) {
+		if constexpr (Row::at(J) != 0.0) sum += Row::at(J) * k[J][i];
+		weighted_sum<Row, J + 1, N>(sum, k, i);
+	} // end if
+} // end weighted_sum
+#pragma endregion
+
+#endif // BUTCHER_H
@@ -45,6 +45,8 @@ universe create_inner_solar_system(void) {
     u.add(&earth);
     u.add(&moon);
     u.add(&mars);
+    // Earth and the Moon orbit each other in their own frame with step_hierarchical
+    u.add_subsystem({ &earth, &moon }, 1);
     return u;
 } // end create_inner_solar_system
 
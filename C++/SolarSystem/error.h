@@ -19,6 +19,9 @@ enum BODY_ERRORS : short {
 									// therefore they have collided
 	ERR_UNIVERSE_NULLPTR = 0x04,	// The universe is a nullptr
 	ERR_BODY_NULLPTR = 0x05,		// The acting force/body is a nullptr
+	ERR_BODY_NOT_IN_UNIVERSE = 0x06,	// The body has not been added to this universe
+	ERR_BODY_IN_SUBSYSTEM = 0x07,	// The body is already in a subsystem
+	ERR_TEST_PARTICLES = 0x08,		// The step cannot move the test particles in the universe
 };
 
 /// <summary>
@@ -35,6 +38,20 @@ enum CALCULATION_ERRORS : short {
 	ERR_AY_NAN = 0x17,	// The ay value returned NaN
 	ERR_AZ_NAN = 0x18,	// The az value returned NaN
 	ERR_OUTSIDE_TOL = 0x19, // The value is outside of the tolerance
+	ERR_KEPLER_NO_CONVERGE = 0x1A, // The Kepler equation solver did not converge
+	ERR_NO_DENSE_OUTPUT = 0x1B, // There is no step to interpolate
+};
+
+/// <summary>
+/// File related errors
+/// </summary>
+enum FILE_ERRORS : short {
+	ERR_FILE_OPEN = 0x20,	// The file could not be opened
+	ERR_FILE_WRITE = 0x21,	// Writing to the file failed
+	ERR_FILE_FORMAT = 0x22,	// The file is not a trajectory file or has an unknown version
+	ERR_FILE_MAP = 0x23,	// The file could not be memory mapped
+	ERR_FILE_NOT_OPEN = 0x24,	// There is no open file
+	ERR_OUTPUT_FULL = 0x25,	// Every frame buffer of the output writer is waiting to be written
 };
 
 /// <summary>
@@ -0,0 +1,333 @@
+// Fast multipole method
+// Expansions are Cartesian Taylor series. A multipole coefficient is M_a = sum gm * s^a where s is
+// the offset of a body from the centre of its cell, a local coefficient L_b is such that the potential
+// about the centre of a cell is sum L_b * t^b. The coefficients of 1/r come from the recurrence
+// |g| r^2 T_g = -(2|g| - 1) sum_i R_i T_(g - e_i) - (|g| - 1) sum_i T_(g - 2e_i)
+
+#include <algorithm>
+#include <cmath>
+
+#include "fmm.h"
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+namespace {
+	// Deepest a cell can be, bodies at (almost) the same position stop being split here
+	const int max_depth = 32;
+	// Fewest tasks the tree is split into. Fixed rather than taken from the number of threads
+	// because where the tasks start changes which cells interact
+	const std::size_t min_tasks = 64;
+
+	/// <summary>
+	/// Gets the octant of the cell a position falls in, bit 0 is x, bit 1 is y and bit 2 is z
+	/// </summary>
+	inline int octant(double x, double y, double z, double cx, double cy, double cz) {
+		return (x >= cx ? 1 : 0) | (y >= cy ? 2 : 0) | (z >= cz ? 4 : 0);
+	} // end octant
+
+	/// <summary>
+	/// Binomial coefficient n choose k
+	/// </summary>
+	double binomial(int n, int k) {
+		double b = 1.0;
+		for (int i = 1; i <= k; i++) b = b * (n - k + i) / i;
+		return b;
+	} // end binomial
+} // end namespace
+
+void fmm::build_tables(int expansion_order) {
+	p = expansion_order;
+	ix.clear(), iy.clear(), iz.clear();
+
+	// Coefficients ordered by total power so every recurrence only looks backwards
+	for (int n = 0; n <= p; n++)
+		for (int a = n; a >= 0; a--)
+			for (int b = n - a; b >= 0; b--)
+				ix.push_back(a), iy.push_back(b), iz.push_back(n - a - b);
+	num_coefs = static_cast<int>(ix.size());
+
+	const int side = p + 1;
+	std::vector<int> lookup(side * side * side, -1);
+	for (int g = 0; g < num_coefs; g++) lookup[(ix[g] * side + iy[g]) * side + iz[g]] = g;
+	auto index = [&](int a, int b, int c) {
+		if (a < 0 || b < 0 || c < 0 || a + b + c > p) return -1;
+		return lookup[(a * side + b) * side + c];
+	};
+
+	prev.assign(num_coefs, -1), axis.assign(num_coefs, 0);
+	for (int i = 0; i < 3; i++) minus1[i].assign(num_coefs, -1), minus2[i].assign(num_coefs, -1);
+	for (int g = 0; g < num_coefs; g++) {
+		const int a = ix[g], b = iy[g], c = iz[g];
+		if (a > 0) prev[g] = index(a - 1, b, c), axis[g] = 0;
+		else if (b > 0) prev[g] = index(a, b - 1, c), axis[g] = 1;
+		else if (c > 0) prev[g] = index(a, b, c - 1), axis[g] = 2;
+		minus1[0][g] = index(a - 1, b, c), minus1[1][g] = index(a, b - 1, c), minus1[2][g] = index(a, b, c - 1);
+		minus2[0][g] = index(a - 2, b, c), minus2[1][g] = index(a, b - 2, c), minus2[2][g] = index(a, b, c - 2);
+	} // end for
+
+	// M2M: M_a += C(a, k) * d^(a - k) * M'_k for every k <= a
+	// L2L: L'_k += C(b, k) * d^(b - k) * L_b for every b >= k
+	m2m.clear(), l2l.clear(), m2l.clear();
+	for (int a = 0; a < num_coefs; a++)
+		for (int k = 0; k < num_coefs; k++) {
+			if (ix[k] > ix[a] || iy[k] > iy[a] || iz[k] > iz[a]) continue;
+			const double coef = binomial(ix[a], ix[k]) * binomial(iy[a], iy[k]) * binomial(iz[a], iz[k]);
+			const int d = index(ix[a] - ix[k], iy[a] - iy[k], iz[a] - iz[k]);
+			m2m.push_back({ a, k, d, coef });
+			l2l.push_back({ k, a, d, coef });
+		} // end for
+
+	// M2L: L_b += (-1)^|a| * C(a + b, a) * M_a * T_(a + b) for |a| + |b| <= p
+	for (int b = 0; b < num_coefs; b++)
+		for (int a = 0; a < num_coefs; a++) {
+			const int g = index(ix[a] + ix[b], iy[a] + iy[b], iz[a] + iz[b]);
+			if (g < 0) continue;
+			const double sign = ((ix[a] + iy[a] + iz[a]) % 2) ? -1.0 : 1.0;
+			const double coef = sign * binomial(ix[a] + ix[b], ix[a]) * binomial(iy[a] + iy[b], iy[a]) * binomial(iz[a] + iz[b], iz[a]);
+			m2l.push_back({ b, a, g, coef });
+		} // end for
+} // end build_tables
+
+void fmm::build_node(const gravity_block& s, std::uint32_t begin, std::uint32_t end,
+	double cx, double cy, double cz, double half, int depth, std::uint32_t parent) {
+	const std::uint32_t index = static_cast<std::uint32_t>(nodes.size());
+	nodes.push_back(fmm_node());
+	nodes[index].parent = parent;
+
+	// The expansions are about the middle of the bodies, which can be well away from the middle of the cube
+	double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+	double m = 0.0;
+	for (std::uint32_t k = begin; k < end; k++) {
+		const std::uint32_t j = order[k];
+		lo[0] = std::min(lo[0], s.x[j]), hi[0] = std::max(hi[0], s.x[j]);
+		lo[1] = std::min(lo[1], s.y[j]), hi[1] = std::max(hi[1], s.y[j]);
+		lo[2] = std::min(lo[2], s.z[j]), hi[2] = std::max(hi[2], s.z[j]);
+		m += s.gm[j];
+	} // end for
+	const double ex = 0.5 * (lo[0] + hi[0]), ey = 0.5 * (lo[1] + hi[1]), ez = 0.5 * (lo[2] + hi[2]);
+	double r2 = 0.0;
+	for (std::uint32_t k = begin; k < end; k++) {
+		const std::uint32_t j = order[k];
+		const double dx = s.x[j] - ex, dy = s.y[j] - ey, dz = s.z[j] - ez;
+		r2 = std::max(r2, dx * dx + dy * dy + dz * dz);
+	} // end for
+
+	if (end - begin <= leaf_size || depth >= max_depth) nodes[index].leaf = true;
+	else {
+		// Sort the bodies of the cell into its eight octants
+		std::uint32_t count[8] = {}, start[9] = {};
+		for (std::uint32_t k = begin; k < end; k++) {
+			const std::uint32_t j = order[k];
+			count[octant(s.x[j], s.y[j], s.z[j], cx, cy, cz)]++;
+		} // end for
+		start[0] = begin;
+		for (int o = 0; o < 8; o++) start[o + 1] = start[o] + count[o];
+		std::uint32_t fill[8];
+		std::copy(start, start + 8, fill);
+		for (std::uint32_t k = begin; k < end; k++) {
+			const std::uint32_t j = order[k];
+			scratch[fill[octant(s.x[j], s.y[j], s.z[j], cx, cy, cz)]++] = j;
+		} // end for
+		std::copy(scratch.begin() + begin, scratch.begin() + end, order.begin() + begin);
+
+		const double quarter = 0.5 * half;
+		for (int o = 0; o < 8; o++) {
+			if (count[o] == 0) continue;
+			build_node(s, start[o], start[o + 1],
+				cx + ((o & 1) ? quarter : -quarter), cy + ((o & 2) ? quarter : -quarter), cz + ((o & 4) ? quarter : -quarter),
+				quarter, depth + 1, index);
+		} // end for
+		nodes[index].leaf = false;
+	} // end if
+
+	fmm_node& node = nodes[index];
+	node.x = ex, node.y = ey, node.z = ez;
+	node.r = std::sqrt(r2);
+	node.gm = m;
+	node.begin = begin;
+	node.end = end;
+	node.next = static_cast<std::uint32_t>(nodes.size());
+} // end build_node
+
+void fmm::powers(double dx, double dy, double dz, double* out) const {
+	const double d[3] = { dx, dy, dz };
+	out[0] = 1.0;
+	for (int g = 1; g < num_coefs; g++) out[g] = out[prev[g]] * d[axis[g]];
+} // end powers
+
+void fmm::derivatives(double dx, double dy, double dz, double* out) const {
+	const double r2 = dx * dx + dy * dy + dz * dz;
+	const double r2_inv = 1.0 / r2;
+	const double d[3] = { dx, dy, dz };
+	out[0] = std::sqrt(r2_inv);
+	for (int g = 1; g < num_coefs; g++) {
+		const int n = ix[g] + iy[g] + iz[g];
+		double first = 0.0, second = 0.0;
+		for (int i = 0; i < 3; i++) {
+			if (minus1[i][g] >= 0) first += d[i] * out[minus1[i][g]];
+			if (minus2[i][g] >= 0) second += out[minus2[i][g]];
+		} // end for
+		out[g] = -((2 * n - 1) * first + (n - 1) * second) * r2_inv / n;
+	} // end for
+} // end derivatives
+
+void fmm::upward_node(std::uint32_t k) {
+	const fmm_node& node = nodes[k];
+	double* m = &multipole[static_cast<std::size_t>(k) * num_coefs];
+	double d[max_coefs];
+	std::fill(m, m + num_coefs, 0.0);
+
+	if (node.leaf) {
+		// P2M, from the bodies of a leaf
+		for (std::uint32_t j = node.begin; j < node.end; j++) {
+			if (gm[j] == 0.0) continue;
+			powers(x[j] - node.x, y[j] - node.y, z[j] - node.z, d);
+			for (int g = 0; g < num_coefs; g++) m[g] += gm[j] * d[g];
+		} // end for
+		return;
+	} // end if
+
+	// M2M, shift the expansion of each child to the centre of this cell
+	for (std::uint32_t c = k + 1; c < node.next; c = nodes[c].next) {
+		if (nodes[c].gm == 0.0) continue;
+		const double* mc = &multipole[static_cast<std::size_t>(c) * num_coefs];
+		powers(nodes[c].x - node.x, nodes[c].y - node.y, nodes[c].z - node.z, d);
+		for (const fmm_term& t : m2m) m[t.to] += t.coef * mc[t.from] * d[t.with];
+	} // end for
+} // end upward_node
+
+void fmm::interact(std::uint32_t t, std::uint32_t s) {
+	const fmm_node& target = nodes[t];
+	const fmm_node& source = nodes[s];
+	if (source.gm == 0.0) return; // Nothing to feel
+
+	// M2L, far enough apart to use the expansions
+	const double dx = target.x - source.x, dy = target.y - source.y, dz = target.z - source.z;
+	const double size = target.r + source.r;
+	if (size * size < theta * theta * (dx * dx + dy * dy + dz * dz)) {
+		double tg[max_coefs];
+		derivatives(dx, dy, dz, tg);
+		double* l = &local[static_cast<std::size_t>(t) * num_coefs];
+		const double* m = &multipole[static_cast<std::size_t>(s) * num_coefs];
+		for (const fmm_term& term : m2l) l[term.to] += term.coef * m[term.from] * tg[term.with];
+		return;
+	} // end if
+
+	// P2P, two leaves too close to use the expansions
+	if (target.leaf && source.leaf) {
+		const gravity_block bodies{ x.data(), y.data(), z.data(), gm.data() };
+		direct_summation(bodies, target.begin, target.end, bodies, source.begin, source.end, ax.data(), ay.data(), az.data());
+		return;
+	} // end if
+
+	// Split the larger of the two cells
+	if (target.leaf == false && (source.leaf || target.r >= source.r)) {
+		for (std::uint32_t c = t + 1; c < target.next; c = nodes[c].next) interact(c, s);
+	}
+	else {
+		for (std::uint32_t c = s + 1; c < source.next; c = nodes[c].next) interact(t, c);
+	} // end if
+} // end interact
+#pragma endregion
+
+#pragma region public functions
+/*****************************************************************************************************
+PUBLIC FUNCTIONS
+*****************************************************************************************************/
+void fmm::build(const gravity_block& bodies, std::size_t n, int expansion_order, double opening_angle) {
+	expansion_order = std::min(std::max(expansion_order, 0), static_cast<int>(max_order));
+	if (expansion_order != p) build_tables(expansion_order);
+	theta = opening_angle;
+	nodes.clear(), tasks.clear(), top.clear();
+	if (n == 0) return;
+
+	// The root is the smallest cube around every body, made slightly larger so no body sits on its edge
+	double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+	order.resize(n);
+	for (std::size_t i = 0; i < n; i++) {
+		order[i] = static_cast<std::uint32_t>(i);
+		lo[0] = std::min(lo[0], bodies.x[i]), hi[0] = std::max(hi[0], bodies.x[i]);
+		lo[1] = std::min(lo[1], bodies.y[i]), hi[1] = std::max(hi[1], bodies.y[i]);
+		lo[2] = std::min(lo[2], bodies.z[i]), hi[2] = std::max(hi[2], bodies.z[i]);
+	} // end for
+	const double half = std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], 1e-300 }) * 0.5 * (1.0 + 1e-12);
+	scratch.resize(n);
+	build_node(bodies, 0, static_cast<std::uint32_t>(n),
+		0.5 * (lo[0] + hi[0]), 0.5 * (lo[1] + hi[1]), 0.5 * (lo[2] + hi[2]), half, 0, 0);
+
+	// Copy the bodies into tree order so each leaf is a contiguous block
+	x.resize(n), y.resize(n), z.resize(n), gm.resize(n);
+	for (std::size_t k = 0; k < n; k++) {
+		const std::uint32_t j = order[k];
+		x[k] = bodies.x[j], y[k] = bodies.y[j], z[k] = bodies.z[j], gm[k] = bodies.gm[j];
+	} // end for
+	ax.assign(n, 0.0), ay.assign(n, 0.0), az.assign(n, 0.0);
+	multipole.resize(nodes.size() * num_coefs);
+	local.assign(nodes.size() * num_coefs, 0.0);
+
+	// Open the tree a level at a time until there are enough subtrees to share out
+	tasks.push_back(0);
+	while (tasks.size() < min_tasks) {
+		std::vector<std::uint32_t> level;
+		bool opened = false;
+		for (std::uint32_t t : tasks) {
+			if (nodes[t].leaf) {
+				level.push_back(t);
+				continue;
+			} // end if
+			top.push_back(t);
+			for (std::uint32_t c = t + 1; c < nodes[t].next; c = nodes[c].next) level.push_back(c);
+			opened = true;
+		} // end for
+		tasks.swap(level);
+		if (opened == false) break;
+	} // end while
+	std::sort(top.begin(), top.end());
+} // end build
+
+void fmm::upward(std::size_t task) {
+	// Children come after their parent so going backwards forms them first
+	const std::uint32_t t = tasks[task];
+	for (std::uint32_t k = nodes[t].next; k-- > t;) upward_node(k);
+} // end upward
+
+void fmm::upward_top() {
+	for (std::size_t k = top.size(); k-- > 0;) upward_node(top[k]);
+} // end upward_top
+
+void fmm::evaluate(std::size_t task, double* out_x, double* out_y, double* out_z) {
+	const std::uint32_t t = tasks[task];
+
+	// Everything this subtree feels, from the whole tree
+	interact(t, 0);
+
+	// L2L down the subtree then L2P onto the bodies of each leaf
+	double d[max_coefs];
+	for (std::uint32_t k = t; k < nodes[t].next; k++) {
+		const fmm_node& node = nodes[k];
+		double* l = &local[static_cast<std::size_t>(k) * num_coefs];
+		if (k != t) {
+			const fmm_node& parent = nodes[node.parent];
+			const double* lp = &local[static_cast<std::size_t>(node.parent) * num_coefs];
+			powers(node.x - parent.x, node.y - parent.y, node.z - parent.z, d);
+			for (const fmm_term& term : l2l) l[term.to] += term.coef * lp[term.from] * d[term.with];
+		} // end if
+		if (node.leaf == false) continue;
+
+		for (std::uint32_t j = node.begin; j < node.end; j++) {
+			// The acceleration is the gradient of sum L_b * t^b
+			powers(x[j] - node.x, y[j] - node.y, z[j] - node.z, d);
+			double gx = 0.0, gy = 0.0, gz = 0.0;
+			for (int g = 1; g < num_coefs; g++) {
+				if (ix[g] > 0) gx += ix[g] * l[g] * d[minus1[0][g]];
+				if (iy[g] > 0) gy += iy[g] * l[g] * d[minus1[1][g]];
+				if (iz[g] > 0) gz += iz[g] * l[g] * d[minus1[2][g]];
+			} // end for
+			const std::uint32_t i = order[j];
+			out_x[i] += ax[j] + gx, out_y[i] += ay[j] + gy, out_z[i] += az[j] + gz;
+		} // end for
+	} // end for
+} // end evaluate
+#pragma endregion
@@ -0,0 +1,173 @@
+// Contains the fast multipole method (FMM) used as an O(N) alternative to direct summation
+// Every cell of an octree gets a multipole expansion of the bodies inside it and a local
+// expansion of the force from far away cells. Far cell pairs interact through their expansions,
+// near leaf pairs through direct summation, and the local expansions are passed down to the bodies
+#ifndef FMM_H
+#define FMM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gravity.h"
+#include "particle_store.h"
+
+/// <summary>
+/// A cell of the FMM octree. Cells are stored in depth first order so the first child
+/// of a cell is the cell after it and next skips past all of its children
+/// </summary>
+struct fmm_node {
+	double x, y, z;			// Centre of the cell, the expansions are about this point
+	double r;				// Distance from the centre to the furthest body in the cell
+	double gm;				// Gravitational constant * mass of everything in the cell
+	std::uint32_t begin;	// First body of the cell in tree order
+	std::uint32_t end;		// One past the last body of the cell in tree order
+	std::uint32_t next;		// The cell after this one and all of its children
+	std::uint32_t parent;	// The cell this one is in, the root is its own parent
+	bool leaf;				// The cell holds bodies rather than children
+};
+
+/// <summary>
+/// One term of a translation between expansions, out[to] += coef * in[from] * factor[with]
+/// </summary>
+struct fmm_term {
+	int to, from, with;
+	double coef;
+};
+
+/// <summary>
+/// Cartesian fast multipole solver over every body in a universe.
+/// The expansions are Taylor series of 1/r truncated at a total order p, the error of a far
+/// interaction falls off roughly as theta^(p + 1) where theta is (r_a + r_b) / distance.
+/// The work is split into subtrees (tasks) which only write to their own cells and bodies,
+/// so tasks can run on different threads and the result does not depend on the number of threads
+/// </summary>
+class fmm {
+private:
+	/*********************************************************
+	Member variables
+	*********************************************************/
+	std::vector<fmm_node> nodes;		// Cells in depth first order, the root is nodes[0]
+	std::vector<std::uint32_t> order;	// Body indices in tree order
+	std::vector<std::uint32_t> scratch;	// Used to sort the bodies into octants
+	aligned_vector<double> x, y, z, gm;	// Bodies in tree order
+	aligned_vector<double> ax, ay, az;	// Acceleration of the bodies in tree order
+	aligned_vector<double> multipole;	// Multipole expansion of every cell, num_coefs per cell
+	aligned_vector<double> local;		// Local expansion of every cell, num_coefs per cell
+	std::vector<std::uint32_t> tasks;	// Roots of the subtrees handed out as tasks
+	std::vector<std::uint32_t> top;		// Cells above the tasks, in depth first order
+	double theta;						// Opening angle, cells interact through their expansions when (r_a + r_b) < theta * distance
+	std::size_t leaf_size;				// Most bodies in a leaf
+
+	/*********************************************************
+	Expansion tables, rebuilt when the order changes
+	*********************************************************/
+	int p;								// Expansion order
+	int num_coefs;						// Number of coefficients in an expansion of order p
+	std::vector<int> ix, iy, iz;		// Powers of x, y and z of each coefficient, ordered by total power
+	std::vector<int> prev;				// Coefficient with one less power of the first non zero axis, -1 for the constant
+	std::vector<int> axis;				// The axis prev removes a power of
+	std::vector<int> minus1[3];			// Coefficient with one less power of x, y or z, -1 if there is none
+	std::vector<int> minus2[3];			// Coefficient with two less powers of x, y or z, -1 if there is none
+	std::vector<fmm_term> m2m;			// Shifts a multipole expansion to a new centre
+	std::vector<fmm_term> m2l;			// Turns a multipole expansion into a local expansion
+	std::vector<fmm_term> l2l;			// Shifts a local expansion to a new centre
+
+	/// <summary>
+	/// Builds the expansion tables for order p
+	/// </summary>
+	/// <param name="expansion_order">The expansion order</param>
+	void build_tables(int expansion_order);
+
+	/// <summary>
+	/// Builds the cell holding the bodies order[begin, end) and all of its children
+	/// </summary>
+	/// <param name="s">The bodies</param>
+	/// <param name="begin">First body of the cell in order</param>
+	/// <param name="end">One past the last body of the cell in order</param>
+	/// <param name="cx">Centre of the cell in x</param>
+	/// <param name="cy">Centre of the cell in y</param>
+	/// <param name="cz">Centre of the cell in z</param>
+	/// <param name="half">Half the side length of the cell</param>
+	/// <param name="depth">Depth of the cell, the root is 0</param>
+	/// <param name="parent">The cell this one is in</param>
+	void build_node(const gravity_block& s, std::uint32_t begin, std::uint32_t end,
+		double cx, double cy, double cz, double half, int depth, std::uint32_t parent);
+
+	/// <summary>
+	/// Computes every product x^a * y^b * z^c up to order p
+	/// </summary>
+	void powers(double dx, double dy, double dz, double* out) const;
+
+	/// <summary>
+	/// Computes the Taylor coefficients D^g(1/r) / g! at (dx, dy, dz) up to order p
+	/// </summary>
+	void derivatives(double dx, double dy, double dz, double* out) const;
+
+	/// <summary>
+	/// Forms the multipole expansion of a cell from its bodies or its children
+	/// </summary>
+	/// <param name="k">The cell</param>
+	void upward_node(std::uint32_t k);
+
+	/// <summary>
+	/// Adds the interaction of the sources in cell s onto the targets in cell t,
+	/// through the expansions if they are far enough apart, otherwise by splitting the larger cell
+	/// </summary>
+	/// <param name="t">The target cell</param>
+	/// <param name="s">The source cell</param>
+	void interact(std::uint32_t t, std::uint32_t s);
+
+public:
+	/*********************************************************
+	Constructors and destructors
+	*********************************************************/
+	/// <summary>
+	/// Default constructor
+	/// </summary>
+	fmm() : theta(0.5), leaf_size(64), p(-1), num_coefs(0) {}
+
+	static const int max_order = 12; // Highest expansion order allowed
+	static const int max_coefs = (max_order + 1) * (max_order + 2) * (max_order + 3) / 6; // Coefficients in an expansion of max_order
+
+	/// <summary>
+	/// Rebuilds the tree from the bodies. Bodies with gm of 0 feel the force but exert none
+	/// </summary>
+	/// <param name="bodies">The bodies</param>
+	/// <param name="n">The number of bodies</param>
+	/// <param name="expansion_order">The expansion order, clamped to [0, max_order]</param>
+	/// <param name="opening_angle">Cells interact through their expansions when (r_a + r_b) / distance is below this</param>
+	void build(const gravity_block& bodies, std::size_t n, int expansion_order, double opening_angle);
+
+	/// <summary>
+	/// Gets the number of tasks, each can be run on any thread once build has been called
+	/// </summary>
+	std::size_t get_num_of_tasks() const { return tasks.size(); }
+
+	/// <summary>
+	/// Forms the multipole expansions of every cell in a task's subtree
+	/// </summary>
+	/// <param name="task">The task</param>
+	void upward(std::size_t task);
+
+	/// <summary>
+	/// Forms the multipole expansions of the cells above the tasks, once every task has run upward
+	/// </summary>
+	void upward_top();
+
+	/// <summary>
+	/// Computes the acceleration of every body in a task's subtree and adds it onto out_x, out_y and out_z
+	/// </summary>
+	/// <param name="task">The task</param>
+	/// <param name="out_x">Acceleration in the x direction, indexed like the bodies</param>
+	/// <param name="out_y">Acceleration in the y direction, indexed like the bodies</param>
+	/// <param name="out_z">Acceleration in the z direction, indexed like the bodies</param>
+	void evaluate(std::size_t task, double* out_x, double* out_y, double* out_z);
+
+	/*********************************************************
+	Getters
+	*********************************************************/
+	std::size_t get_num_of_nodes() const { return nodes.size(); } // Get the number of cells in the tree
+}; // end class fmm
+
+#endif // FMM_H
@@ -0,0 +1,146 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "frame_codec.h"
+#include "error.h"
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+namespace {
+	// Bytes stored for each 3 bit code
+	const int code_bytes[8] = { 0, 1, 2, 3, 5, 6, 7, 8 };
+
+	/// <summary>
+	/// Maps the bits of a double to an integer that grows with the double, so values either side of 0 are close
+	/// </summary>
+	inline std::uint64_t to_ordered(double v) {
+		std::uint64_t bits;
+		std::memcpy(&bits, &v, sizeof(bits));
+		return (bits >> 63) ? ~bits : bits | 0x8000000000000000ull;
+	} // end to_ordered
+
+	/// <summary>
+	/// The inverse of to_ordered
+	/// </summary>
+	inline double from_ordered(std::uint64_t u) {
+		const std::uint64_t bits = (u >> 63) ? u & 0x7FFFFFFFFFFFFFFFull : ~u;
+		double v;
+		std::memcpy(&v, &bits, sizeof(v));
+		return v;
+	} // end from_ordered
+
+	/// <summary>
+	/// Maps a signed difference to an unsigned one with small magnitudes first, 0, -1, 1, -2, ...
+	/// </summary>
+	inline std::uint64_t zigzag(std::uint64_t d) {
+		return (d << 1) ^ (0 - (d >> 63));
+	} // end zigzag
+
+	/// <summary>
+	/// The inverse of zigzag
+	/// </summary>
+	inline std::uint64_t unzigzag(std::uint64_t z) {
+		return (z >> 1) ^ (0 - (z & 1));
+	} // end unzigzag
+
+	/// <summary>
+	/// Gets the 3 bit code of the fewest bytes that hold z, 4 bytes have no code of their own and take 5
+	/// </summary>
+	inline int byte_code(std::uint64_t z) {
+		int n = 0;
+		while (z != 0) n++, z >>= 8;
+		return n <= 3 ? n : std::max(n - 1, 4);
+	} // end byte_code
+
+	/// <summary>
+	/// Predicts value j of frame f from the frames before it. Frames before the first are taken to be
+	/// the first, the first frame itself is predicted as 0. Unsigned arithmetic wraps, so it is exact
+	/// </summary>
+	/// <param name="frames">The frames, every frame before f must already be known</param>
+	/// <param name="f">The frame</param>
+	/// <param name="j">The value in the frame</param>
+	/// <param name="frame_size">The number of values in a frame</param>
+	/// <param name="linear">The linear prediction, passed by reference</param>
+	/// <param name="cubic">The cubic prediction, passed by reference</param>
+	inline void predict(const double* frames, std::size_t f, std::size_t j, std::size_t frame_size,
+		std::uint64_t& linear, std::uint64_t& cubic) {
+		if (f == 0) {
+			linear = cubic = 0;
+			return;
+		} // end if
+		const double* column = frames + j;
+		const std::uint64_t a = to_ordered(column[(f - 1) * frame_size]);
+		const std::uint64_t b = to_ordered(column[(f >= 2 ? f - 2 : 0) * frame_size]);
+		const std::uint64_t c = to_ordered(column[(f >= 3 ? f - 3 : 0) * frame_size]);
+		const std::uint64_t d = to_ordered(column[(f >= 4 ? f - 4 : 0) * frame_size]);
+		linear = 2 * a - b;
+		cubic = 4 * a - 6 * b + 4 * c - d;
+	} // end predict
+} // end namespace
+#pragma endregion
+
+#pragma region public functions
+/*****************************************************************************************************
+PUBLIC FUNCTIONS
+*****************************************************************************************************/
+std::size_t encode_frames(const double* frames, std::size_t count, std::size_t frame_size, std::vector<unsigned char>& out) {
+	const std::size_t start = out.size();
+	out.resize(start + max_encoded_bytes(count, frame_size));
+	unsigned char* p = out.data() + start;
+	unsigned char* header = p;
+
+	const std::size_t values = count * frame_size;
+	for (std::size_t k = 0; k < values; k++) {
+		const std::size_t f = k / frame_size, j = k % frame_size;
+		std::uint64_t linear, cubic;
+		predict(frames, f, j, frame_size, linear, cubic);
+		const std::uint64_t actual = to_ordered(frames[k]);
+		std::uint64_t z = zigzag(actual - linear);
+		int code = byte_code(z);
+		const std::uint64_t z_cubic = zigzag(actual - cubic);
+		const int code_cubic = byte_code(z_cubic);
+		if (code_cubic < code) z = z_cubic, code = code_cubic | 8;
+
+		// The first value of a pair reserves the byte for both codes
+		if (k % 2 == 0) {
+			header = p++;
+			*header = static_cast<unsigned char>(code);
+		}
+		else *header |= static_cast<unsigned char>(code << 4);
+
+		for (int b = 0; b < code_bytes[code & 7]; b++, z >>= 8) *p++ = static_cast<unsigned char>(z);
+	} // end for
+
+	const std::size_t written = p - (out.data() + start);
+	out.resize(start + written);
+	return written;
+} // end encode_frames
+
+int decode_frames(const unsigned char* in, std::size_t bytes, std::size_t count, std::size_t frame_size, double* frames) {
+	const unsigned char* p = in;
+	const unsigned char* end = in + bytes;
+	unsigned char header = 0;
+
+	const std::size_t values = count * frame_size;
+	for (std::size_t k = 0; k < values; k++) {
+		if (k % 2 == 0) {
+			if (p == end) return ERR_FILE_FORMAT;
+			header = *p++;
+		} // end if
+		const int code = (k % 2 == 0) ? header & 15 : header >> 4;
+		const int n = code_bytes[code & 7];
+		if (end - p < n) return ERR_FILE_FORMAT;
+		std::uint64_t z = 0;
+		for (int b = 0; b < n; b++) z |= static_cast<std::uint64_t>(*p++) << (8 * b);
+
+		const std::size_t f = k / frame_size, j = k % frame_size;
+		std::uint64_t linear, cubic;
+		predict(frames, f, j, frame_size, linear, cubic);
+		frames[k] = from_ordered(((code & 8) ? cubic : linear) + unzigzag(z));
+	} // end for
+	return p == end ? (int)NO_ERROR : (int)ERR_FILE_FORMAT;
+} // end decode_frames
+#pragma endregion
@@ -0,0 +1,45 @@
+// Contains the lossless compression of trajectory frames used by the compressed trajectory format
+// Every value of a frame is predicted from the same value in the frames before it, by linear (2a - b)
+// and cubic (4a - 6b + 4c - d) extrapolation. Only the difference between the value and the better of
+// the two predictions is stored, in as few bytes as it needs, so a smooth trajectory needs few bytes
+// per value. The arithmetic is done on the bits of the doubles as integers, so it is exact and
+// decoding gives back exactly the doubles that were encoded, whatever the compiler or floating point mode.
+// Each value gets a 4 bit code, the two codes of a pair of values share a byte which comes before their bytes.
+// The low 3 bits give the number of bytes stored, one of 0, 1, 2, 3, 5, 6, 7 or 8 (4 is stored as 5),
+// and the top bit which prediction was used (0 linear, 1 cubic)
+#ifndef FRAME_CODEC_H
+#define FRAME_CODEC_H
+
+#include <cstddef>
+#include <vector>
+
+/// <summary>
+/// Gets the most bytes encode_frames can write for count frames of frame_size values
+/// </summary>
+inline std::size_t max_encoded_bytes(std::size_t count, std::size_t frame_size) {
+	return count * frame_size * 8 + (count * frame_size + 1) / 2;
+} // end max_encoded_bytes
+
+/// <summary>
+/// Encodes frames and appends them to out. The frames are predicted only from each other, so
+/// the result can be decoded on its own
+/// </summary>
+/// <param name="frames">The frames, one after the other</param>
+/// <param name="count">The number of frames</param>
+/// <param name="frame_size">The number of values in a frame</param>
+/// <param name="out">The bytes are appended to this, passed by reference</param>
+/// <returns>The number of bytes appended</returns>
+std::size_t encode_frames(const double* frames, std::size_t count, std::size_t frame_size, std::vector<unsigned char>& out);
+
+/// <summary>
+/// Decodes frames written by encode_frames
+/// </summary>
+/// <param name="in">The encoded bytes</param>
+/// <param name="bytes">The number of encoded bytes</param>
+/// <param name="count">The number of frames</param>
+/// <param name="frame_size">The number of values in a frame</param>
+/// <param name="frames">Room for count * frame_size values, the frames are written here</param>
+/// <returns>The error code, see error.h for more. ERR_FILE_FORMAT if the bytes do not hold exactly count frames</returns>
+int decode_frames(const unsigned char* in, std::size_t bytes, std::size_t count, std::size_t frame_size, double* frames);
+
+#endif // FRAME_CODEC_H
@@ -0,0 +1,445 @@
+// Direct summation and pairwise gravity kernels
+// The AVX2 and AVX-512 kernels hold 4 or 8 targets in a register and stream the sources past them.
+// Instead of a sqrt followed by a divide, each pair takes one reciprocal square root estimate
+// refined with Newton-Raphson iterations to full double precision, cubed to get r^-3
+// The pairwise kernels compute each pair once and add it to both bodies, the tiles of a
+// round robin schedule let threads share the work without two writing to the same body
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <immintrin.h>
+#endif
+
+#include "gravity.h"
+
+// GCC and Clang only allow intrinsics in functions compiled for that instruction set
+// MSVC allows them anywhere so the attributes are empty
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#define TARGET_AVX512
+#else
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+namespace {
+	// Number of sources streamed past the targets at a time
+	// 1024 sources * 4 arrays * 8 bytes = 32 KB, which stays in L1/L2 while the targets are swept
+	const std::size_t source_tile = 1024;
+	// Bodies in a block of the pairwise kernel, a tile is two blocks
+	// 2 blocks * 256 bodies * 7 arrays * 8 bytes = 28 KB, which stays in L1/L2 while the pairs are swept
+	const std::size_t pairwise_block = 256;
+
+	/// <summary>
+	/// Checks whether the operating system saves the AVX (and AVX-512) registers on a context switch
+	/// </summary>
+	bool os_supports(std::uint64_t mask) {
+#if defined(_MSC_VER)
+		return (_xgetbv(0) & mask) == mask;
+#else
+		std::uint32_t eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return ((static_cast<std::uint64_t>(edx) << 32 | eax) & mask) == mask;
+#endif
+	} // end os_supports
+
+	/// <summary>
+	/// Runs cpuid for a leaf and sub-leaf
+	/// </summary>
+	void cpuid(int leaf, int subleaf, int regs[4]) {
+#if defined(_MSC_VER)
+		__cpuidex(regs, leaf, subleaf);
+#else
+		__asm__ volatile("cpuid" : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3]) : "a"(leaf), "c"(subleaf));
+#endif
+	} // end cpuid
+
+	SIMD_LEVEL& current_simd_level() {
+		static SIMD_LEVEL level = detect_simd_level();
+		return level;
+	} // end current_simd_level
+
+	/// <summary>
+	/// Scalar kernel, also used for the targets left over after the vector kernels
+	/// </summary>
+	void direct_summation_scalar(const gravity_block& t, std::size_t t_begin, std::size_t t_end,
+		const gravity_block& s, std::size_t s_begin, std::size_t s_end, double* ax, double* ay, double* az) {
+		for (std::size_t i = t_begin; i < t_end; i++) {
+			const double xi = t.x[i], yi = t.y[i], zi = t.z[i];
+			double axi = 0.0, ayi = 0.0, azi = 0.0;
+			for (std::size_t j = s_begin; j < s_end; j++) {
+				const double dx = s.x[j] - xi, dy = s.y[j] - yi, dz = s.z[j] - zi;
+				const double r2 = dx * dx + dy * dy + dz * dz;
+				if (r2 == 0.0) continue; // Body and itself
+				const double f = s.gm[j] / (r2 * std::sqrt(r2));
+				axi += f * dx, ayi += f * dy, azi += f * dz;
+			} // end for
+			ax[i] += axi, ay[i] += ayi, az[i] += azi;
+		} // end for
+	} // end direct_summation_scalar
+
+	/// <summary>
+	/// 1/sqrt(r2) for 4 doubles. AVX2 has no double precision estimate so the first guess comes from
+	/// halving the exponent with an integer subtract (the "fast inverse square root" constant for doubles,
+	/// within 3.5%), four Newton-Raphson steps then take it to full precision for any normal double
+	/// </summary>
+	TARGET_AVX2 inline __m256d rsqrt_avx2(__m256d r2) {
+		const __m256i magic = _mm256_set1_epi64x(0x5FE6EB50C7B537A9LL);
+		__m256d y = _mm256_castsi256_pd(_mm256_sub_epi64(magic, _mm256_srli_epi64(_mm256_castpd_si256(r2), 1)));
+		const __m256d half_r2 = _mm256_mul_pd(_mm256_set1_pd(0.5), r2);
+		const __m256d three_halves = _mm256_set1_pd(1.5);
+		for (int k = 0; k < 4; k++) // y = y * (1.5 - 0.5 * r2 * y * y)
+			y = _mm256_mul_pd(y, _mm256_fnmadd_pd(_mm256_mul_pd(half_r2, y), y, three_halves));
+		return y;
+	} // end rsqrt_avx2
+
+	TARGET_AVX2 void direct_summation_avx2(const gravity_block& t, std::size_t t_begin, std::size_t t_end,
+		const gravity_block& s, std::size_t s_begin, std::size_t s_end, double* ax, double* ay, double* az) {
+		const __m256d zero = _mm256_setzero_pd();
+		std::size_t i = t_begin;
+		for (; i + 4 <= t_end; i += 4) {
+			const __m256d xi = _mm256_loadu_pd(t.x + i), yi = _mm256_loadu_pd(t.y + i), zi = _mm256_loadu_pd(t.z + i);
+			__m256d axi = zero, ayi = zero, azi = zero;
+			for (std::size_t j = s_begin; j < s_end; j++) {
+				const __m256d dx = _mm256_sub_pd(_mm256_broadcast_sd(s.x + j), xi);
+				const __m256d dy = _mm256_sub_pd(_mm256_broadcast_sd(s.y + j), yi);
+				const __m256d dz = _mm256_sub_pd(_mm256_broadcast_sd(s.z + j), zi);
+				const __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dz, dz)));
+				const __m256d r_inv = rsqrt_avx2(r2);
+				// gm / r^3, zero for the body and itself
+				__m256d f = _mm256_mul_pd(_mm256_mul_pd(_mm256_broadcast_sd(s.gm + j), r_inv), _mm256_mul_pd(r_inv, r_inv));
+				f = _mm256_and_pd(f, _mm256_cmp_pd(r2, zero, _CMP_GT_OQ));
+				axi = _mm256_fmadd_pd(f, dx, axi);
+				ayi = _mm256_fmadd_pd(f, dy, ayi);
+				azi = _mm256_fmadd_pd(f, dz, azi);
+			} // end for
+			_mm256_storeu_pd(ax + i, _mm256_add_pd(_mm256_loadu_pd(ax + i), axi));
+			_mm256_storeu_pd(ay + i, _mm256_add_pd(_mm256_loadu_pd(ay + i), ayi));
+			_mm256_storeu_pd(az + i, _mm256_add_pd(_mm256_loadu_pd(az + i), azi));
+		} // end for
+		direct_summation_scalar(t, i, t_end, s, s_begin, s_end, ax, ay, az);
+	} // end direct_summation_avx2
+
+	/// <summary>
+	/// 1/sqrt(r2) for 8 doubles from the 14 bit estimate, two Newton-Raphson steps give full precision
+	/// </summary>
+	TARGET_AVX512 inline __m512d rsqrt_avx512(__m512d r2) {
+		__m512d y = _mm512_rsqrt14_pd(r2);
+		const __m512d half_r2 = _mm512_mul_pd(_mm512_set1_pd(0.5), r2);
+		const __m512d three_halves = _mm512_set1_pd(1.5);
+		y = _mm512_mul_pd(y, _mm512_fnmadd_pd(_mm512_mul_pd(half_r2, y), y, three_halves));
+		y = _mm512_mul_pd(y, _mm512_fnmadd_pd(_mm512_mul_pd(half_r2, y), y, three_halves));
+		return y;
+	} // end rsqrt_avx512
+
+	TARGET_AVX512 void direct_summation_avx512(const gravity_block& t, std::size_t t_begin, std::size_t t_end,
+		const gravity_block& s, std::size_t s_begin, std::size_t s_end, double* ax, double* ay, double* az) {
+		const __m512d zero = _mm512_setzero_pd();
+		std::size_t i = t_begin;
+		for (; i + 8 <= t_end; i += 8) {
+			const __m512d xi = _mm512_loadu_pd(t.x + i), yi = _mm512_loadu_pd(t.y + i), zi = _mm512_loadu_pd(t.z + i);
+			__m512d axi = zero, ayi = zero, azi = zero;
+			for (std::size_t j = s_begin; j < s_end; j++) {
+				const __m512d dx = _mm512_sub_pd(_mm512_set1_pd(s.x[j]), xi);
+				const __m512d dy = _mm512_sub_pd(_mm512_set1_pd(s.y[j]), yi);
+				const __m512d dz = _mm512_sub_pd(_mm512_set1_pd(s.z[j]), zi);
+				const __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dz, dz)));
+				const __mmask8 not_self = _mm512_cmp_pd_mask(r2, zero, _CMP_GT_OQ);
+				const __m512d r_inv = rsqrt_avx512(r2);
+				// gm / r^3, zero for the body and itself
+				const __m512d f = _mm512_maskz_mul_pd(not_self, _mm512_mul_pd(_mm512_set1_pd(s.gm[j]), r_inv), _mm512_mul_pd(r_inv, r_inv));
+				axi = _mm512_fmadd_pd(f, dx, axi);
+				ayi = _mm512_fmadd_pd(f, dy, ayi);
+				azi = _mm512_fmadd_pd(f, dz, azi);
+			} // end for
+			_mm512_storeu_pd(ax + i, _mm512_add_pd(_mm512_loadu_pd(ax + i), axi));
+			_mm512_storeu_pd(ay + i, _mm512_add_pd(_mm512_loadu_pd(ay + i), ayi));
+			_mm512_storeu_pd(az + i, _mm512_add_pd(_mm512_loadu_pd(az + i), azi));
+		} // end for
+		direct_summation_scalar(t, i, t_end, s, s_begin, s_end, ax, ay, az);
+	} // end direct_summation_avx512
+
+	/// <summary>
+	/// Pairwise scalar kernel for bodies [i_begin, i_end) against [j_begin, j_end).
+	/// Each pair is computed once and adds equal and opposite terms to both bodies, when the
+	/// ranges are the same block only the pairs with i < j are used
+	/// </summary>
+	void pairwise_tile_scalar(const gravity_block& b, std::size_t i_begin, std::size_t i_end,
+		std::size_t j_begin, std::size_t j_end, bool diagonal, double* ax, double* ay, double* az) {
+		for (std::size_t i = i_begin; i < i_end; i++) {
+			const double xi = b.x[i], yi = b.y[i], zi = b.z[i], gmi = b.gm[i];
+			double axi = 0.0, ayi = 0.0, azi = 0.0;
+			for (std::size_t j = diagonal ? i + 1 : j_begin; j < j_end; j++) {
+				const double dx = b.x[j] - xi, dy = b.y[j] - yi, dz = b.z[j] - zi;
+				const double r2 = dx * dx + dy * dy + dz * dz;
+				if (r2 == 0.0) continue; // Bodies at the same position
+				const double r_inv3 = 1.0 / (r2 * std::sqrt(r2));
+				const double fi = b.gm[j] * r_inv3, fj = gmi * r_inv3;
+				axi += fi * dx, ayi += fi * dy, azi += fi * dz;
+				ax[j] -= fj * dx, ay[j] -= fj * dy, az[j] -= fj * dz;
+			} // end for
+			ax[i] += axi, ay[i] += ayi, az[i] += azi;
+		} // end for
+	} // end pairwise_tile_scalar
+
+	/// <summary>
+	/// Sum of the 4 doubles in a register
+	/// </summary>
+	TARGET_AVX2 inline double horizontal_sum_avx2(__m256d v) {
+		const __m128d pair = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+		return _mm_cvtsd_f64(_mm_add_sd(pair, _mm_unpackhi_pd(pair, pair)));
+	} // end horizontal_sum_avx2
+
+	TARGET_AVX2 void pairwise_tile_avx2(const gravity_block& b, std::size_t i_begin, std::size_t i_end,
+		std::size_t j_begin, std::size_t j_end, bool diagonal, double* ax, double* ay, double* az) {
+		const __m256d zero = _mm256_setzero_pd();
+		for (std::size_t i = i_begin; i < i_end; i++) {
+			const __m256d xi = _mm256_set1_pd(b.x[i]), yi = _mm256_set1_pd(b.y[i]), zi = _mm256_set1_pd(b.z[i]);
+			const __m256d gmi = _mm256_set1_pd(b.gm[i]);
+			__m256d axi = zero, ayi = zero, azi = zero;
+			std::size_t j = diagonal ? i + 1 : j_begin;
+			for (; j + 4 <= j_end; j += 4) {
+				const __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(b.x + j), xi);
+				const __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(b.y + j), yi);
+				const __m256d dz = _mm256_sub_pd(_mm256_loadu_pd(b.z + j), zi);
+				const __m256d r2 = _mm256_fmadd_pd(dx, dx, _mm256_fmadd_pd(dy, dy, _mm256_mul_pd(dz, dz)));
+				const __m256d r_inv = rsqrt_avx2(r2);
+				// r^-3, zero for bodies at the same position
+				__m256d r_inv3 = _mm256_mul_pd(_mm256_mul_pd(r_inv, r_inv), r_inv);
+				r_inv3 = _mm256_and_pd(r_inv3, _mm256_cmp_pd(r2, zero, _CMP_GT_OQ));
+				const __m256d fi = _mm256_mul_pd(_mm256_loadu_pd(b.gm + j), r_inv3);
+				const __m256d fj = _mm256_mul_pd(gmi, r_inv3);
+				axi = _mm256_fmadd_pd(fi, dx, axi);
+				ayi = _mm256_fmadd_pd(fi, dy, ayi);
+				azi = _mm256_fmadd_pd(fi, dz, azi);
+				_mm256_storeu_pd(ax + j, _mm256_fnmadd_pd(fj, dx, _mm256_loadu_pd(ax + j)));
+				_mm256_storeu_pd(ay + j, _mm256_fnmadd_pd(fj, dy, _mm256_loadu_pd(ay + j)));
+				_mm256_storeu_pd(az + j, _mm256_fnmadd_pd(fj, dz, _mm256_loadu_pd(az + j)));
+			} // end for
+			ax[i] += horizontal_sum_avx2(axi), ay[i] += horizontal_sum_avx2(ayi), az[i] += horizontal_sum_avx2(azi);
+			// The last few pairs of the row
+			if (j < j_end) pairwise_tile_scalar(b, i, i + 1, j, j_end, false, ax, ay, az);
+		} // end for
+	} // end pairwise_tile_avx2
+
+	TARGET_AVX512 void pairwise_tile_avx512(const gravity_block& b, std::size_t i_begin, std::size_t i_end,
+		std::size_t j_begin, std::size_t j_end, bool diagonal, double* ax, double* ay, double* az) {
+		const __m512d zero = _mm512_setzero_pd();
+		for (std::size_t i = i_begin; i < i_end; i++) {
+			const __m512d xi = _mm512_set1_pd(b.x[i]), yi = _mm512_set1_pd(b.y[i]), zi = _mm512_set1_pd(b.z[i]);
+			const __m512d gmi = _mm512_set1_pd(b.gm[i]);
+			__m512d axi = zero, ayi = zero, azi = zero;
+			for (std::size_t j = diagonal ? i + 1 : j_begin; j < j_end; j += 8) {
+				// The last few pairs of the row are masked off
+				const __mmask8 live = (j_end - j >= 8) ? static_cast<__mmask8>(0xFF) : static_cast<__mmask8>((1u << (j_end - j)) - 1);
+				const __m512d dx = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, b.x + j), xi);
+				const __m512d dy = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, b.y + j), yi);
+				const __m512d dz = _mm512_sub_pd(_mm512_maskz_loadu_pd(live, b.z + j), zi);
+				const __m512d r2 = _mm512_fmadd_pd(dx, dx, _mm512_fmadd_pd(dy, dy, _mm512_mul_pd(dz, dz)));
+				const __mmask8 use = _mm512_mask_cmp_pd_mask(live, r2, zero, _CMP_GT_OQ);
+				const __m512d r_inv = rsqrt_avx512(r2);
+				// r^-3, zero for bodies at the same position and lanes past the end
+				const __m512d r_inv3 = _mm512_maskz_mul_pd(use, _mm512_mul_pd(r_inv, r_inv), r_inv);
+				const __m512d fi = _mm512_mul_pd(_mm512_maskz_loadu_pd(live, b.gm + j), r_inv3);
+				const __m512d fj = _mm512_mul_pd(gmi, r_inv3);
+				axi = _mm512_fmadd_pd(fi, dx, axi);
+				ayi = _mm512_fmadd_pd(fi, dy, ayi);
+				azi = _mm512_fmadd_pd(fi, dz, azi);
+				_mm512_mask_storeu_pd(ax + j, live, _mm512_fnmadd_pd(fj, dx, _mm512_maskz_loadu_pd(live, ax + j)));
+				_mm512_mask_storeu_pd(ay + j, live, _mm512_fnmadd_pd(fj, dy, _mm512_maskz_loadu_pd(live, ay + j)));
+				_mm512_mask_storeu_pd(az + j, live, _mm512_fnmadd_pd(fj, dz, _mm512_maskz_loadu_pd(live, az + j)));
+			} // end for
+			ax[i] += _mm512_reduce_add_pd(axi), ay[i] += _mm512_reduce_add_pd(ayi), az[i] += _mm512_reduce_add_pd(azi);
+		} // end for
+	} // end pairwise_tile_avx512
+
+	/// <summary>
+	/// Gets the number of blocks the pairwise kernel splits n bodies into, rounded up to even
+	/// so the round robin schedule pairs every block in every round
+	/// </summary>
+	std::size_t pairwise_num_blocks(std::size_t n) {
+		const std::size_t blocks = (n + pairwise_block - 1) / pairwise_block;
+		return (blocks <= 1) ? blocks : blocks + (blocks & 1);
+	} // end pairwise_num_blocks
+
+	/// <summary>
+	/// Gets the two blocks of bodies a tile of the pairwise kernel pairs up.
+	/// Round 0 is block tile against itself. The other rounds use the circle method,
+	/// the last block stays put while the rest rotate so each block meets every other exactly once
+	/// </summary>
+	/// <returns>False for the padding block, which has no bodies</returns>
+	bool pairwise_tile_range(std::size_t n, std::size_t round, std::size_t tile, std::size_t& a_begin, std::size_t& a_end,
+		std::size_t& b_begin, std::size_t& b_end, bool& diagonal) {
+		const std::size_t blocks = pairwise_num_blocks(n);
+		std::size_t a = tile, b = tile;
+		if (round > 0) {
+			const std::size_t spin = blocks - 1, r = round - 1;
+			if (tile == 0) a = r, b = spin;
+			else a = (r + tile) % spin, b = (r + spin - tile) % spin;
+		} // end if
+
+		a_begin = std::min(a * pairwise_block, n), a_end = std::min(a_begin + pairwise_block, n);
+		b_begin = std::min(b * pairwise_block, n), b_end = std::min(b_begin + pairwise_block, n);
+		diagonal = (a == b);
+		return a_begin != a_end && b_begin != b_end;
+	} // end pairwise_tile_range
+} // end namespace
+#pragma endregion
+
+#pragma region public functions
+/*****************************************************************************************************
+PUBLIC FUNCTIONS
+*****************************************************************************************************/
+SIMD_LEVEL detect_simd_level() {
+	int regs[4];
+	cpuid(0, 0, regs);
+	const int max_leaf = regs[0];
+	if (max_leaf < 7) return SIMD_SCALAR;
+
+	cpuid(1, 0, regs);
+	const bool fma = (regs[2] & (1 << 12)) != 0;
+	const bool osxsave = (regs[2] & (1 << 27)) != 0;
+	const bool avx = (regs[2] & (1 << 28)) != 0;
+	// The OS has to save the YMM (bits 1, 2) and for AVX-512 also the opmask and ZMM (bits 5, 6, 7) state
+	if (!osxsave || !avx || !os_supports(0x06)) return SIMD_SCALAR;
+
+	cpuid(7, 0, regs);
+	const bool avx2 = (regs[1] & (1 << 5)) != 0;
+	const bool avx512f = (regs[1] & (1 << 16)) != 0;
+
+	if (avx512f && os_supports(0xE6)) return SIMD_AVX512;
+	if (avx2 && fma) return SIMD_AVX2;
+	return SIMD_SCALAR;
+} // end detect_simd_level
+
+SIMD_LEVEL get_simd_level() {
+	return current_simd_level();
+} // end get_simd_level
+
+SIMD_LEVEL set_simd_level(SIMD_LEVEL level) {
+	const SIMD_LEVEL supported = detect_simd_level();
+	current_simd_level() = (level > supported) ? supported : level;
+	return current_simd_level();
+} // end set_simd_level
+
+void direct_summation(const gravity_block& targets, std::size_t t_begin, std::size_t t_end,
+	const gravity_block& sources, std::size_t s_begin, std::size_t s_end,
+	double* ax, double* ay, double* az) {
+	const SIMD_LEVEL level = current_simd_level();
+
+	// Stream the sources past the targets one tile at a time so they stay in cache
+	for (std::size_t s = s_begin; s < s_end; s += source_tile) {
+		const std::size_t s_stop = std::min(s + source_tile, s_end);
+		switch (level) {
+		case SIMD_AVX512:
+			direct_summation_avx512(targets, t_begin, t_end, sources, s, s_stop, ax, ay, az);
+			break;
+		case SIMD_AVX2:
+			direct_summation_avx2(targets, t_begin, t_end, sources, s, s_stop, ax, ay, az);
+			break;
+		default:
+			direct_summation_scalar(targets, t_begin, t_end, sources, s, s_stop, ax, ay, az);
+			break;
+		} // end switch
+	} // end for
+} // end direct_summation
+
+void direct_summation_jerk(const gravity_block& targets, const velocity_block& target_v, std::size_t t_begin, std::size_t t_end,
+	const gravity_block& sources, const velocity_block& source_v, std::size_t s_begin, std::size_t s_end,
+	double* ax, double* ay, double* az, double* jx, double* jy, double* jz) {
+	// a = gm * d / r^3 and j = gm * (w / r^3 - 3 (d.w) d / r^5) with d and w the relative position and velocity
+	for (std::size_t i = t_begin; i < t_end; i++) {
+		const double xi = targets.x[i], yi = targets.y[i], zi = targets.z[i];
+		const double vxi = target_v.vx[i], vyi = target_v.vy[i], vzi = target_v.vz[i];
+		double axi = 0.0, ayi = 0.0, azi = 0.0, jxi = 0.0, jyi = 0.0, jzi = 0.0;
+		for (std::size_t j = s_begin; j < s_end; j++) {
+			const double dx = sources.x[j] - xi, dy = sources.y[j] - yi, dz = sources.z[j] - zi;
+			const double r2 = dx * dx + dy * dy + dz * dz;
+			if (r2 == 0.0) continue; // Body and itself
+			const double wx = source_v.vx[j] - vxi, wy = source_v.vy[j] - vyi, wz = source_v.vz[j] - vzi;
+			const double r_inv2 = 1.0 / r2;
+			const double f = sources.gm[j] * r_inv2 * std::sqrt(r_inv2);
+			const double g = 3.0 * (dx * wx + dy * wy + dz * wz) * r_inv2;
+			axi += f * dx, ayi += f * dy, azi += f * dz;
+			jxi += f * (wx - g * dx), jyi += f * (wy - g * dy), jzi += f * (wz - g * dz);
+		} // end for
+		ax[i] += axi, ay[i] += ayi, az[i] += azi;
+		jx[i] += jxi, jy[i] += jyi, jz[i] += jzi;
+	} // end for
+} // end direct_summation_jerk
+
+std::size_t pairwise_num_rounds(std::size_t n) {
+	// One round for the blocks against themselves, then every block meets every other once
+	return pairwise_num_blocks(n);
+} // end pairwise_num_rounds
+
+std::size_t pairwise_num_tiles(std::size_t n, std::size_t round) {
+	const std::size_t blocks = pairwise_num_blocks(n);
+	return (round == 0) ? blocks : blocks / 2;
+} // end pairwise_num_tiles
+
+void pairwise_tile(const gravity_block& bodies, std::size_t n, std::size_t round, std::size_t tile,
+	double* ax, double* ay, double* az) {
+	std::size_t a_begin, a_end, b_begin, b_end;
+	bool diagonal;
+	if (pairwise_tile_range(n, round, tile, a_begin, a_end, b_begin, b_end, diagonal) == false) return; // The padding block
+
+	switch (current_simd_level()) {
+	case SIMD_AVX512:
+		pairwise_tile_avx512(bodies, a_begin, a_end, b_begin, b_end, diagonal, ax, ay, az);
+		break;
+	case SIMD_AVX2:
+		pairwise_tile_avx2(bodies, a_begin, a_end, b_begin, b_end, diagonal, ax, ay, az);
+		break;
+	default:
+		pairwise_tile_scalar(bodies, a_begin, a_end, b_begin, b_end, diagonal, ax, ay, az);
+		break;
+	} // end switch
+} // end pairwise_tile
+
+void pairwise_jerk_tile(const gravity_block& bodies, const velocity_block& v, std::size_t n, std::size_t round, std::size_t tile,
+	double* ax, double* ay, double* az, double* jx, double* jy, double* jz) {
+	std::size_t a_begin, a_end, b_begin, b_end;
+	bool diagonal;
+	if (pairwise_tile_range(n, round, tile, a_begin, a_end, b_begin, b_end, diagonal) == false) return; // The padding block
+
+	// a = gm * d / r^3 and j = gm * (w / r^3 - 3 (d.w) d / r^5), both change sign when the pair is swapped
+	for (std::size_t i = a_begin; i < a_end; i++) {
+		const double xi = bodies.x[i], yi = bodies.y[i], zi = bodies.z[i], gmi = bodies.gm[i];
+		const double vxi = v.vx[i], vyi = v.vy[i], vzi = v.vz[i];
+		double axi = 0.0, ayi = 0.0, azi = 0.0, jxi = 0.0, jyi = 0.0, jzi = 0.0;
+		for (std::size_t j = diagonal ? i + 1 : b_begin; j < b_end; j++) {
+			const double dx = bodies.x[j] - xi, dy = bodies.y[j] - yi, dz = bodies.z[j] - zi;
+			const double r2 = dx * dx + dy * dy + dz * dz;
+			if (r2 == 0.0) continue; // Bodies at the same position
+			const double wx = v.vx[j] - vxi, wy = v.vy[j] - vyi, wz = v.vz[j] - vzi;
+			const double r_inv2 = 1.0 / r2;
+			const double r_inv3 = r_inv2 * std::sqrt(r_inv2);
+			const double g = 3.0 * (dx * wx + dy * wy + dz * wz) * r_inv2;
+			const double kx = wx - g * dx, ky = wy - g * dy, kz = wz - g * dz;
+			const double fi = bodies.gm[j] * r_inv3, fj = gmi * r_inv3;
+			axi += fi * dx, ayi += fi * dy, azi += fi * dz;
+			jxi += fi * kx, jyi += fi * ky, jzi += fi * kz;
+			ax[j] -= fj * dx, ay[j] -= fj * dy, az[j] -= fj * dz;
+			jx[j] -= fj * kx, jy[j] -= fj * ky, jz[j] -= fj * kz;
+		} // end for
+		ax[i] += axi, ay[i] += ayi, az[i] += azi;
+		jx[i] += jxi, jy[i] += jyi, jz[i] += jzi;
+	} // end for
+} // end pairwise_jerk_tile
+
+void pairwise_summation(const gravity_block& bodies, std::size_t n, double* ax, double* ay, double* az) {
+	for (std::size_t round = 0; round < pairwise_num_rounds(n); round++)
+		for (std::size_t tile = 0; tile < pairwise_num_tiles(n, round); tile++)
+			pairwise_tile(bodies, n, round, tile, ax, ay, az);
+} // end pairwise_summation
+#pragma endregion
@@ -0,0 +1,167 @@
+// Contains the direct summation and pairwise gravity kernels used by the whole-system integrators
+// The kernels work on structure of arrays blocks of targets and sources and pick an
+// AVX-512, AVX2 or scalar implementation at runtime depending on what the CPU supports
+#ifndef GRAVITY_H
+#define GRAVITY_H
+
+#include <cstddef>
+
+/// <summary>
+/// The instruction sets the gravity kernels can be run with
+/// </summary>
+enum SIMD_LEVEL : int {
+	SIMD_SCALAR = 0,	// Plain C++, no vector instructions
+	SIMD_AVX2 = 1,		// 4 doubles per instruction, needs AVX2 and FMA
+	SIMD_AVX512 = 2,	// 8 doubles per instruction, needs AVX-512F
+};
+
+/// <summary>
+/// The ways the force on every body can be computed
+/// </summary>
+enum FORCE_SOLVER : int {
+	SOLVER_DIRECT = 0,		// Every pair of bodies, exact but O(N^2)
+	SOLVER_BARNES_HUT = 1,	// Barnes-Hut octree, O(N log N) with an error set by the opening angle
+	SOLVER_FMM = 2,			// Fast multipole method, O(N) with an error set by the opening angle and expansion order
+};
+
+/// <summary>
+/// A block of bodies in structure of arrays form
+/// </summary>
+struct gravity_block {
+	const double* x;	// X positions
+	const double* y;	// Y positions
+	const double* z;	// Z positions
+	const double* gm;	// Gravitational constant * mass, 0 for bodies that exert no force
+};
+
+/// <summary>
+/// The velocities of a block of bodies in structure of arrays form, indexed like its gravity_block
+/// </summary>
+struct velocity_block {
+	const double* vx;	// X velocities
+	const double* vy;	// Y velocities
+	const double* vz;	// Z velocities
+};
+
+/// <summary>
+/// Gets the best instruction set supported by the CPU and operating system
+/// </summary>
+/// <returns>The SIMD level</returns>
+SIMD_LEVEL detect_simd_level();
+
+/// <summary>
+/// Gets the instruction set the kernels are currently using
+/// </summary>
+/// <returns>The SIMD level</returns>
+SIMD_LEVEL get_simd_level();
+
+/// <summary>
+/// Sets the instruction set used by the kernels, e.g. to compare against the scalar path.
+/// A level the CPU does not support falls back to the best supported level below it
+/// </summary>
+/// <param name="level">The requested SIMD level</param>
+/// <returns>The SIMD level now in use</returns>
+SIMD_LEVEL set_simd_level(SIMD_LEVEL level);
+
+/// <summary>
+/// Adds the acceleration on targets [t_begin, t_end) due to sources [s_begin, s_end) onto ax, ay and az.
+/// Each pair costs one reciprocal square root. Pairs at zero distance (a body and itself) are skipped
+/// </summary>
+/// <param name="targets">The bodies feeling the force</param>
+/// <param name="t_begin">First target</param>
+/// <param name="t_end">One past the last target</param>
+/// <param name="sources">The bodies exerting the force</param>
+/// <param name="s_begin">First source</param>
+/// <param name="s_end">One past the last source</param>
+/// <param name="ax">Acceleration in the x direction, indexed like the targets</param>
+/// <param name="ay">Acceleration in the y direction, indexed like the targets</param>
+/// <param name="az">Acceleration in the z direction, indexed like the targets</param>
+void direct_summation(const gravity_block& targets, std::size_t t_begin, std::size_t t_end,
+	const gravity_block& sources, std::size_t s_begin, std::size_t s_end,
+	double* ax, double* ay, double* az);
+
+/// <summary>
+/// Adds the acceleration and its time derivative (the jerk) on targets [t_begin, t_end) due to sources [s_begin, s_end)
+/// onto ax, ay, az and jx, jy, jz, both from the same pass over the pairs.
+/// Pairs at zero distance (a body and itself) are skipped
+/// </summary>
+/// <param name="targets">The bodies feeling the force</param>
+/// <param name="target_v">The velocities of the targets</param>
+/// <param name="t_begin">First target</param>
+/// <param name="t_end">One past the last target</param>
+/// <param name="sources">The bodies exerting the force</param>
+/// <param name="source_v">The velocities of the sources</param>
+/// <param name="s_begin">First source</param>
+/// <param name="s_end">One past the last source</param>
+/// <param name="ax">Acceleration in the x direction, indexed like the targets</param>
+/// <param name="ay">Acceleration in the y direction, indexed like the targets</param>
+/// <param name="az">Acceleration in the z direction, indexed like the targets</param>
+/// <param name="jx">Jerk in the x direction, indexed like the targets</param>
+/// <param name="jy">Jerk in the y direction, indexed like the targets</param>
+/// <param name="jz">Jerk in the z direction, indexed like the targets</param>
+void direct_summation_jerk(const gravity_block& targets, const velocity_block& target_v, std::size_t t_begin, std::size_t t_end,
+	const gravity_block& sources, const velocity_block& source_v, std::size_t s_begin, std::size_t s_end,
+	double* ax, double* ay, double* az, double* jx, double* jy, double* jz);
+
+/// <summary>
+/// Gets the number of rounds the pairwise kernel is split into for n bodies.
+/// The tiles of a round touch different bodies so they can run on different threads,
+/// the rounds must run one after another
+/// </summary>
+/// <param name="n">The number of bodies</param>
+/// <returns>The number of rounds</returns>
+std::size_t pairwise_num_rounds(std::size_t n);
+
+/// <summary>
+/// Gets the number of tiles in a round of the pairwise kernel
+/// </summary>
+/// <param name="n">The number of bodies</param>
+/// <param name="round">The round</param>
+/// <returns>The number of tiles</returns>
+std::size_t pairwise_num_tiles(std::size_t n, std::size_t round);
+
+/// <summary>
+/// Adds the accelerations from one tile of the pairwise kernel onto ax, ay and az. Each pair of bodies
+/// is computed once and its equal and opposite contributions are added to both bodies (Newton's third law),
+/// so every pair in [0, n) costs half as much as in direct_summation
+/// </summary>
+/// <param name="bodies">The bodies, each is both a target and a source</param>
+/// <param name="n">The number of bodies</param>
+/// <param name="round">The round</param>
+/// <param name="tile">The tile of the round</param>
+/// <param name="ax">Acceleration in the x direction</param>
+/// <param name="ay">Acceleration in the y direction</param>
+/// <param name="az">Acceleration in the z direction</param>
+void pairwise_tile(const gravity_block& bodies, std::size_t n, std::size_t round, std::size_t tile,
+	double* ax, double* ay, double* az);
+
+/// <summary>
+/// Adds the accelerations and jerks from one tile of the pairwise kernel onto ax, ay, az and jx, jy, jz.
+/// Uses the same rounds and tiles as pairwise_tile, each pair is computed once for both bodies
+/// </summary>
+/// <param name="bodies">The bodies, each is both a target and a source</param>
+/// <param name="v">The velocities of the bodies</param>
+/// <param name="n">The number of bodies</param>
+/// <param name="round">The round</param>
+/// <param name="tile">The tile of the round</param>
+/// <param name="ax">Acceleration in the x direction</param>
+/// <param name="ay">Acceleration in the y direction</param>
+/// <param name="az">Acceleration in the z direction</param>
+/// <param name="jx">Jerk in the x direction</param>
+/// <param name="jy">Jerk in the y direction</param>
+/// <param name="jz">Jerk in the z direction</param>
+void pairwise_jerk_tile(const gravity_block& bodies, const velocity_block& v, std::size_t n, std::size_t round, std::size_t tile,
+	double* ax, double* ay, double* az, double* jx, double* jy, double* jz);
+
+/// <summary>
+/// Adds the acceleration of every body in [0, n) due to every other onto ax, ay and az
+/// using the pairwise kernel, every tile in order on the calling thread
+/// </summary>
+/// <param name="bodies">The bodies, each is both a target and a source</param>
+/// <param name="n">The number of bodies</param>
+/// <param name="ax">Acceleration in the x direction</param>
+/// <param name="ay">Acceleration in the y direction</param>
+/// <param name="az">Acceleration in the z direction</param>
+void pairwise_summation(const gravity_block& bodies, std::size_t n, double* ax, double* ay, double* az);
+
+#endif // GRAVITY_H
@@ -0,0 +1,187 @@
+// Contains the scratch state used by the whole-system integrators in universe.cpp
+// Every stage of a step is computed for all bodies from one consistent snapshot
+// and only written back to the particle store once the step is complete
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "particle_store.h"
+
+/// <summary>
+/// Positions and velocities of every body in structure of arrays form.
+/// Used for the state at a stage and for the derivative of the state at a stage
+/// </summary>
+struct phase_arrays {
+	aligned_vector<double> x, y, z;		// Positions (or their derivatives)
+	aligned_vector<double> vx, vy, vz;	// Velocities (or their derivatives)
+
+	/// <summary>
+	/// Resizes every array to n bodies
+	/// </summary>
+	/// <param name="n">The number of bodies</param>
+	void resize(std::size_t n) {
+		x.resize(n), y.resize(n), z.resize(n);
+		vx.resize(n), vy.resize(n), vz.resize(n);
+	} // end resize
+
+	/// <summary>
+	/// Copies the positions and velocities out of a particle store
+	/// </summary>
+	/// <param name="s">The particle store</param>
+	void load(const particle_store& s) {
+		resize(s.size());
+		for (std::size_t i = 0; i < s.size(); i++) {
+			x[i] = s.x[i], y[i] = s.y[i], z[i] = s.z[i];
+			vx[i] = s.vx[i], vy[i] = s.vy[i], vz[i] = s.vz[i];
+		} // end for
+	} // end load
+
+	/// <summary>
+	/// Writes the positions and velocities back into a particle store
+	/// </summary>
+	/// <param name="s">The particle store</param>
+	void store(particle_store& s) const {
+		for (std::size_t i = 0; i < s.size(); i++) {
+			s.x[i] = x[i], s.y[i] = y[i], s.z[i] = z[i];
+			s.vx[i] = vx[i], s.vy[i] = vy[i], s.vz[i] = vz[i];
+		} // end for
+	} // end store
+}; // end phase_arrays
+
+/// <summary>
+/// A read only view of the positions and velocities of n bodies held in six contiguous arrays,
+/// e.g. a particle store, a phase_arrays or a frame of a trajectory file. It only holds pointers so it
+/// is cheap to pass by value and serializing through it never copies or allocates. It is only
+/// valid while the arrays it points into are alive and not resized
+/// </summary>
+struct state_view {
+	std::size_t n;						// Number of bodies
+	const double* x, * y, * z;			// Positions
+	const double* vx, * vy, * vz;		// Velocities
+
+	/// <summary>
+	/// View of the state held in a particle store
+	/// </summary>
+	state_view(const particle_store& s) : n(s.size()), x(s.x.data()), y(s.y.data()), z(s.z.data()),
+		vx(s.vx.data()), vy(s.vy.data()), vz(s.vz.data()) {}
+
+	/// <summary>
+	/// View of a state, e.g. from universe::dense_output
+	/// </summary>
+	state_view(const phase_arrays& s) : n(s.x.size()), x(s.x.data()), y(s.y.data()), z(s.z.data()),
+		vx(s.vx.data()), vy(s.vy.data()), vz(s.vz.data()) {}
+
+	/// <summary>
+	/// View of six arrays of count values stored one after the other, x[count], y[count], ..., vz[count]
+	/// </summary>
+	/// <param name="columns">The first of the six arrays</param>
+	/// <param name="count">The number of bodies</param>
+	state_view(const double* columns, std::size_t count) : n(count), x(columns), y(columns + count), z(columns + 2 * count),
+		vx(columns + 3 * count), vy(columns + 4 * count), vz(columns + 5 * count) {}
+}; // end state_view
+
+/// <summary>
+/// Coefficients of an embedded Runge-Kutta-Nystrom method for x'' = a(x). Stage i is evaluated at
+/// x0 + c[i] h v0 + h^2 * sum of a[i][j] * a_j, the step is x1 = x0 + h v0 + h^2 * sum of b_bar[i] * a_i
+/// and v1 = v0 + h * sum of b[i] * a_i. The error estimate is h^2 * sum of e_bar[i] * a_i on the positions
+/// </summary>
+struct rkn_tableau {
+	int stages;				// Number of stages, at most integrator_workspace::max_stages
+	int order;				// The error estimate scales as h^order
+	const double* c;		// Stage times as fractions of the step
+	const double* a;		// Stage coefficients, row i has the i coefficients of the stages before it
+	const double* b_bar;	// Position weights
+	const double* b;		// Velocity weights
+	const double* e_bar;	// Position weights minus those of the embedded lower order method
+};
+
+/// <summary>
+/// A bound group of bodies, e.g. a planet and its moons. Its internal motion is integrated in its own
+/// centre of mass frame with its own time step, the rest of the universe only sees it through the force on each member
+/// </summary>
+struct subsystem {
+	std::vector<std::size_t> members;	// Rows of the members in the particle store
+	int substeps;						// Internal steps per outer step, a pair follows its Kepler orbit exactly instead
+};
+
+/// <summary>
+/// Scratch arrays for the whole-system integrators. Kept between steps so a step does not allocate
+/// </summary>
+struct integrator_workspace {
+	static const int max_stages = 7;	// Most stages used by any method (Dormand-Prince)
+	static const int max_block_level = 30; // Deepest block time step level, a step of dt / 2^30
+
+	phase_arrays y0;					// State at the start of the step
+	phase_arrays stage;					// State at the current stage
+	phase_arrays k[max_stages];			// Derivative of the state at each stage
+	aligned_vector<double> gm;			// Gravitational constant * mass of every body, 0 if it is not included
+	std::vector<std::vector<std::pair<std::size_t, std::size_t>>> collisions; // Colliding pairs found by each chunk of the collision check
+	std::vector<std::size_t> rows;		// Store index of each row of stage when it only holds some of the bodies
+	std::vector<int> status;			// Error code of each chunk of a parallel loop
+
+	// The last force evaluation of a step, reused by the next step if it starts at the same positions and masses
+	phase_arrays last;					// Positions in x, y, z and the accelerations at them in vx, vy, vz
+	aligned_vector<double> last_gm;		// Gravitational constant * mass of every body at the time
+	bool last_valid = false;			// Whether last holds a force evaluation
+
+	// Adaptive step size control, shared by the embedded Runge-Kutta methods
+	double err_old = 1e-4;				// Error norm of the last accepted step, the memory of the PI controller
+	bool step_rejected = false;			// Whether the last attempted step was rejected
+	std::uint64_t accepted = 0;			// Adaptive steps accepted since the counters were reset
+	std::uint64_t rejected = 0;			// Adaptive steps rejected since the counters were reset
+
+	// Dense output of the last Dormand-Prince step, the state at a fraction s of the step is
+	// dense[0] + s * (dense[1] + (1 - s) * (dense[2] + s * (dense[3] + (1 - s) * dense[4])))
+	phase_arrays dense[5];
+	double dense_dt = 0.0;				// Time step the dense output covers
+	bool dense_valid = false;			// Whether dense holds a step
+
+	// Gauss-Radau (IAS15) expansion of the acceleration over a step, each array holds the x, y then z rows of every body.
+	// Kept so the next step starts from this one extrapolated forward
+	static const int radau_terms = 7;	// Terms of the expansion, a = a0 + b0 t + ... + b6 t^7
+	aligned_vector<double> radau_b[radau_terms];	// Coefficients of the acceleration in powers of the step fraction
+	aligned_vector<double> radau_g[radau_terms];	// The same in divided difference form at the Radau nodes
+	aligned_vector<double> radau_e[radau_terms];	// The b predicted from the last step, before it was corrected
+	bool radau_valid = false;			// Whether the arrays hold the expansion of the last step
+
+	// Bulirsch-Stoer extrapolation table, row k is the step made of the k-th number of midpoint substeps
+	std::vector<phase_arrays> table;
+	int bs_column = 0;					// Column the next Bulirsch-Stoer step aims to converge in, 0 if it has not been picked yet
+
+	// Individual block time steps, the step each body wants is kept so the next step starts from it
+	std::vector<double> block_dt;		// Time step each body wants, 0 if it has not been worked out yet
+	std::vector<int> level;				// Level of each body, it is advanced by dt / 2^level at a time
+	std::vector<std::uint64_t> tick;	// Time each body has reached, in units of dt / 2^max_block_level
+	// The acceleration each body had at its last correction, from predicted rather than final positions so only a block step
+	// may start from it. Kept apart from last, which the other steps treat as the exact force
+	phase_arrays block_force;			// Positions in x, y, z and the accelerations in vx, vy, vz
+	aligned_vector<double> block_gm;	// Gravitational constant * mass of every body at the time
+	bool block_valid = false;			// Whether block_force holds the end of the last block step
+
+	// Hierarchical subsystems, the members of one subsystem at a time in its centre of mass frame
+	phase_arrays inner;					// Positions and velocities of the members
+	phase_arrays inner_acc;				// Accelerations of the members in x, y and z
+	aligned_vector<double> inner_gm;	// Gravitational constant * mass of the members
+	std::vector<int> subsystem_of;		// Subsystem of every body, -1 if it is in none
+
+	// Acceleration of every test particle
+	aligned_vector<double> test_ax, test_ay, test_az;
+	phase_arrays test_bodies;			// The bodies interpolated to a time inside a step, for the test particles
+	phase_arrays test_start;			// The test particles at the start of a step, put back if the step fails
+
+	/// <summary>
+	/// Resizes every array to n bodies
+	/// </summary>
+	/// <param name="n">The number of bodies</param>
+	void resize(std::size_t n) {
+		y0.resize(n), stage.resize(n);
+		for (auto& ki : k) ki.resize(n);
+		gm.resize(n);
+	} // end resize
+}; // end integrator_workspace
+
+#endif // INTEGRATOR_H
@@ -0,0 +1,119 @@
+// Kepler drift in universal variables
+// With beta = 2 gm / r0 - v0^2 and the Stumpff functions c_k(beta X^2), G_k = X^k c_k and
+// dt = r0 G1 + eta G2 + gm G3 where eta = r0 . v0. Once X is found the new state is given
+// by the f and g functions, x = f x0 + g v0 and v = f' x0 + g' v0
+
+#include <cmath>
+
+#include "kepler.h"
+#include "error.h"
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+namespace {
+	const double pi = 3.14159265358979323846;
+	// Most iterations of the Kepler equation solver, it stops once X changes by less than 1e-14 of itself
+	const int max_iterations = 50;
+
+	/// <summary>
+	/// The Stumpff functions c0(z) to c3(z)
+	/// </summary>
+	void stumpff(double z, double& c0, double& c1, double& c2, double& c3) {
+		if (std::abs(z) < 1.0) {
+			// Series, c2 = sum (-z)^k / (2k + 2)! and c3 = sum (-z)^k / (2k + 3)!
+			double t2 = 0.5, t3 = 1.0 / 6.0;
+			c2 = 0.0, c3 = 0.0;
+			for (int k = 0; k < 12; k++) {
+				c2 += t2, c3 += t3;
+				t2 *= -z / ((2 * k + 3) * (2 * k + 4));
+				t3 *= -z / ((2 * k + 4) * (2 * k + 5));
+			} // end for
+		}
+		else if (z > 0.0) {
+			const double s = std::sqrt(z);
+			c2 = (1.0 - std::cos(s)) / z;
+			c3 = (s - std::sin(s)) / (z * s);
+		}
+		else {
+			const double s = std::sqrt(-z);
+			c2 = (std::cosh(s) - 1.0) / -z;
+			c3 = (std::sinh(s) - s) / (-z * s);
+		} // end if
+		c0 = 1.0 - z * c2;
+		c1 = 1.0 - z * c3;
+	} // end stumpff
+} // end namespace
+#pragma endregion
+
+#pragma region public functions
+/*****************************************************************************************************
+PUBLIC FUNCTIONS
+*****************************************************************************************************/
+int kepler_drift(double gm, double dt, double& x, double& y, double& z, double& vx, double& vy, double& vz) {
+	if (dt == 0.0 || gm == 0.0) {
+		// Nothing pulls on the body, it moves in a straight line
+		x += dt * vx, y += dt * vy, z += dt * vz;
+		return NO_ERROR;
+	} // end if
+
+	const double r0 = std::sqrt(x * x + y * y + z * z);
+	const double v2 = vx * vx + vy * vy + vz * vz;
+	const double eta = x * vx + y * vy + z * vz;
+	const double beta = 2.0 * gm / r0 - v2;
+
+	// Whole orbits bring a bound body back to where it started
+	double t = dt;
+	if (beta > 0.0) {
+		const double period = 2.0 * pi * gm / (beta * std::sqrt(beta));
+		if (std::abs(t) > period) t = std::fmod(t, period);
+	} // end if
+
+	// First guess, the mean motion for a long bound drift or the start radius for a short one.
+	// On a hyperbola r grows exponentially in X so a long drift needs X ~ log(t)
+	double s = t / r0;
+	if (beta > 0.0 && std::abs(t * beta * std::sqrt(beta)) > 0.2 * gm) s = t * beta / gm;
+	if (beta < 0.0) {
+		const double k = std::sqrt(-beta);
+		const double h = std::log(1.0 + 2.0 * std::abs(t) * (-beta) * k / (gm + std::abs(eta) * k - beta * r0)) / k;
+		if (h < std::abs(s)) s = (t < 0.0) ? -h : h;
+	} // end if
+
+	// Laguerre-Conway iteration on f(X) = r0 G1 + eta G2 + gm G3 - t, which converges from any start
+	double c0 = 1.0, c1 = 1.0, c2 = 0.5, c3 = 1.0 / 6.0;
+	double g0 = 1.0, g1 = s, g2 = 0.0, g3 = 0.0, r = r0;
+	bool converged = false;
+	for (int i = 0; i < max_iterations; i++) {
+		stumpff(beta * s * s, c0, c1, c2, c3);
+		g0 = c0, g1 = s * c1, g2 = s * s * c2, g3 = s * s * s * c3;
+		const double f = r0 * g1 + eta * g2 + gm * g3 - t;
+		r = r0 * g0 + eta * g1 + gm * g2;
+		const double f2 = eta * g0 + (gm - beta * r0) * g1;
+		const double n = 5.0;
+		const double root = std::sqrt(std::abs((n - 1.0) * (n - 1.0) * r * r - n * (n - 1.0) * f * f2));
+		const double ds = n * f / (r + (r >= 0.0 ? root : -root));
+		s -= ds;
+		if (std::abs(ds) <= 1e-14 * std::abs(s) || f == 0.0) {
+			converged = true;
+			break;
+		} // end if
+	} // end for
+	if (converged == false || r != r) return ERR_KEPLER_NO_CONVERGE;
+
+	// Update from the last X
+	stumpff(beta * s * s, c0, c1, c2, c3);
+	g0 = c0, g1 = s * c1, g2 = s * s * c2, g3 = s * s * s * c3;
+	r = r0 * g0 + eta * g1 + gm * g2;
+
+	const double f = 1.0 - gm * g2 / r0;
+	const double g = t - gm * g3;
+	const double fd = -gm * g1 / (r0 * r);
+	const double gd = 1.0 - gm * g2 / r;
+
+	const double nx = f * x + g * vx, ny = f * y + g * vy, nz = f * z + g * vz;
+	vx = fd * x + gd * vx, vy = fd * y + gd * vy, vz = fd * z + gd * vz;
+	x = nx, y = ny, z = nz;
+	return NO_ERROR;
+} // end kepler_drift
+#pragma endregion
@@ -0,0 +1,22 @@
+// Contains the Kepler drift, which moves a body along its two body orbit around a central mass
+// The orbit is solved in universal variables so circular, elliptic, parabolic and hyperbolic
+// orbits all go through the same equations
+#ifndef KEPLER_H
+#define KEPLER_H
+
+/// <summary>
+/// Moves a body along its Kepler orbit around a fixed central mass for a time dt.
+/// The position and velocity are relative to the central mass
+/// </summary>
+/// <param name="gm">Gravitational constant * mass of the central body (plus the body itself if wanted)</param>
+/// <param name="dt">The time to move for, can be negative</param>
+/// <param name="x">Relative x position, passed by reference</param>
+/// <param name="y">Relative y position, passed by reference</param>
+/// <param name="z">Relative z position, passed by reference</param>
+/// <param name="vx">Relative x velocity, passed by reference</param>
+/// <param name="vy">Relative y velocity, passed by reference</param>
+/// <param name="vz">Relative z velocity, passed by reference</param>
+/// <returns>The error code, see error.h for more. The state is left unchanged on an error</returns>
+int kepler_drift(double gm, double dt, double& x, double& y, double& z, double& vx, double& vy, double& vz);
+
+#endif // KEPLER_H
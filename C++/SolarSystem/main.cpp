@@ -1,13 +1,14 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <cstring>
 
 #include "body.h"
-#include "output.h"
+#include "async_writer.h"
 #include "universe.h"
 #include "create_universe.h"
 
-std::ofstream file_;
+async_writer file_;
 
 int main(int argc, char* argv[]) {         
     char* outfilename{};
@@ -19,37 +20,82 @@ int main(int argc, char* argv[]) {
     }
     else outfilename = argv[1];    
     //const char* outfilename = "Universe_Test.csv";
-    file_.open(outfilename);
+    // A .traj file gets the binary trajectory format, a .trajz file the compressed one, anything else the text format
+    auto ends_with = [](const char* name, const char* extension) {
+        const std::size_t length = std::strlen(name), extension_length = std::strlen(extension);
+        return length >= extension_length && std::strcmp(name + length - extension_length, extension) == 0;
+    };
+    const bool compressed = ends_with(outfilename, ".trajz");
+    const bool binary = compressed || ends_with(outfilename, ".traj");
+
+    // Given a trajectory file and a second filename, convert it instead. To another .traj or .trajz file
+    // to compress or decompress it, to the text format otherwise
+    if (binary && argc > 2) {
+        trajectory_reader reader;
+        int retval = reader.open(outfilename);
+        if (retval == NO_ERROR) {
+            if (ends_with(argv[2], ".trajz")) retval = reader.export_trajectory(argv[2], true);
+            else if (ends_with(argv[2], ".traj")) retval = reader.export_trajectory(argv[2], false);
+            else retval = reader.export_csv(argv[2], 0);
+        } // end if
+        if (retval != NO_ERROR) std::cerr << "ERROR: " << retval << " See error.h for more\n";
+        return retval;
+    } // end if
 
     double time = 0.0;
-    double dt = 0.001;
+    double dt = 0.001, dt_next = dt;
     double final_time = 10;
+    double output_dt = 0.001; // Time between trajectory rows
     unsigned int step_number = 0, written_steps = 0;
     unsigned int number_of_steps = 1000000;
     double tol = 0.00005;
+    phase_arrays state;
 
     universe u = create_three_body();
-    output_preamble(u, file_);
+    // Rows are written on the writer thread so the integrator never waits on the disk
+    int retval = file_.open(outfilename, u, compressed ? OUTPUT_COMPRESSED : binary ? OUTPUT_BINARY : OUTPUT_TEXT);
+    if (retval != NO_ERROR) {
+        std::cerr << "ERROR: " << retval << " See error.h for more\n";
+        return retval;
+    } // end if
 
     while ((time < final_time) && (step_number <= number_of_steps)) {
-        int retval = NO_ERROR;
         std::cerr << "\rTime remaining: " << final_time - time- dt << ' ' << "Step no: " << step_number << "           " << std::flush;
-        retval = u.step_rk4(dt);
+        retval = u.step_dopri5(tol, dt, dt_next);
         if (retval != NO_ERROR) { 
             std::cerr << "\nERROR: " << retval << " See error.h for more\n";
             return retval; 
         } // end if
 
-        if (step_number % 1 == 0) {
-            output_no_whitespace(time / 86400.0, u, file_, ",");
+        // Write every output time the step passed over from its dense output,
+        // so the step size is never cut short to land on an output time
+        double output_time = written_steps * output_dt;
+        while (output_time <= time + dt && output_time <= final_time) {
+            retval = u.dense_output(output_time - time, state);
+            if (retval != NO_ERROR) {
+                std::cerr << "\nERROR: " << retval << " See error.h for more\n";
+                return retval;
+            } // end if
+            retval = file_.write_frame(output_time / 86400.0, state);
+            if (retval != NO_ERROR) {
+                std::cerr << "\nERROR: " << retval << " See error.h for more\n";
+                return retval;
+            } // end if
             written_steps++;
-        }
+            output_time = written_steps * output_dt;
+        } // end while
         step_number++;
         time += dt;
+        dt = dt_next;
     } // end while
-    std::cerr << "\nDone.\n";
 
-    output_number_of_steps(written_steps, file_);
+    // Waits for the last rows to be written and finishes the file
+    retval = file_.close();
+    if (retval != NO_ERROR) {
+        std::cerr << "\nERROR: " << retval << " See error.h for more\n";
+        return retval;
+    } // end if
+    std::cerr << "\nDone.\n";
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,196 @@
+// Barnes-Hut octree
+// The sources are sorted into octants recursively until a cell holds only a few bodies.
+// A target uses the multipole expansion of a cell when it is far enough away compared to the size of the cell,
+// so each target only sees O(log N) cells instead of every source
+
+#include <algorithm>
+#include <cmath>
+
+#include "octree.h"
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+namespace {
+	// Deepest a cell can be, bodies at (almost) the same position stop being split here
+	const int max_depth = 32;
+
+	/// <summary>
+	/// Gets the octant of the cell a position falls in, bit 0 is x, bit 1 is y and bit 2 is z
+	/// </summary>
+	inline int octant(double x, double y, double z, double cx, double cy, double cz) {
+		return (x >= cx ? 1 : 0) | (y >= cy ? 2 : 0) | (z >= cz ? 4 : 0);
+	} // end octant
+
+	/// <summary>
+	/// Adds the quadrupole moment of a point mass at offset (sx, sy, sz) from the centre of mass of a cell
+	/// </summary>
+	inline void add_quadrupole(octree_node& node, double gm, double sx, double sy, double sz) {
+		const double s2 = sx * sx + sy * sy + sz * sz;
+		node.qxx += gm * (3.0 * sx * sx - s2), node.qxy += gm * 3.0 * sx * sy, node.qxz += gm * 3.0 * sx * sz;
+		node.qyy += gm * (3.0 * sy * sy - s2), node.qyz += gm * 3.0 * sy * sz, node.qzz += gm * (3.0 * sz * sz - s2);
+	} // end add_quadrupole
+} // end namespace
+
+void octree::build_node(const gravity_block& s, std::uint32_t begin, std::uint32_t end,
+	double cx, double cy, double cz, double half, int depth) {
+	const std::uint32_t index = static_cast<std::uint32_t>(nodes.size());
+	nodes.push_back(octree_node());
+	std::uint32_t children[8];
+	int num_children = 0;
+	double mx = 0.0, my = 0.0, mz = 0.0, m = 0.0;
+
+	if (end - begin <= leaf_size || depth >= max_depth) {
+		// A leaf, the centre of mass comes straight from its bodies
+		for (std::uint32_t k = begin; k < end; k++) {
+			const std::uint32_t j = order[k];
+			mx += s.gm[j] * s.x[j], my += s.gm[j] * s.y[j], mz += s.gm[j] * s.z[j];
+			m += s.gm[j];
+		} // end for
+		nodes[index].leaf = true;
+	}
+	else {
+		// Sort the bodies of the cell into its eight octants
+		std::uint32_t count[8] = {}, start[9] = {};
+		for (std::uint32_t k = begin; k < end; k++) {
+			const std::uint32_t j = order[k];
+			count[octant(s.x[j], s.y[j], s.z[j], cx, cy, cz)]++;
+		} // end for
+		start[0] = begin;
+		for (int o = 0; o < 8; o++) start[o + 1] = start[o] + count[o];
+		std::uint32_t fill[8];
+		std::copy(start, start + 8, fill);
+		for (std::uint32_t k = begin; k < end; k++) {
+			const std::uint32_t j = order[k];
+			scratch[fill[octant(s.x[j], s.y[j], s.z[j], cx, cy, cz)]++] = j;
+		} // end for
+		std::copy(scratch.begin() + begin, scratch.begin() + end, order.begin() + begin);
+
+		// Build each non empty octant, the centre of mass is the sum of the children
+		const double quarter = 0.5 * half;
+		for (int o = 0; o < 8; o++) {
+			if (count[o] == 0) continue;
+			children[num_children++] = static_cast<std::uint32_t>(nodes.size());
+			build_node(s, start[o], start[o + 1],
+				cx + ((o & 1) ? quarter : -quarter), cy + ((o & 2) ? quarter : -quarter), cz + ((o & 4) ? quarter : -quarter),
+				quarter, depth + 1);
+			const octree_node& c = nodes[children[num_children - 1]];
+			mx += c.gm * c.x, my += c.gm * c.y, mz += c.gm * c.z;
+			m += c.gm;
+		} // end for
+		nodes[index].leaf = false;
+	} // end if
+
+	octree_node& node = nodes[index];
+	node.gm = m;
+	if (m > 0.0) node.x = mx / m, node.y = my / m, node.z = mz / m;
+	else node.x = cx, node.y = cy, node.z = cz;
+
+	// Quadrupole moment about the centre of mass, from the bodies of a leaf or by
+	// shifting the moment of each child (parallel axis theorem)
+	node.qxx = node.qxy = node.qxz = node.qyy = node.qyz = node.qzz = 0.0;
+	if (node.leaf) {
+		for (std::uint32_t k = begin; k < end; k++) {
+			const std::uint32_t j = order[k];
+			add_quadrupole(node, s.gm[j], s.x[j] - node.x, s.y[j] - node.y, s.z[j] - node.z);
+		} // end for
+	}
+	else {
+		for (int c = 0; c < num_children; c++) {
+			const octree_node& child = nodes[children[c]];
+			node.qxx += child.qxx, node.qxy += child.qxy, node.qxz += child.qxz;
+			node.qyy += child.qyy, node.qyz += child.qyz, node.qzz += child.qzz;
+			add_quadrupole(node, child.gm, child.x - node.x, child.y - node.y, child.z - node.z);
+		} // end for
+	} // end if
+
+	// Open the cell if the target is closer than side / theta plus the distance from the centre
+	// of mass to the centre of the cell, so a target inside the cell always opens it
+	const double dx = node.x - cx, dy = node.y - cy, dz = node.z - cz;
+	const double open = 2.0 * half / theta + std::sqrt(dx * dx + dy * dy + dz * dz);
+	node.open2 = open * open;
+	node.begin = begin;
+	node.end = end;
+	node.next = static_cast<std::uint32_t>(nodes.size());
+} // end build_node
+#pragma endregion
+
+#pragma region public functions
+/*****************************************************************************************************
+PUBLIC FUNCTIONS
+*****************************************************************************************************/
+void octree::build(const gravity_block& sources, std::size_t n, double opening_angle) {
+	theta = opening_angle;
+	nodes.clear();
+	order.clear();
+
+	// Only bodies with mass exert a force
+	double lo[3] = { HUGE_VAL, HUGE_VAL, HUGE_VAL }, hi[3] = { -HUGE_VAL, -HUGE_VAL, -HUGE_VAL };
+	for (std::size_t i = 0; i < n; i++) {
+		if (sources.gm[i] == 0.0) continue;
+		order.push_back(static_cast<std::uint32_t>(i));
+		lo[0] = std::min(lo[0], sources.x[i]), hi[0] = std::max(hi[0], sources.x[i]);
+		lo[1] = std::min(lo[1], sources.y[i]), hi[1] = std::max(hi[1], sources.y[i]);
+		lo[2] = std::min(lo[2], sources.z[i]), hi[2] = std::max(hi[2], sources.z[i]);
+	} // end for
+	if (order.empty()) return;
+
+	// The root is the smallest cube around every source, made slightly larger so no body sits on its edge
+	const double half = std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], 1e-300 }) * 0.5 * (1.0 + 1e-12);
+	scratch.resize(order.size());
+	build_node(sources, 0, static_cast<std::uint32_t>(order.size()),
+		0.5 * (lo[0] + hi[0]), 0.5 * (lo[1] + hi[1]), 0.5 * (lo[2] + hi[2]), half, 0);
+
+	// Copy the sources into tree order so each leaf is a contiguous block
+	x.resize(order.size()), y.resize(order.size()), z.resize(order.size()), gm.resize(order.size());
+	for (std::size_t k = 0; k < order.size(); k++) {
+		const std::uint32_t j = order[k];
+		x[k] = sources.x[j], y[k] = sources.y[j], z[k] = sources.z[j], gm[k] = sources.gm[j];
+	} // end for
+} // end build
+
+void octree::add_acceleration(const gravity_block& targets, std::size_t t_begin, std::size_t t_end,
+	double* ax, double* ay, double* az) const {
+	const std::uint32_t count = static_cast<std::uint32_t>(nodes.size());
+
+	for (std::size_t i = t_begin; i < t_end; i++) {
+		const double xi = targets.x[i], yi = targets.y[i], zi = targets.z[i];
+		double axi = 0.0, ayi = 0.0, azi = 0.0;
+
+		// Walk the cells in depth first order, skipping the children of any cell used whole
+		std::uint32_t k = 0;
+		while (k < count) {
+			const octree_node& c = nodes[k];
+			const double dx = c.x - xi, dy = c.y - yi, dz = c.z - zi;
+			const double r2 = dx * dx + dy * dy + dz * dz;
+			if (r2 > c.open2) {
+				// Far enough away to use the mass and quadrupole moment of the cell
+				// a = gm * d / r^3 - Q d / r^5 + 5/2 * (d.Q.d) * d / r^7, d from the target to the centre of mass
+				const double r_inv2 = 1.0 / r2;
+				const double r_inv3 = r_inv2 / std::sqrt(r2);
+				const double r_inv5 = r_inv3 * r_inv2;
+				const double qx = c.qxx * dx + c.qxy * dy + c.qxz * dz;
+				const double qy = c.qxy * dx + c.qyy * dy + c.qyz * dz;
+				const double qz = c.qxz * dx + c.qyz * dy + c.qzz * dz;
+				const double f = c.gm * r_inv3 + 2.5 * (dx * qx + dy * qy + dz * qz) * r_inv5 * r_inv2;
+				axi += f * dx - qx * r_inv5, ayi += f * dy - qy * r_inv5, azi += f * dz - qz * r_inv5;
+				k = c.next;
+			}
+			else if (c.leaf) {
+				// Too close, sum the bodies of the leaf directly
+				for (std::uint32_t j = c.begin; j < c.end; j++) {
+					const double bx = x[j] - xi, by = y[j] - yi, bz = z[j] - zi;
+					const double b2 = bx * bx + by * by + bz * bz;
+					if (b2 == 0.0) continue; // Body and itself
+					const double f = gm[j] / (b2 * std::sqrt(b2));
+					axi += f * bx, ayi += f * by, azi += f * bz;
+				} // end for
+				k = c.next;
+			}
+			else k++; // Too close, open the cell
+		} // end while
+		ax[i] += axi, ay[i] += ayi, az[i] += azi;
+	} // end for
+} // end add_acceleration
+#pragma endregion
@@ -0,0 +1,96 @@
+// Contains the Barnes-Hut octree used as an O(N log N) alternative to direct summation
+// The tree is rebuilt from the current positions every time the forces are needed, a distant
+// cell is replaced by the mass and quadrupole moment about its centre of mass while a near cell is opened
+#ifndef OCTREE_H
+#define OCTREE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gravity.h"
+#include "particle_store.h"
+
+/// <summary>
+/// A cell of the octree. Cells are stored in depth first order so the first child
+/// of a cell is the cell after it and next skips past all of its children
+/// </summary>
+struct octree_node {
+	double x, y, z;			// Centre of mass
+	double gm;				// Gravitational constant * mass of everything in the cell
+	double qxx, qxy, qxz;	// Quadrupole moment about the centre of mass (times the gravitational constant),
+	double qyy, qyz, qzz;	// sum of gm * (3 * s_i * s_j - |s|^2 * delta_ij)
+	double open2;			// Square of the distance inside which the cell must be opened
+	std::uint32_t begin;	// First body of the cell in tree order
+	std::uint32_t end;		// One past the last body of the cell in tree order
+	std::uint32_t next;		// The cell after this one and all of its children
+	bool leaf;				// The cell holds bodies rather than children
+};
+
+/// <summary>
+/// A Barnes-Hut octree over the bodies exerting a force.
+/// The tree keeps its own copy of the sources in tree order so a leaf is a contiguous block
+/// </summary>
+class octree {
+private:
+	/*********************************************************
+	Member variables
+	*********************************************************/
+	std::vector<octree_node> nodes;		// Cells in depth first order, the root is nodes[0]
+	std::vector<std::uint32_t> order;	// Source indices in tree order
+	std::vector<std::uint32_t> scratch;	// Used to sort the sources into octants
+	aligned_vector<double> x, y, z, gm;	// Sources in tree order
+	double theta;						// Opening angle the cells were built for
+	std::size_t leaf_size;				// Most bodies in a leaf
+
+	/// <summary>
+	/// Builds the cell holding the sources order[begin, end) and all of its children
+	/// </summary>
+	/// <param name="s">The sources</param>
+	/// <param name="begin">First source of the cell in order</param>
+	/// <param name="end">One past the last source of the cell in order</param>
+	/// <param name="cx">Centre of the cell in x</param>
+	/// <param name="cy">Centre of the cell in y</param>
+	/// <param name="cz">Centre of the cell in z</param>
+	/// <param name="half">Half the side length of the cell</param>
+	/// <param name="depth">Depth of the cell, the root is 0</param>
+	void build_node(const gravity_block& s, std::uint32_t begin, std::uint32_t end,
+		double cx, double cy, double cz, double half, int depth);
+
+public:
+	/*********************************************************
+	Constructors and destructors
+	*********************************************************/
+	/// <summary>
+	/// Default constructor
+	/// </summary>
+	octree() : theta(0.5), leaf_size(8) {}
+
+	/// <summary>
+	/// Rebuilds the tree from the sources. Sources with gm of 0 exert no force and are left out
+	/// </summary>
+	/// <param name="sources">The bodies exerting the force</param>
+	/// <param name="n">The number of sources</param>
+	/// <param name="opening_angle">A cell of side s at distance d is used whole when s / d is below this</param>
+	void build(const gravity_block& sources, std::size_t n, double opening_angle);
+
+	/// <summary>
+	/// Adds the acceleration on targets [t_begin, t_end) due to the tree onto ax, ay and az.
+	/// Targets are independent of each other so ranges can be given to different threads
+	/// </summary>
+	/// <param name="targets">The bodies feeling the force, only the positions are used</param>
+	/// <param name="t_begin">First target</param>
+	/// <param name="t_end">One past the last target</param>
+	/// <param name="ax">Acceleration in the x direction, indexed like the targets</param>
+	/// <param name="ay">Acceleration in the y direction, indexed like the targets</param>
+	/// <param name="az">Acceleration in the z direction, indexed like the targets</param>
+	void add_acceleration(const gravity_block& targets, std::size_t t_begin, std::size_t t_end,
+		double* ax, double* ay, double* az) const;
+
+	/*********************************************************
+	Getters
+	*********************************************************/
+	std::size_t get_num_of_nodes() const { return nodes.size(); } // Get the number of cells in the tree
+}; // end class octree
+
+#endif // OCTREE_H
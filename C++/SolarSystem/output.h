@@ -1,94 +1,203 @@
 #ifndef OUTPUT_H
 #define OUTPUT_H
 
+#include <algorithm>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
+#include <string>
+#include <vector>
 
+#include"thread_pool.h"
 #include"universe.h"
 
+// The rows are written from a state_view, a set of pointers into the arrays of the state, so writing a row
+// neither copies the universe nor allocates. The universe overloads view its particle store.
+// The state_view overloads end a row with '\n' and leave the flushing to the stream,
+// the universe and body overloads flush after every row as before.
+// The CSV rows (output_no_whitespace and csv_encoder) are formatted with std::to_chars, which gives the
+// shortest text that reads back to exactly the same double, into a buffer that is reused from row to row
+
+// Most characters std::to_chars writes for a double, e.g. -2.2250738585072014e-308
+const std::size_t max_double_chars = 24;
+
+// Most characters in a CSV row of n bodies, including the newline
+inline std::size_t csv_row_bound(std::size_t n, std::size_t seperator_length) {
+    return (1 + 6 * n) * (max_double_chars + seperator_length) + 1;
+} // end csv_row_bound
+
+// Formats a CSV row at out, which must have room for csv_row_bound characters, and returns the end of the row
+inline char* format_csv_row(char* out, double step_number, const state_view& state, const char* seperator, std::size_t seperator_length) {
+    auto value = [&](double v) {
+        out = std::to_chars(out, out + max_double_chars, v).ptr;
+        out = std::copy(seperator, seperator + seperator_length, out);
+    };
+    value(step_number);
+    for (std::size_t i = 0; i < state.n; i++)
+    {
+        value(state.x[i]);
+        value(state.y[i]);
+        value(state.z[i]);
+        value(state.vx[i]);
+        value(state.vy[i]);
+        value(state.vz[i]);
+    }
+    *out++ = '\n';
+    return out;
+} // end format_csv_row
+
 // Outputs number of steps
-void output_number_of_steps(int step_no, std::ofstream& ofile) {
+inline void output_number_of_steps(int step_no, std::ostream& ofile) {
     ofile << "\nNUM_STEPS\n" << step_no;
     return;
 } // end output_number_of_steps
 
 // Outputs information on names and masses etc...
-void output_preamble(universe u, std::ostream& ofile) {
-    ofile << "NUM_BODIES\n" << u.num_of_bodies << "\n";
+inline void output_preamble(const std::vector<std::string>& names, const double* masses, const double* radii, std::ostream& ofile) {
+    ofile << "NUM_BODIES\n" << names.size() << "\n";
     ofile << "\nNAMES\n";
-    for (auto i = 0; i < u.num_of_bodies; i++)
-        ofile << u.body_at(i)->name << "\n";
+    for (std::size_t i = 0; i < names.size(); i++)
+        ofile << names[i] << "\n";
 
     ofile << "\nMASSES\n";
-    for (auto i = 0; i < u.num_of_bodies; i++)
-        ofile << u.body_at(i)->mass << "\n";
+    for (std::size_t i = 0; i < names.size(); i++)
+        ofile << masses[i] << "\n";
 
     ofile << "\nRADII\n";
-    for (auto i = 0; i < u.num_of_bodies; i++)
-        ofile << u.body_at(i)->radius << "\n";
+    for (std::size_t i = 0; i < names.size(); i++)
+        ofile << radii[i] << "\n";
 
     ofile << "\nTRAJECTORIES\n";
     ofile << "Step No,";
-    for (auto i = 0; i < u.num_of_bodies; i++) {
-        ofile << u.body_at(i)->name << "x" << ",";
-        ofile << u.body_at(i)->name << "y" << ",";
-        ofile << u.body_at(i)->name << "z" << ",";
-        ofile << u.body_at(i)->name << "vx" << ",";
-        ofile << u.body_at(i)->name << "vy" << ",";
-        ofile << u.body_at(i)->name << "vz" << ",";
+    for (std::size_t i = 0; i < names.size(); i++) {
+        ofile << names[i] << "x" << ",";
+        ofile << names[i] << "y" << ",";
+        ofile << names[i] << "z" << ",";
+        ofile << names[i] << "vx" << ",";
+        ofile << names[i] << "vy" << ",";
+        ofile << names[i] << "vz" << ",";
     } // end for
     ofile << "\n";
     return;
 } // end output_preamble
 
-// Outputs the step number and position/velocity info on all bodies in the universe
-void output(double step_number, universe u, std::ofstream& ofile) {
+inline void output_preamble(const universe& u, std::ostream& ofile) {
+    const particle_store& s = *u.get_particles();
+    std::vector<std::string> names;
+    for (auto i = 0; i < u.num_of_bodies; i++)
+        names.push_back(u.body_at(i)->name);
+    output_preamble(names, s.mass.data(), s.radius.data(), ofile);
+} // end output_preamble
+
+// Outputs the step number and position/velocity info on all bodies in a state
+inline void output(double step_number, const state_view& state, std::ostream& ofile) {
     ofile << std::setiosflags(std::ios::showpoint | std::ios::uppercase);
     ofile << std::setprecision(8) << step_number << " ";
-    for (int i = 0; i < u.num_of_bodies; i++)
+    for (std::size_t i = 0; i < state.n; i++)
     {
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->x << " ";
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->y << " ";
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->z << " ";
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->vx << " ";
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->vy << " ";
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->vz;
+        ofile << std::setw(15) << std::setprecision(8) << state.x[i] << " ";
+        ofile << std::setw(15) << std::setprecision(8) << state.y[i] << " ";
+        ofile << std::setw(15) << std::setprecision(8) << state.z[i] << " ";
+        ofile << std::setw(15) << std::setprecision(8) << state.vx[i] << " ";
+        ofile << std::setw(15) << std::setprecision(8) << state.vy[i] << " ";
+        ofile << std::setw(15) << std::setprecision(8) << state.vz[i];
     }
-    ofile << std::endl;
+    ofile << '\n';
 }  // end output
 
-void output(double step_number, universe u, std::ofstream& ofile, const char* seperator) {
+inline void output(double step_number, const state_view& state, std::ostream& ofile, const char* seperator) {
     ofile << std::setiosflags(std::ios::showpoint | std::ios::uppercase);
     ofile << std::setprecision(8) << step_number << seperator;
-    for (int i = 0; i < u.num_of_bodies; i++)
+    for (std::size_t i = 0; i < state.n; i++)
     {
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->x << seperator;
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->y << seperator;
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->z << seperator;
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->vx << seperator;
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->vy << seperator;
-        ofile << std::setw(15) << std::setprecision(8) << u.body_at(i)->vz << seperator;
+        ofile << std::setw(15) << std::setprecision(8) << state.x[i] << seperator;
+        ofile << std::setw(15) << std::setprecision(8) << state.y[i] << seperator;
+        ofile << std::setw(15) << std::setprecision(8) << state.z[i] << seperator;
+        ofile << std::setw(15) << std::setprecision(8) << state.vx[i] << seperator;
+        ofile << std::setw(15) << std::setprecision(8) << state.vy[i] << seperator;
+        ofile << std::setw(15) << std::setprecision(8) << state.vz[i] << seperator;
     }
-    ofile << std::endl;
+    ofile << '\n';
 }  // end output
 
-void output_no_whitespace(double step_number, universe u, std::ofstream& ofile, const char* seperator) {
-    ofile << std::setiosflags(std::ios::showpoint | std::ios::uppercase);
-    ofile << std::setprecision(8) << step_number << seperator;
-    for (int i = 0; i < u.num_of_bodies; i++)
-    {
-        ofile << std::setprecision(8) << u.body_at(i)->x << seperator;
-        ofile << std::setprecision(8) << u.body_at(i)->y << seperator;
-        ofile << std::setprecision(8) << u.body_at(i)->z << seperator;
-        ofile << std::setprecision(8) << u.body_at(i)->vx << seperator;
-        ofile << std::setprecision(8) << u.body_at(i)->vy << seperator;
-        ofile << std::setprecision(8) << u.body_at(i)->vz << seperator;
-    }
-    ofile << std::endl;
+// Outputs the time and position/velocity info on all bodies in a state, e.g. the particle store or the dense output of an adaptive step
+inline void output_no_whitespace(double step_number, const state_view& state, std::ostream& ofile, const char* seperator) {
+    // Each thread keeps its buffer, so only the first row (or a row of a bigger universe) allocates
+    thread_local std::vector<char> buffer;
+    const std::size_t seperator_length = std::strlen(seperator);
+    const std::size_t bound = csv_row_bound(state.n, seperator_length);
+    if (buffer.size() < bound) buffer.resize(bound);
+    const char* end = format_csv_row(buffer.data(), step_number, state, seperator, seperator_length);
+    ofile.write(buffer.data(), end - buffer.data());
+}  // end output_no_whitespace
+
+/// <summary>
+/// Formats many CSV rows at once by splitting them into chunks which are formatted on different threads
+/// and then written in order, so the file is the same as writing the rows one by one with output_no_whitespace
+/// </summary>
+class csv_encoder {
+private:
+    thread_pool pool;                           // Threads formatting the chunks
+    std::vector<std::vector<char>> chunks;      // Text of each chunk, kept between calls
+    std::vector<std::size_t> lengths;           // Characters used in each chunk
+    static const std::size_t chunks_per_thread = 2;    // Chunks per thread, evens out slow threads
+    static const std::size_t min_rows_per_thread = 64; // Fewer rows than this per thread are formatted on the calling thread
+
+public:
+    /// <summary>
+    /// Modified constructor
+    /// </summary>
+    /// <param name="num_threads">Number of threads including the calling thread, 0 uses one per core</param>
+    explicit csv_encoder(unsigned num_threads) : pool(num_threads) {}
+
+    /// <summary>
+    /// Formats and writes frames laid out as in a trajectory file, time, x[n], y[n], z[n], vx[n], vy[n], vz[n]
+    /// </summary>
+    /// <param name="frames">The frames, one after the other</param>
+    /// <param name="count">The number of frames</param>
+    /// <param name="n">The number of bodies in a frame</param>
+    /// <param name="ofile">The stream</param>
+    /// <param name="seperator">Separator written after every value</param>
+    void write(const double* frames, std::size_t count, std::size_t n, std::ostream& ofile, const char* seperator) {
+        const std::size_t seperator_length = std::strlen(seperator);
+        const std::size_t bound = csv_row_bound(n, seperator_length);
+        const std::size_t stride = 1 + 6 * n;
+        const std::size_t num_chunks = pool.num_chunks(chunks_per_thread);
+        if (chunks.size() < num_chunks) chunks.resize(num_chunks);
+        lengths.assign(num_chunks, 0);
+
+        pool.parallel_for(count, chunks_per_thread, 1, min_rows_per_thread, [&](std::size_t c, std::size_t begin, std::size_t end) {
+            std::vector<char>& chunk = chunks[c];
+            if (chunk.size() < (end - begin) * bound) chunk.resize((end - begin) * bound);
+            char* out = chunk.data();
+            for (std::size_t f = begin; f < end; f++)
+                out = format_csv_row(out, frames[f * stride], state_view(frames + f * stride + 1, n), seperator, seperator_length);
+            lengths[c] = out - chunk.data();
+        });
+
+        for (std::size_t c = 0; c < num_chunks; c++)
+            if (lengths[c] != 0) ofile.write(chunks[c].data(), lengths[c]);
+    } // end write
+}; // end class csv_encoder
+
+// Outputs the step number and position/velocity info on all bodies in the universe
+inline void output(double step_number, const universe& u, std::ostream& ofile) {
+    output(step_number, *u.get_particles(), ofile);
+    ofile << std::flush;
+}  // end output
+
+inline void output(double step_number, const universe& u, std::ostream& ofile, const char* seperator) {
+    output(step_number, *u.get_particles(), ofile, seperator);
+    ofile << std::flush;
 }  // end output
 
+inline void output_no_whitespace(double step_number, const universe& u, std::ostream& ofile, const char* seperator) {
+    output_no_whitespace(step_number, *u.get_particles(), ofile, seperator);
+    ofile << std::flush;
+}  // end output_no_whitespace
 
-void output(double step_number, body b, std::ofstream& ofile) {
+inline void output(double step_number, const body& b, std::ostream& ofile) {
     ofile << std::setiosflags(std::ios::showpoint | std::ios::uppercase);
     ofile << std::setw(15) << std::setprecision(8) << step_number << " ";
     ofile << std::setw(15) << std::setprecision(8) << b.x << " ";
@@ -100,7 +209,7 @@ void output(double step_number, body b, std::ofstream& ofile) {
     ofile << std::endl;
 }  // end output
 
-void output(double step_number, body b, std::ofstream& ofile, const char* seperator) {
+inline void output(double step_number, const body& b, std::ostream& ofile, const char* seperator) {
     ofile << std::setiosflags(std::ios::showpoint | std::ios::uppercase);
     ofile << std::setw(15) << std::setprecision(8) << step_number << seperator;
     ofile << std::setw(15) << std::setprecision(8) << b.x << seperator;
@@ -0,0 +1,121 @@
+// Contains the structure of arrays (SoA) store that holds the state of every body in a universe
+// Each quantity lives in its own contiguous, cache line aligned array so the force loops
+// can stream through positions and masses without chasing a pointer per body
+#ifndef PARTICLE_STORE_H
+#define PARTICLE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+#include "vec3.h"
+
+/// <summary>
+/// An allocator returning memory aligned to a given boundary (64 bytes by default, one cache line
+/// and wide enough for an AVX-512 register)
+/// </summary>
+template <typename T, std::size_t Alignment = 64>
+struct aligned_allocator {
+	typedef T value_type;
+
+	template <typename U> struct rebind { typedef aligned_allocator<U, Alignment> other; };
+
+	aligned_allocator() noexcept {}
+	template <typename U> aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept {}
+
+	T* allocate(std::size_t n) { return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment))); }
+	void deallocate(T* p, std::size_t) noexcept { ::operator delete(p, std::align_val_t(Alignment)); }
+
+	template <typename U> bool operator==(const aligned_allocator<U, Alignment>&) const noexcept { return true; }
+	template <typename U> bool operator!=(const aligned_allocator<U, Alignment>&) const noexcept { return false; }
+}; // end aligned_allocator
+
+template <typename T>
+using aligned_vector = std::vector<T, aligned_allocator<T>>; // Aligned std::vector
+
+/// <summary>
+/// Per body flags held in the store
+/// </summary>
+enum BODY_FLAGS : std::uint8_t {
+	FLAG_NONE = 0x00,		// No flags set
+	FLAG_INCLUDE = 0x01,	// The body is included in the simulation
+};
+
+/// <summary>
+/// A structure of arrays holding the position, velocity, mass, radius and flags of every body in a universe.
+/// Index i of every array belongs to the body at i in the universe
+/// </summary>
+class particle_store {
+public:
+	/*********************************************************
+	Member variables - public so the kernels can take the raw
+	arrays, every array always has size() elements
+	*********************************************************/
+	aligned_vector<double> x, y, z;				// Positions
+	aligned_vector<double> vx, vy, vz;			// Velocities
+	aligned_vector<double> mass;				// Masses
+	aligned_vector<double> radius;				// Radii
+	aligned_vector<std::uint8_t> flags;			// Flags, see BODY_FLAGS
+
+	/// <summary>
+	/// Gets the number of bodies in the store
+	/// </summary>
+	std::size_t size() const { return x.size(); }
+
+	/// <summary>
+	/// Reserves space for n bodies in every array
+	/// </summary>
+	/// <param name="n">The number of bodies</param>
+	void reserve(std::size_t n) {
+		x.reserve(n), y.reserve(n), z.reserve(n);
+		vx.reserve(n), vy.reserve(n), vz.reserve(n);
+		mass.reserve(n), radius.reserve(n), flags.reserve(n);
+	} // end reserve
+
+	/// <summary>
+	/// Adds a body to the end of the store
+	/// </summary>
+	/// <param name="pos">Position of the body</param>
+	/// <param name="vel">Velocity of the body</param>
+	/// <param name="m">Mass of the body</param>
+	/// <param name="r">Radius of the body</param>
+	/// <param name="include">Whether the body is included in the simulation</param>
+	/// <returns>The index of the body in the store</returns>
+	std::size_t add(const point3& pos, const vel3& vel, double m, double r, bool include) {
+		x.push_back(pos.x()), y.push_back(pos.y()), z.push_back(pos.z());
+		vx.push_back(vel.x()), vy.push_back(vel.y()), vz.push_back(vel.z());
+		mass.push_back(m), radius.push_back(r);
+		flags.push_back(include ? FLAG_INCLUDE : FLAG_NONE);
+		return size() - 1;
+	} // end add
+
+	/// <summary>
+	/// Removes all bodies from the store
+	/// </summary>
+	void clear() {
+		x.clear(), y.clear(), z.clear();
+		vx.clear(), vy.clear(), vz.clear();
+		mass.clear(), radius.clear(), flags.clear();
+	} // end clear
+
+	/*********************************************************
+	Element access
+	*********************************************************/
+	point3 pos(std::size_t i) const { return point3(x[i], y[i], z[i]); } // Get position of body i
+	vel3 vel(std::size_t i) const { return vel3(vx[i], vy[i], vz[i]); } // Get velocity of body i
+	bool included(std::size_t i) const { return (flags[i] & FLAG_INCLUDE) != 0; } // Get include flag of body i
+
+	/// <summary>
+	/// Sets the mass, radius and velocity of body i to 0 and removes it from the simulation
+	/// Used when two bodies collide
+	/// </summary>
+	/// <param name="i">The index of the body</param>
+	void set_to_zero(std::size_t i) {
+		mass[i] = 0.0, radius[i] = 0.0;
+		vx[i] = 0.0, vy[i] = 0.0, vz[i] = 0.0;
+		flags[i] &= ~FLAG_INCLUDE;
+	} // end set_to_zero
+}; // end class particle_store
+
+#endif // PARTICLE_STORE_H
@@ -0,0 +1,148 @@
+// Contains a persistent pool of worker threads used to split the force loops across cores
+// Work is always split into the same chunks and each chunk is always given to the same thread,
+// so for a given pool size the order every sum is done in never changes
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// A fixed size pool of threads which stay alive between parallel_for calls
+/// </summary>
+class thread_pool {
+private:
+	/*********************************************************
+	Member variables
+	*********************************************************/
+	std::vector<std::thread> workers;	// Worker threads, the calling thread is thread 0
+	std::mutex lock;					// Guards everything below
+	std::condition_variable start;		// Signals the workers that a job is ready
+	std::condition_variable finished;	// Signals the caller that every worker is done
+	const std::function<void(unsigned)>* job;	// The job, called with the thread index
+	unsigned long long generation;		// Incremented for every job
+	unsigned remaining;					// Workers still running the current job
+	bool stopping;						// Set when the pool is destroyed
+
+	/// <summary>
+	/// The loop every worker runs until the pool is destroyed
+	/// </summary>
+	/// <param name="index">Index of the worker thread</param>
+	void worker_loop(unsigned index) {
+		unsigned long long seen = 0;
+		for (;;) {
+			const std::function<void(unsigned)>* current;
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				start.wait(guard, [&] { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+				current = job;
+			}
+			(*current)(index);
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				if (--remaining == 0) finished.notify_one();
+			}
+		} // end for
+	} // end worker_loop
+
+public:
+	/*********************************************************
+	Constructors and destructors
+	*********************************************************/
+	/// <summary>
+	/// Modified constructor
+	/// </summary>
+	/// <param name="num_threads">Number of threads including the calling thread, 0 uses one per core</param>
+	explicit thread_pool(unsigned num_threads) : job(nullptr), generation(0), remaining(0), stopping(false) {
+		if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+		for (unsigned i = 1; i < num_threads; i++)
+			workers.emplace_back(&thread_pool::worker_loop, this, i);
+	} // end thread_pool
+
+	/// <summary>
+	/// Destructor, waits for the workers to exit
+	/// </summary>
+	~thread_pool() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		start.notify_all();
+		for (auto& worker : workers) worker.join();
+	} // end ~thread_pool
+
+	thread_pool(const thread_pool&) = delete;
+	thread_pool& operator=(const thread_pool&) = delete;
+
+	/// <summary>
+	/// Gets the number of threads including the calling thread
+	/// </summary>
+	unsigned size() const { return static_cast<unsigned>(workers.size()) + 1; }
+
+	/// <summary>
+	/// Runs f(thread index) on every thread of the pool and waits for them all to finish
+	/// </summary>
+	/// <param name="f">The job</param>
+	void run(const std::function<void(unsigned)>& f) {
+		if (workers.empty()) {
+			f(0);
+			return;
+		} // end if
+
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			job = &f;
+			remaining = static_cast<unsigned>(workers.size());
+			generation++;
+		}
+		start.notify_all();
+		f(0);
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard, [&] { return remaining == 0; });
+	} // end run
+
+	/// <summary>
+	/// Splits [0, n) into chunks whose boundaries are multiples of align and calls f(chunk, begin, end) for each.
+	/// Chunk c always runs on thread c % size() so the split only depends on n and the pool size.
+	/// Runs on the calling thread alone if there are fewer than min_per_thread items per thread
+	/// </summary>
+	/// <param name="n">Number of items</param>
+	/// <param name="chunks_per_thread">Chunks per thread, more than 1 helps balance uneven work</param>
+	/// <param name="align">Chunk boundaries are multiples of this, e.g. the SIMD width</param>
+	/// <param name="min_per_thread">Smallest number of items worth giving a thread</param>
+	/// <param name="f">The job, called with the chunk index and the range of items</param>
+	template <typename F>
+	void parallel_for(std::size_t n, std::size_t chunks_per_thread, std::size_t align, std::size_t min_per_thread, F&& f) {
+		const std::size_t threads = size();
+		if (threads == 1 || n < threads * min_per_thread) {
+			f(std::size_t(0), std::size_t(0), n);
+			return;
+		} // end if
+
+		const std::size_t chunks = threads * chunks_per_thread;
+		std::size_t chunk_size = (n + chunks - 1) / chunks;
+		chunk_size = ((chunk_size + align - 1) / align) * align;
+		run([&](unsigned t) {
+			for (std::size_t c = t; c < chunks; c += threads) {
+				const std::size_t begin = c * chunk_size;
+				if (begin >= n) break;
+				f(c, begin, std::min(begin + chunk_size, n));
+			} // end for
+		});
+	} // end parallel_for
+
+	/// <summary>
+	/// Gets the number of chunks parallel_for splits into, for sizing per chunk results
+	/// </summary>
+	/// <param name="chunks_per_thread">Chunks per thread passed to parallel_for</param>
+	std::size_t num_chunks(std::size_t chunks_per_thread) const { return size() * chunks_per_thread; }
+}; // end class thread_pool
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,424 @@
+#include <algorithm>
+#include <cstring>
+
+#include "trajectory.h"
+#include "frame_codec.h"
+#include "output.h"
+#include "universe.h"
+#include "error.h"
+
+// The platform headers come last, windows.h defines NO_ERROR as a macro which would break error.h
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+namespace {
+	const char trajectory_magic[8] = { 'S', 'S', 'T', 'R', 'A', 'J', 0, 0 };
+	const char index_magic[8] = { 'S', 'S', 'I', 'N', 'D', 'E', 'X', 0 };
+	const std::uint64_t trajectory_alignment = 64; // The first frame starts on a multiple of this
+	const std::uint64_t export_block = 1 << 14; // Frames handed to the CSV encoder at once, bounds the text held in memory
+	const std::size_t max_block_frames = 1024; // Most frames in a compressed block, fewer if they would take more than max_block_bytes
+	const std::size_t max_block_bytes = 1 << 24; // Most bytes a block of frames takes decoded, bounds the memory of a reader
+
+	/// <summary>
+	/// Writes raw bytes to a binary stream
+	/// </summary>
+	template <class T>
+	void write_raw(std::ofstream& file, const T* data, std::size_t count) {
+		file.write(reinterpret_cast<const char*>(data), count * sizeof(T));
+	} // end write_raw
+} // end namespace
+#pragma endregion
+
+#pragma region trajectory_writer
+/*****************************************************************************************************
+TRAJECTORY WRITER
+*****************************************************************************************************/
+int trajectory_writer::write_block() {
+	if (pending == 0) return NO_ERROR;
+	encoded.clear();
+	encode_frames(block.data(), pending, 1 + 6 * n, encoded);
+	const trajectory_block info{ pending, encoded.size() };
+	blocks.push_back(offset);
+	write_raw(file, &info, 1);
+	write_raw(file, encoded.data(), encoded.size());
+	offset += sizeof(info) + encoded.size();
+	pending = 0;
+	return file ? (int)NO_ERROR : (int)ERR_FILE_WRITE;
+} // end write_block
+
+int trajectory_writer::add_to_block(double time, const state_view& state) {
+	double* frame = block.data() + pending * (1 + 6 * n);
+	frame[0] = time;
+	std::copy(state.x, state.x + n, frame + 1);
+	std::copy(state.y, state.y + n, frame + 1 + n);
+	std::copy(state.z, state.z + n, frame + 1 + 2 * n);
+	std::copy(state.vx, state.vx + n, frame + 1 + 3 * n);
+	std::copy(state.vy, state.vy + n, frame + 1 + 4 * n);
+	std::copy(state.vz, state.vz + n, frame + 1 + 5 * n);
+	pending++;
+	frames++;
+	return pending == block_frames ? write_block() : (int)NO_ERROR;
+} // end add_to_block
+
+int trajectory_writer::open(const char* filename, const universe& u, bool compressed) {
+	const std::size_t count = u.get_num_of_bodies();
+	std::vector<std::string> body_names(count);
+	std::vector<double> masses(count), radii(count);
+	for (std::size_t i = 0; i < count; i++) {
+		body_names[i] = u.body_at(i)->get_name();
+		masses[i] = u.body_at(i)->get_mass();
+		radii[i] = u.body_at(i)->get_radius();
+	} // end for
+	return open(filename, body_names, masses.data(), radii.data(), compressed);
+} // end open
+
+int trajectory_writer::open(const char* filename, const std::vector<std::string>& body_names, const double* masses, const double* radii, bool compressed) {
+	close();
+	file.open(filename, std::ios::binary | std::ios::trunc);
+	if (file.is_open() == false) return ERR_FILE_OPEN;
+
+	n = body_names.size();
+	frames = 0;
+	compress = compressed;
+
+	// The names have different lengths, so the size of the preamble is only known once they are counted
+	std::uint64_t preamble = sizeof(trajectory_header) + 2 * n * sizeof(double);
+	for (std::size_t i = 0; i < n; i++)
+		preamble += sizeof(std::uint32_t) + body_names[i].size();
+
+	trajectory_header header{};
+	std::memcpy(header.magic, trajectory_magic, sizeof(header.magic));
+	header.version = compress ? trajectory_compressed_version : trajectory_version;
+	header.num_bodies = static_cast<std::uint32_t>(n);
+	header.num_frames = 0;
+	header.data_offset = (preamble + trajectory_alignment - 1) / trajectory_alignment * trajectory_alignment;
+	header.frame_bytes = (1 + 6 * n) * sizeof(double);
+	write_raw(file, &header, 1);
+
+	write_raw(file, masses, n);
+	write_raw(file, radii, n);
+	for (std::size_t i = 0; i < n; i++) {
+		const std::uint32_t length = static_cast<std::uint32_t>(body_names[i].size());
+		write_raw(file, &length, 1);
+		write_raw(file, body_names[i].data(), body_names[i].size());
+	} // end for
+
+	const char zeros[trajectory_alignment] = {};
+	write_raw(file, zeros, static_cast<std::size_t>(header.data_offset - preamble));
+	if (!file) {
+		file.close();
+		return ERR_FILE_WRITE;
+	} // end if
+	offset = header.data_offset;
+
+	// A block is decoded whole, so it is kept small enough for a reader to hold
+	blocks.clear();
+	pending = 0;
+	if (compress) {
+		block_frames = std::max<std::size_t>(1, std::min<std::size_t>(max_block_frames, max_block_bytes / header.frame_bytes));
+		block.assign(block_frames * (1 + 6 * n), 0.0);
+	} // end if
+	return NO_ERROR;
+} // end open
+
+int trajectory_writer::write_frame(double time, const state_view& state) {
+	if (file.is_open() == false) return ERR_FILE_NOT_OPEN;
+	if (state.n != n) return ERR_FILE_FORMAT;
+	if (compress) return add_to_block(time, state);
+	write_raw(file, &time, 1);
+	write_raw(file, state.x, n), write_raw(file, state.y, n), write_raw(file, state.z, n);
+	write_raw(file, state.vx, n), write_raw(file, state.vy, n), write_raw(file, state.vz, n);
+	if (!file) return ERR_FILE_WRITE;
+	frames++;
+	offset += (1 + 6 * n) * sizeof(double);
+	return NO_ERROR;
+} // end write_frame
+
+int trajectory_writer::write_frames(const double* data, std::size_t count) {
+	if (file.is_open() == false) return ERR_FILE_NOT_OPEN;
+	const std::size_t stride = 1 + 6 * n;
+	if (compress) {
+		for (std::size_t f = 0; f < count; f++) {
+			const int retval = add_to_block(data[f * stride], state_view(data + f * stride + 1, n));
+			if (retval != NO_ERROR) return retval;
+		} // end for
+		return NO_ERROR;
+	} // end if
+	write_raw(file, data, count * stride);
+	if (!file) return ERR_FILE_WRITE;
+	frames += count;
+	offset += count * stride * sizeof(double);
+	return NO_ERROR;
+} // end write_frames
+
+int trajectory_writer::close() {
+	if (file.is_open() == false) return NO_ERROR;
+	int retval = NO_ERROR;
+	if (compress) {
+		// The last block may not be full, then the index lets a reader find any block without walking them
+		retval = write_block();
+		trajectory_footer footer{};
+		footer.index_offset = offset;
+		footer.num_blocks = blocks.size();
+		std::memcpy(footer.magic, index_magic, sizeof(footer.magic));
+		write_raw(file, blocks.data(), blocks.size());
+		write_raw(file, &footer, 1);
+	} // end if
+
+	// Fill in the number of frames now it is known
+	file.seekp(offsetof(trajectory_header, num_frames));
+	write_raw(file, &frames, 1);
+	if (retval == NO_ERROR && !file) retval = ERR_FILE_WRITE;
+	file.close();
+	return retval;
+} // end close
+#pragma endregion
+
+#pragma region trajectory_reader
+/*****************************************************************************************************
+TRAJECTORY READER
+*****************************************************************************************************/
+int trajectory_reader::find_blocks() {
+	const std::uint64_t frame_size = 1 + 6 * header.num_bodies;
+	auto add_block = [&](std::uint64_t at, std::uint64_t end) {
+		if (at < header.data_offset || at > end || end - at < sizeof(trajectory_block)) return false;
+		trajectory_block info;
+		std::memcpy(&info, base + at, sizeof(info));
+		// Every value takes at least half a byte, which also keeps a corrupt count from allocating too much
+		if (info.num_frames == 0 || info.bytes > end - at - sizeof(info) || info.num_frames > 2 * info.bytes
+			|| info.num_frames * frame_size / 2 > info.bytes) return false;
+		blocks.push_back(at);
+		return true;
+	};
+
+	// A closed file ends with the index of its blocks
+	trajectory_footer footer;
+	bool indexed = false;
+	if (bytes - header.data_offset >= sizeof(footer)) {
+		std::memcpy(&footer, base + bytes - sizeof(footer), sizeof(footer));
+		const std::uint64_t end = bytes - sizeof(footer);
+		indexed = std::memcmp(footer.magic, index_magic, sizeof(footer.magic)) == 0 && footer.index_offset >= header.data_offset
+			&& footer.index_offset <= end && (end - footer.index_offset) / sizeof(std::uint64_t) == footer.num_blocks;
+		for (std::uint64_t b = 0; indexed && b < footer.num_blocks; b++) {
+			std::uint64_t at;
+			std::memcpy(&at, base + footer.index_offset + b * sizeof(at), sizeof(at));
+			indexed = add_block(at, footer.index_offset);
+		} // end for
+	} // end if
+
+	// Otherwise the writer never finished, walk the blocks up to the last complete one
+	if (indexed == false) {
+		blocks.clear();
+		std::uint64_t at = header.data_offset;
+		while (add_block(at, bytes)) {
+			trajectory_block info;
+			std::memcpy(&info, base + at, sizeof(info));
+			at += sizeof(info) + info.bytes;
+		} // end while
+	} // end if
+
+	// Every block but the last holds the same number of frames, so the block of a frame can be worked out
+	frames = 0;
+	block_frames = 0;
+	for (std::size_t b = 0; b < blocks.size(); b++) {
+		trajectory_block info;
+		std::memcpy(&info, base + blocks[b], sizeof(info));
+		if (b == 0) block_frames = info.num_frames;
+		if (info.num_frames > block_frames || (info.num_frames != block_frames && b + 1 != blocks.size())) return ERR_FILE_FORMAT;
+		frames += info.num_frames;
+	} // end for
+	cached_block = blocks.size();
+	return NO_ERROR;
+} // end find_blocks
+
+const double* trajectory_reader::frames_from(std::uint64_t f, std::uint64_t& count) const {
+	const std::size_t frame_size = 1 + 6 * header.num_bodies;
+	if (header.version == trajectory_version) {
+		count = frames - f;
+		return reinterpret_cast<const double*>(base + header.data_offset) + f * frame_size;
+	} // end if
+
+	const std::uint64_t b = f / block_frames;
+	trajectory_block info;
+	std::memcpy(&info, base + blocks[b], sizeof(info));
+	if (b != cached_block) {
+		cache.resize(static_cast<std::size_t>(block_frames) * frame_size);
+		const int retval = decode_frames(base + blocks[b] + sizeof(info), static_cast<std::size_t>(info.bytes),
+			static_cast<std::size_t>(info.num_frames), frame_size, cache.data());
+		if (retval != NO_ERROR) {
+			cached_block = blocks.size();
+			return nullptr;
+		} // end if
+		cached_block = b;
+	} // end if
+	const std::uint64_t first = f - b * block_frames;
+	count = std::min(info.num_frames - first, frames - f);
+	return cache.data() + first * frame_size;
+} // end frames_from
+
+int trajectory_reader::open(const char* filename) {
+	close();
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) return ERR_FILE_OPEN;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(handle, &size) == 0 || size.QuadPart < static_cast<LONGLONG>(sizeof(trajectory_header))) {
+		CloseHandle(handle);
+		return ERR_FILE_FORMAT;
+	} // end if
+	HANDLE map = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	CloseHandle(handle); // The mapping keeps the file open
+	if (map == nullptr) return ERR_FILE_MAP;
+	const void* view = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (view == nullptr) {
+		CloseHandle(map);
+		return ERR_FILE_MAP;
+	} // end if
+	mapping = map;
+	bytes = static_cast<std::size_t>(size.QuadPart);
+#else
+	const int fd = ::open(filename, O_RDONLY);
+	if (fd < 0) return ERR_FILE_OPEN;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size < static_cast<off_t>(sizeof(trajectory_header))) {
+		::close(fd);
+		return ERR_FILE_FORMAT;
+	} // end if
+	void* view = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd); // The mapping keeps the file open
+	if (view == MAP_FAILED) return ERR_FILE_MAP;
+	bytes = static_cast<std::size_t>(info.st_size);
+#endif
+	base = static_cast<const unsigned char*>(view);
+
+	// Check the header and that the preamble fits in the file
+	std::memcpy(&header, base, sizeof(header));
+	const std::uint64_t n = header.num_bodies;
+	if (std::memcmp(header.magic, trajectory_magic, sizeof(header.magic)) != 0
+		|| (header.version != trajectory_version && header.version != trajectory_compressed_version)
+		|| header.frame_bytes != (1 + 6 * n) * sizeof(double) || header.data_offset % sizeof(double) != 0
+		|| header.data_offset > bytes || sizeof(trajectory_header) + 2 * n * sizeof(double) > header.data_offset) {
+		close();
+		return ERR_FILE_FORMAT;
+	} // end if
+
+	// Read the names, they follow the masses and radii
+	std::uint64_t offset = sizeof(trajectory_header) + 2 * n * sizeof(double);
+	names.reserve(static_cast<std::size_t>(n));
+	for (std::uint64_t i = 0; i < n; i++) {
+		std::uint32_t length = 0;
+		if (offset + sizeof(length) > header.data_offset) break;
+		std::memcpy(&length, base + offset, sizeof(length));
+		offset += sizeof(length);
+		if (offset + length > header.data_offset) break;
+		names.emplace_back(reinterpret_cast<const char*>(base + offset), length);
+		offset += length;
+	} // end for
+	if (names.size() != n) {
+		close();
+		return ERR_FILE_FORMAT;
+	} // end if
+
+	// A run that stopped before its writer was closed still has every frame it completed
+	if (header.version == trajectory_compressed_version) {
+		if (find_blocks() != NO_ERROR) {
+			close();
+			return ERR_FILE_FORMAT;
+		} // end if
+	}
+	else frames = (bytes - header.data_offset) / header.frame_bytes;
+	if (header.num_frames != 0 && header.num_frames < frames) frames = header.num_frames;
+	return NO_ERROR;
+} // end open
+
+void trajectory_reader::close() {
+	if (base == nullptr) return;
+#ifdef _WIN32
+	UnmapViewOfFile(base);
+	CloseHandle(static_cast<HANDLE>(mapping));
+#else
+	munmap(const_cast<unsigned char*>(base), bytes);
+#endif
+	base = nullptr, bytes = 0, mapping = nullptr, frames = 0;
+	header = trajectory_header();
+	names.clear();
+	blocks.clear(), cache.clear();
+	block_frames = 0, cached_block = 0;
+} // end close
+
+int trajectory_reader::read_frames(std::uint64_t f, std::uint64_t count, double* out) const {
+	if (base == nullptr) return ERR_FILE_NOT_OPEN;
+	if (f > frames || count > frames - f) return ERR_FILE_FORMAT;
+	const std::size_t frame_size = 1 + 6 * header.num_bodies;
+	while (count > 0) {
+		std::uint64_t available;
+		const double* p = frames_from(f, available);
+		if (p == nullptr) return ERR_FILE_FORMAT;
+		available = std::min(available, count);
+		out = std::copy(p, p + available * frame_size, out);
+		f += available, count -= available;
+	} // end while
+	return NO_ERROR;
+} // end read_frames
+
+int trajectory_reader::export_csv(const char* filename, unsigned num_threads) const {
+	if (base == nullptr) return ERR_FILE_NOT_OPEN;
+	std::ofstream file(filename);
+	if (file.is_open() == false) return ERR_FILE_OPEN;
+
+	output_preamble(names, get_masses(), get_radii(), file);
+	csv_encoder encoder(num_threads);
+	for (std::uint64_t f = 0; f < frames;) {
+		std::uint64_t count = 0;
+		const double* data = frames_from(f, count);
+		if (data == nullptr) return ERR_FILE_FORMAT;
+		count = std::min(count, export_block);
+		encoder.write(data, static_cast<std::size_t>(count), header.num_bodies, file, ",");
+		f += count;
+	} // end for
+	output_number_of_steps(static_cast<int>(frames), file);
+	return file ? (int)NO_ERROR : (int)ERR_FILE_WRITE;
+} // end export_csv
+
+int trajectory_reader::export_trajectory(const char* filename, bool compressed) const {
+	if (base == nullptr) return ERR_FILE_NOT_OPEN;
+	trajectory_writer writer;
+	int retval = writer.open(filename, names, get_masses(), get_radii(), compressed);
+	for (std::uint64_t f = 0; retval == NO_ERROR && f < frames;) {
+		std::uint64_t count = 0;
+		const double* data = frames_from(f, count);
+		if (data == nullptr) retval = ERR_FILE_FORMAT;
+		else retval = writer.write_frames(data, static_cast<std::size_t>(count));
+		f += count;
+	} // end for
+	const int closed = writer.close();
+	return retval != NO_ERROR ? retval : closed;
+} // end export_trajectory
+
+trajectory_frame trajectory_reader::frame_at(std::uint64_t f) const {
+	const std::size_t n = header.num_bodies;
+	std::uint64_t count = 0;
+	const double* p = frames_from(f, count);
+	if (p == nullptr) return { 0.0, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+	return { p[0], p + 1, p + 1 + n, p + 1 + 2 * n, p + 1 + 3 * n, p + 1 + 4 * n, p + 1 + 5 * n };
+} // end frame_at
+
+state_view trajectory_reader::state_at(std::uint64_t f) const {
+	std::uint64_t count = 0;
+	const double* p = frames_from(f, count);
+	if (p == nullptr) return state_view(p, 0);
+	return state_view(p + 1, header.num_bodies);
+} // end state_at
+#pragma endregion
@@ -0,0 +1,312 @@
+// Contains the binary trajectory format, its writer and its memory mapped reader
+// A file is a header, the NUM_BODIES/NAMES/MASSES/RADII preamble and then one fixed size frame per
+// written time. Every value is a little endian float64 and a frame is laid out like the SoA store,
+// time, x[n], y[n], z[n], vx[n], vy[n], vz[n], so frame f starts at data_offset + f * frame_bytes and
+// a reader can map the file and index it directly (Python/trajectory.py does so with numpy.memmap)
+// Version 2 is the same header and preamble with the frames stored in compressed blocks instead (see
+// frame_codec.h). Each block is encoded on its own, so a reader can jump to any block without decoding
+// the blocks before it, and an index of the blocks is written at the end of the file when it is closed
+//
+// Layout of version 1
+//	offset 0	char[8]		magic, "SSTRAJ" padded with zeros
+//	offset 8	uint32		version
+//	offset 12	uint32		number of bodies n
+//	offset 16	uint64		number of frames, 0 until the writer is closed
+//	offset 24	uint64		data_offset, the first frame, a multiple of 64
+//	offset 32	uint64		frame_bytes, 8 * (1 + 6n)
+//	offset 40	float64[n]	masses
+//				float64[n]	radii
+//				n times		uint32 length then the characters of the name
+//				zeros up to data_offset
+//	data_offset	frames
+//
+// Layout of version 2, the header and preamble are as in version 1 and then
+//	data_offset	blocks, each a trajectory_block followed by its encoded frames. Every block but the last
+//				has the same number of frames
+//				uint64[num_blocks]	file offset of every block
+//				trajectory_footer
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "integrator.h"
+#include "particle_store.h"
+
+class universe;
+
+const std::uint32_t trajectory_version = 1; // Version with the frames stored as they are
+const std::uint32_t trajectory_compressed_version = 2; // Version with the frames stored in compressed blocks
+
+/// <summary>
+/// The fixed part of the header at the start of a trajectory file
+/// </summary>
+struct trajectory_header {
+	char magic[8];				// "SSTRAJ" padded with zeros
+	std::uint32_t version;		// Format version
+	std::uint32_t num_bodies;	// Number of bodies in every frame
+	std::uint64_t num_frames;	// Number of frames, 0 if the writer was never closed
+	std::uint64_t data_offset;	// Byte offset of the first frame
+	std::uint64_t frame_bytes;	// Size of a frame in bytes
+};
+static_assert(sizeof(trajectory_header) == 40, "trajectory_header must have no padding");
+
+/// <summary>
+/// The start of a block of compressed frames
+/// </summary>
+struct trajectory_block {
+	std::uint64_t num_frames;	// Number of frames in the block
+	std::uint64_t bytes;		// Size of the encoded frames after this
+};
+static_assert(sizeof(trajectory_block) == 16, "trajectory_block must have no padding");
+
+/// <summary>
+/// The end of a compressed trajectory file, written when the writer is closed
+/// </summary>
+struct trajectory_footer {
+	std::uint64_t index_offset;	// Byte offset of the block offsets
+	std::uint64_t num_blocks;	// Number of blocks
+	char magic[8];				// "SSINDEX" padded with zeros
+};
+static_assert(sizeof(trajectory_footer) == 24, "trajectory_footer must have no padding");
+
+/// <summary>
+/// One frame of a mapped trajectory, pointers into the file with num_bodies values each
+/// </summary>
+struct trajectory_frame {
+	double time;						// Time of the frame
+	const double* x, * y, * z;			// Positions
+	const double* vx, * vy, * vz;		// Velocities
+};
+
+/// <summary>
+/// Writes a trajectory file one frame at a time. A frame is written straight from the arrays
+/// a state_view points to, so writing does not allocate or format anything.
+/// When compressing, frames are gathered into a block and the block is encoded and written once it is full
+/// </summary>
+class trajectory_writer {
+private:
+	/*********************************************************
+	Member variables
+	*********************************************************/
+	std::ofstream file;			// The file being written
+	std::size_t n;				// Number of bodies in a frame
+	std::uint64_t frames;		// Frames written so far
+	std::uint64_t offset;		// Bytes written so far
+
+	/*********************************************************
+	Compression
+	*********************************************************/
+	bool compress;							// Write version 2, the frames in compressed blocks
+	std::size_t block_frames;				// Frames in a full block
+	aligned_vector<double> block;			// Frames waiting to be encoded
+	std::size_t pending;					// Number of frames in block
+	std::vector<unsigned char> encoded;		// The encoded block, kept between blocks
+	std::vector<std::uint64_t> blocks;		// File offset of every block written
+
+	/// <summary>
+	/// Encodes and writes the frames waiting in block
+	/// </summary>
+	int write_block();
+
+	/// <summary>
+	/// Copies a frame into the block, writing the block out once it is full
+	/// </summary>
+	int add_to_block(double time, const state_view& state);
+
+public:
+	/*********************************************************
+	Constructors and destructors
+	*********************************************************/
+	/// <summary>
+	/// Default constructor
+	/// </summary>
+	trajectory_writer() : n(0), frames(0), offset(0), compress(false), block_frames(0), pending(0) {}
+
+	/// <summary>
+	/// Destructor, closes the file so the number of frames is filled in
+	/// </summary>
+	~trajectory_writer() { close(); }
+
+	trajectory_writer(const trajectory_writer&) = delete;
+	trajectory_writer& operator=(const trajectory_writer&) = delete;
+
+	/// <summary>
+	/// Creates the file and writes the header and preamble of the bodies in a universe
+	/// </summary>
+	/// <param name="filename">The file to create, an existing file is overwritten</param>
+	/// <param name="u">The universe</param>
+	/// <param name="compressed">Store the frames in compressed blocks (version 2)</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int open(const char* filename, const universe& u, bool compressed = false);
+
+	/// <summary>
+	/// Creates the file and writes the header and a preamble of the given bodies
+	/// </summary>
+	/// <param name="filename">The file to create, an existing file is overwritten</param>
+	/// <param name="body_names">The names of the bodies</param>
+	/// <param name="masses">The masses of the bodies</param>
+	/// <param name="radii">The radii of the bodies</param>
+	/// <param name="compressed">Store the frames in compressed blocks (version 2)</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int open(const char* filename, const std::vector<std::string>& body_names, const double* masses, const double* radii, bool compressed = false);
+
+	/// <summary>
+	/// Writes the state of every body as the next frame
+	/// </summary>
+	/// <param name="time">Time of the frame</param>
+	/// <param name="state">The state, e.g. universe::get_particles() or the state from universe::dense_output</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int write_frame(double time, const state_view& state);
+
+	/// <summary>
+	/// Writes frames that are already laid out as in the file, time, x[n], y[n], z[n], vx[n], vy[n], vz[n]
+	/// </summary>
+	/// <param name="data">The frames, one after the other</param>
+	/// <param name="count">The number of frames</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int write_frames(const double* data, std::size_t count);
+
+	/// <summary>
+	/// Writes the last block and the block index if compressing, fills in the number of frames and
+	/// closes the file. Does nothing if no file is open
+	/// </summary>
+	/// <returns>The error code, see error.h for more</returns>
+	int close();
+
+	/*********************************************************
+	Getters
+	*********************************************************/
+	bool is_open() const { return file.is_open(); } // Get whether a file is open
+	bool is_compressed() const { return compress; } // Get whether the frames are compressed
+	std::uint64_t get_num_of_frames() const { return frames; } // Get the number of frames written so far
+}; // end class trajectory_writer
+
+/// <summary>
+/// Reads a trajectory file by memory mapping it, so opening does not read the frames and
+/// only the pages of the frames looked at are ever loaded from disk.
+/// The frames of a compressed file are decoded a block at a time into a cache, so a reader of
+/// a compressed file must not be shared between threads
+/// </summary>
+class trajectory_reader {
+private:
+	/*********************************************************
+	Member variables
+	*********************************************************/
+	const unsigned char* base;		// Start of the mapped file
+	std::size_t bytes;				// Size of the mapped file
+	void* mapping;					// Handle of the file mapping (Windows only)
+	trajectory_header header;		// Copy of the header
+	std::uint64_t frames;			// Number of complete frames in the file
+	std::vector<std::string> names;	// Names of the bodies
+
+	/*********************************************************
+	Compression
+	*********************************************************/
+	std::vector<std::uint64_t> blocks;		// File offset of every block
+	std::uint64_t block_frames;				// Frames in every block but the last
+	mutable aligned_vector<double> cache;	// The frames of the last block decoded
+	mutable std::uint64_t cached_block;		// The block in cache, or blocks.size() if there is none
+
+	/// <summary>
+	/// Finds the blocks of a compressed file from the index, or from the blocks themselves
+	/// if the writer was never closed
+	/// </summary>
+	int find_blocks();
+
+	/// <summary>
+	/// Gets frame f and the frames after it which are contiguous in memory
+	/// </summary>
+	/// <param name="f">The frame, less than get_num_of_frames()</param>
+	/// <param name="count">The number of contiguous frames from f, passed by reference</param>
+	/// <returns>The frames, nullptr if a compressed block could not be decoded</returns>
+	const double* frames_from(std::uint64_t f, std::uint64_t& count) const;
+
+public:
+	/*********************************************************
+	Constructors and destructors
+	*********************************************************/
+	/// <summary>
+	/// Default constructor
+	/// </summary>
+	trajectory_reader() : base(nullptr), bytes(0), mapping(nullptr), header(), frames(0), block_frames(0), cached_block(0) {}
+
+	/// <summary>
+	/// Destructor, unmaps the file
+	/// </summary>
+	~trajectory_reader() { close(); }
+
+	trajectory_reader(const trajectory_reader&) = delete;
+	trajectory_reader& operator=(const trajectory_reader&) = delete;
+
+	/// <summary>
+	/// Maps a trajectory file and checks its header. A file whose writer was never closed
+	/// is read up to its last complete frame, or its last complete block if it is compressed
+	/// </summary>
+	/// <param name="filename">The file</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int open(const char* filename);
+
+	/// <summary>
+	/// Unmaps the file. Does nothing if no file is open
+	/// </summary>
+	void close();
+
+	/// <summary>
+	/// Gets frame f. The pointers stay valid until the reader is closed, or for a compressed file until
+	/// a frame of another block is asked for. They are nullptr if a compressed block could not be decoded
+	/// </summary>
+	/// <param name="f">The frame, less than get_num_of_frames()</param>
+	trajectory_frame frame_at(std::uint64_t f) const;
+
+	/// <summary>
+	/// Gets the state of frame f, e.g. to pass on to output_no_whitespace. Stays valid as long as frame_at would,
+	/// it has no bodies if a compressed block could not be decoded
+	/// </summary>
+	/// <param name="f">The frame, less than get_num_of_frames()</param>
+	state_view state_at(std::uint64_t f) const;
+
+	/// <summary>
+	/// Copies count frames from f on, laid out as in the file, decoding them if the file is compressed
+	/// </summary>
+	/// <param name="f">The first frame</param>
+	/// <param name="count">The number of frames, f + count must not be more than get_num_of_frames()</param>
+	/// <param name="out">Room for count frames</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int read_frames(std::uint64_t f, std::uint64_t count, double* out) const;
+
+	/// <summary>
+	/// Writes every frame to a file in the text format of output.h, as read by plot_2d.py and plot_3d.py.
+	/// The rows are formatted in parallel chunks and written in order
+	/// </summary>
+	/// <param name="filename">The file to create, an existing file is overwritten</param>
+	/// <param name="num_threads">Number of threads formatting the rows, 0 uses one per core</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int export_csv(const char* filename, unsigned num_threads) const;
+
+	/// <summary>
+	/// Writes every frame to a new trajectory file, e.g. to compress a file or to decompress one for numpy
+	/// </summary>
+	/// <param name="filename">The file to create, an existing file is overwritten</param>
+	/// <param name="compressed">Store the frames in compressed blocks (version 2)</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int export_trajectory(const char* filename, bool compressed) const;
+
+	/*********************************************************
+	Getters
+	*********************************************************/
+	bool is_open() const { return base != nullptr; } // Get whether a file is mapped
+	std::uint32_t get_version() const { return header.version; } // Get the format version of the file
+	bool is_compressed() const { return header.version == trajectory_compressed_version; } // Get whether the frames are compressed
+	std::size_t get_num_of_bodies() const { return header.num_bodies; } // Get the number of bodies
+	std::uint64_t get_num_of_frames() const { return frames; } // Get the number of frames
+	const std::vector<std::string>& get_names() const { return names; } // Get the names of the bodies
+	const double* get_masses() const { return reinterpret_cast<const double*>(base + sizeof(trajectory_header)); } // Get the masses of the bodies
+	const double* get_radii() const { return get_masses() + header.num_bodies; } // Get the radii of the bodies
+}; // end class trajectory_reader
+
+#endif // TRAJECTORY_H
@@ -1,27 +1,1012 @@
+#include <algorithm>
+#include <cmath>
+
 #include "universe.h"
+#include "butcher.h"
+#include "gravity.h"
+#include "kepler.h"
+
+void universe::clear() {
+	// Give every body its own copy of its state back before the store is dropped
+	for (const auto& object : objects)
+		if (object != nullptr && object->_store == particles) object->detach();
+	objects.clear();
+	subsystems.clear();
+	// Copies of this universe still share the old store so start a new one
+	particles = std::make_shared<particle_store>();
+	tracers = std::make_shared<particle_store>();
+} // end clear
+
+void universe::add(body* object) {
+	// A body can only be in a universe once
+	if (object != nullptr && object->_store == particles) return;
+
+	objects.emplace_back(object);
+	// Keep the rows of the store lined up with objects
+	// a nullptr gets an empty row that is never included
+	if (object == nullptr) {
+		particles->add(point3(0.0, 0.0, 0.0), vel3(0.0, 0.0, 0.0), 0.0, 0.0, false);
+		return;
+	} // end if
+	object->attach(particles);
+} // end add
+
+int universe::add_subsystem(const std::vector<body*>& members, int substeps) {
+	subsystem sys;
+	sys.substeps = std::max(1, substeps);
+	for (const auto& member : members) {
+		if (member == nullptr) return ERR_BODY_NULLPTR;
+
+		// The body has to be in this universe, once
+		std::size_t i = 0;
+		while (i < objects.size() && objects[i] != member) i++;
+		if (i == objects.size()) return ERR_BODY_NOT_IN_UNIVERSE;
+		if (std::find(sys.members.begin(), sys.members.end(), i) != sys.members.end()) return ERR_BODY_IN_SUBSYSTEM;
+
+		// and in no other subsystem
+		for (const auto& other : subsystems)
+			if (std::find(other.members.begin(), other.members.end(), i) != other.members.end()) return ERR_BODY_IN_SUBSYSTEM;
+		sys.members.push_back(i);
+	} // end for
+
+	// A subsystem of one body is just that body
+	if (sys.members.size() > 1) subsystems.push_back(sys);
+	return NO_ERROR;
+} // end add_subsystem
+
+#pragma region private functions
+/*****************************************************************************************************
+PRIVATE FUNCTIONS
+*****************************************************************************************************/
+// The Runge-Kutta tableaus are in butcher.h
+namespace {
+	// Nystrom's fifth order Runge-Kutta-Nystrom coefficients, the embedded fourth order position weights
+	// are (-1/24, 25/56, 3/56, 1/24) which only differ from the fifth order ones by a multiple of the third difference of the stages
+	const double rkn54_c[] = { 0.0, 1.0 / 5.0, 2.0 / 3.0, 1.0 };
+	const double rkn54_a[] = { 1.0 / 50.0, -1.0 / 27.0, 7.0 / 27.0, 3.0 / 10.0, -2.0 / 35.0, 9.0 / 35.0 };
+	const double rkn54_b_bar[] = { 14.0 / 336.0, 100.0 / 336.0, 54.0 / 336.0, 0.0 };
+	const double rkn54_b[] = { 14.0 / 336.0, 125.0 / 336.0, 162.0 / 336.0, 35.0 / 336.0 };
+	const double rkn54_e_bar[] = { 14.0 / 336.0 + 1.0 / 24.0, 100.0 / 336.0 - 25.0 / 56.0, 54.0 / 336.0 - 3.0 / 56.0, -1.0 / 24.0 };
+	const rkn_tableau rkn54 = { 4, 5, rkn54_c, rkn54_a, rkn54_b_bar, rkn54_b, rkn54_e_bar };
+
+	// Leapfrog drift-kick-drift coefficients
+	const double leapfrog_drift[] = { 0.5, 0.5 };
+	const double leapfrog_kick[] = { 1.0 };
+
+	// Velocity Verlet kick-drift-kick coefficients, the empty first and last drifts let the
+	// force at the end of one step be the force at the start of the next
+	const double verlet_drift[] = { 0.0, 1.0, 0.0 };
+	const double verlet_kick[] = { 0.5, 0.5 };
+
+	// Yoshida / Forest-Ruth fourth order coefficients, w1 = 1 / (2 - 2^(1/3)) and w0 = 1 - 2 * w1
+	const double yoshida_w1 = 1.0 / (2.0 - std::cbrt(2.0));
+	const double yoshida_w0 = 1.0 - 2.0 * yoshida_w1;
+	const double yoshida_drift[] = { yoshida_w1 / 2.0, (yoshida_w0 + yoshida_w1) / 2.0, (yoshida_w0 + yoshida_w1) / 2.0, yoshida_w1 / 2.0 };
+	const double yoshida_kick[] = { yoshida_w1, yoshida_w0, yoshida_w1 };
+
+	// Gauss-Radau nodes as fractions of the step, the roots of (P7 + P8) / (1 + x) on [0, 1] plus the start
+	const double radau_h[] = { 0.0, 0.0562625605369221464656521910318, 0.180240691736892364987579942780,
+		0.352624717113169637373907769648, 0.547153626330555383001448554766, 0.734210177215410531523210605558,
+		0.885320946839095768090359771030, 0.977520613561287501891174488626 };
+
+	/// <summary>
+	/// Converts the divided difference form of the IAS15 expansion, g, into powers of the step fraction, b.
+	/// Term j of g multiplies t (t - h1) ... (t - hj) so c[j][k] is the coefficient of t^(k + 1) in it
+	/// </summary>
+	struct radau_table {
+		double c[7][7];
+
+		radau_table() {
+			for (int j = 0; j < 7; j++) {
+				// Multiply the polynomial of term j - 1 by (t - hj)
+				for (int k = 0; k < 7; k++) c[j][k] = 0.0;
+				if (j == 0) {
+					c[0][0] = 1.0;
+					continue;
+				} // end if
+				for (int k = 0; k <= j; k++)
+					c[j][k] = (k > 0 ? c[j - 1][k - 1] : 0.0) - radau_h[j] * (k < j ? c[j - 1][k] : 0.0);
+			} // end for
+		} // end radau_table
+	};
+	const radau_table radau;
+	// Fewest predictor-corrector iterations of a step that has nothing to start from, and the most of any step
+	const int radau_min_iterations = 2;
+	const int radau_max_iterations = 12;
+	// A step is retried if the next time step would be less than this fraction of it, and grows by at most 1 / this
+	const double radau_safety = 0.25;
+
+	// Bulirsch-Stoer substep sequence, each column of the table adds the next one
+	const int bs_substeps[] = { 2, 4, 6, 8, 10, 12, 14, 16 };
+	const int bs_columns = 8;
+	// Step size controller, h_k = h * bs_safety * (bs_target / err_k)^(1 / (2k + 1)) kept within [bs_min_factor, bs_max_factor]
+	const double bs_safety = 0.94, bs_target = 0.65, bs_min_factor = 0.02, bs_max_factor = 4.0;
+
+	// PI step size controller of the embedded methods, h_new = h * step_safety * err^-alpha * err_old^step_beta
+	// kept within [step_min_factor, step_max_factor], where alpha = 1 / order - 0.75 * step_beta
+	const double step_safety = 0.9, step_min_factor = 0.2, step_max_factor = 10.0, step_beta = 0.08;
+
+	// Test particles moved over a step of the bodies take substeps of at most test_eta times the shortest
+	// sqrt(r^3 / GM) from a particle to a body, a step that needs more than test_max_substeps is too big
+	const double test_eta = 0.01;
+	const double test_max_substeps = 65536.0;
+
+	// An adaptive step may not shrink below this fraction of the shortest |v| / |a| of a body at its start
+	const double min_step_fraction = 1e-12;
+
+	/// <summary>
+	/// Gets one of the six arrays of a phase_arrays, 0 to 2 are the positions and 3 to 5 the velocities
+	/// </summary>
+	inline double* component(phase_arrays& p, int c) {
+		aligned_vector<double>* arrays[6] = { &p.x, &p.y, &p.z, &p.vx, &p.vy, &p.vz };
+		return arrays[c]->data();
+	} // end component
+
+	inline const double* component(const phase_arrays& p, int c) {
+		const aligned_vector<double>* arrays[6] = { &p.x, &p.y, &p.z, &p.vx, &p.vy, &p.vz };
+		return arrays[c]->data();
+	} // end component
+
+	// Fewest targets worth handing to a thread
+	const std::size_t min_targets_per_thread = 64;
+	// The collision check is triangular so it is split into more chunks to balance it
+	const std::size_t collision_chunks_per_thread = 4;
+	// Tree walks cost more in dense regions so they are split into more chunks too
+	const std::size_t tree_chunks_per_thread = 4;
+} // end namespace
+
+thread_pool& universe::get_pool() {
+	if (!pool) pool = std::make_shared<thread_pool>(threads);
+	return *pool;
+} // end get_pool
+
+void universe::compute_accelerations(const gravity_block& bodies, std::size_t n, double* ax, double* ay, double* az) {
+	switch (solver) {
+	case SOLVER_BARNES_HUT:
+		// Build the tree on one thread, then each thread walks it for a range of targets
+		tree->build(bodies, n, theta);
+		get_pool().parallel_for(n, tree_chunks_per_thread, 1, min_targets_per_thread, [&](std::size_t, std::size_t begin, std::size_t end) {
+			tree->add_acceleration(bodies, begin, end, ax, ay, az);
+		});
+		break;
+	case SOLVER_FMM: {
+		// Build the tree on one thread, then share out its subtrees for each pass
+		fmm& f = *multipoles;
+		thread_pool& p = get_pool();
+		f.build(bodies, n, expansion, theta);
+		p.parallel_for(f.get_num_of_tasks(), 1, 1, 1, [&](std::size_t, std::size_t begin, std::size_t end) {
+			for (std::size_t t = begin; t < end; t++) f.upward(t);
+		});
+		f.upward_top();
+		p.parallel_for(f.get_num_of_tasks(), tree_chunks_per_thread, 1, 1, [&](std::size_t, std::size_t begin, std::size_t end) {
+			for (std::size_t t = begin; t < end; t++) f.evaluate(t, ax, ay, az);
+		});
+		break;
+	} // end case
+	default: {
+		// Every pair once, adding equal and opposite accelerations to both bodies
+		// The tiles of a round touch different bodies so they can go to different threads
+		thread_pool& p = get_pool();
+		for (std::size_t round = 0; round < pairwise_num_rounds(n); round++)
+			p.parallel_for(pairwise_num_tiles(n, round), 1, 1, 1, [&](std::size_t, std::size_t begin, std::size_t end) {
+				for (std::size_t t = begin; t < end; t++)
+					pairwise_tile(bodies, n, round, t, ax, ay, az);
+			});
+		break;
+	} // end default
+	} // end switch
+} // end compute_accelerations
+
+void universe::compute_accelerations(const gravity_block& targets, std::size_t m, const gravity_block& sources, std::size_t n,
+	double* ax, double* ay, double* az) {
+	thread_pool& p = get_pool();
+	if (solver == SOLVER_DIRECT) {
+		// Each thread sums every source onto a range of targets
+		p.parallel_for(m, 1, 1, min_targets_per_thread, [&](std::size_t, std::size_t begin, std::size_t end) {
+			direct_summation(targets, begin, end, sources, 0, n, ax, ay, az);
+		});
+		return;
+	} // end if
+
+	// Build the tree of the sources on one thread, then each thread walks it for a range of targets
+	tree->build(sources, n, theta);
+	p.parallel_for(m, tree_chunks_per_thread, 1, min_targets_per_thread, [&](std::size_t, std::size_t begin, std::size_t end) {
+		tree->add_acceleration(targets, begin, end, ax, ay, az);
+	});
+} // end compute_accelerations
+
+int universe::compute_derivatives(const phase_arrays& state, phase_arrays& deriv) {
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	aligned_vector<double>& gm = workspace->gm;
+
+	for (std::size_t i = 0; i < n; i++) {
+		// The position variables are dependant on only the current velocity of a body
+		deriv.x[i] = state.vx[i], deriv.y[i] = state.vy[i], deriv.z[i] = state.vz[i];
+		deriv.vx[i] = 0.0, deriv.vy[i] = 0.0, deriv.vz[i] = 0.0;
+		// Bodies no longer in the simulation exert no force
+		gm[i] = s.included(i) ? grav_constant * s.mass[i] : 0.0;
+	} // end for
+
+	// The velocity variables are dependant on the force due to all bodies in the universe
+	const gravity_block bodies{ state.x.data(), state.y.data(), state.z.data(), gm.data() };
+	compute_accelerations(bodies, n, deriv.vx.data(), deriv.vy.data(), deriv.vz.data());
+
+	for (std::size_t i = 0; i < n; i++) {
+		// Bodies no longer in the simulation do not move
+		if (s.included(i) == false) {
+			deriv.x[i] = 0.0, deriv.y[i] = 0.0, deriv.z[i] = 0.0;
+			deriv.vx[i] = 0.0, deriv.vy[i] = 0.0, deriv.vz[i] = 0.0;
+			continue;
+		} // end if
+
+		// if the acceleration applied on a body is NaN return an error
+		if (deriv.vx[i] != deriv.vx[i]) return ERR_AX_NAN;
+		if (deriv.vy[i] != deriv.vy[i]) return ERR_AY_NAN;
+		if (deriv.vz[i] != deriv.vz[i]) return ERR_AZ_NAN;
+	} // end for
+
+	return NO_ERROR;
+} // end compute_derivatives
+
+int universe::compute_derivatives_cached(const phase_arrays& state, phase_arrays& deriv) {
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+
+	// The kept force can be used if nothing has moved or changed mass since
+	bool reuse = (w.last_valid && w.last.x.size() == n);
+	for (std::size_t i = 0; reuse && i < n; i++) {
+		w.gm[i] = s.included(i) ? grav_constant * s.mass[i] : 0.0;
+		reuse = (w.last.x[i] == state.x[i] && w.last.y[i] == state.y[i] && w.last.z[i] == state.z[i] && w.last_gm[i] == w.gm[i]);
+	} // end for
+	if (reuse == false) return compute_derivatives(state, deriv);
+
+	for (std::size_t i = 0; i < n; i++) {
+		// Bodies no longer in the simulation do not move
+		const bool in = s.included(i);
+		deriv.x[i] = in ? state.vx[i] : 0.0, deriv.y[i] = in ? state.vy[i] : 0.0, deriv.z[i] = in ? state.vz[i] : 0.0;
+		deriv.vx[i] = w.last.vx[i], deriv.vy[i] = w.last.vy[i], deriv.vz[i] = w.last.vz[i];
+	} // end for
+
+	return NO_ERROR;
+} // end compute_derivatives_cached
+
+int universe::compute_external_derivatives(const phase_arrays& state, phase_arrays& deriv) {
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+
+	int retval = compute_derivatives(state, deriv);
+	if (retval != NO_ERROR) return retval;
+
+	// Take the pull of the members of each subsystem on each other back off, it is in the drift
+	for (const auto& sys : subsystems) {
+		const std::size_t m = sys.members.size();
+		w.inner.resize(m), w.inner_acc.resize(m), w.inner_gm.resize(m);
+		for (std::size_t r = 0; r < m; r++) {
+			const std::size_t i = sys.members[r];
+			w.inner.x[r] = state.x[i], w.inner.y[r] = state.y[i], w.inner.z[r] = state.z[i];
+			w.inner_gm[r] = w.gm[i];
+			w.inner_acc.x[r] = 0.0, w.inner_acc.y[r] = 0.0, w.inner_acc.z[r] = 0.0;
+		} // end for
+		const gravity_block members{ w.inner.x.data(), w.inner.y.data(), w.inner.z.data(), w.inner_gm.data() };
+		direct_summation(members, 0, m, members, 0, m, w.inner_acc.x.data(), w.inner_acc.y.data(), w.inner_acc.z.data());
+
+		for (std::size_t r = 0; r < m; r++) {
+			const std::size_t i = sys.members[r];
+			if (s.included(i) == false) continue;
+			deriv.vx[i] -= w.inner_acc.x[r], deriv.vy[i] -= w.inner_acc.y[r], deriv.vz[i] -= w.inner_acc.z[r];
+		} // end for
+	} // end for
+
+	return NO_ERROR;
+} // end compute_external_derivatives
+
+int universe::drift_subsystem(const subsystem& sys, double dt) {
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	phase_arrays& q = w.inner;
+	phase_arrays& a = w.inner_acc;
+
+	// Gather the included members
+	w.rows.clear();
+	for (const auto& i : sys.members) {
+		if (s.included(i) == false) continue;
+		w.rows.push_back(i);
+	} // end for
+	const std::size_t m = w.rows.size();
+	q.resize(m), a.resize(m), w.inner_gm.resize(m);
 
-int universe::check_step(double err, double tol, double& dt, std::vector<pos_vel_params> pos_vel_vec) {
-	if (err > tol) { // Reject the step
-		dt /= 2; // Half the time step
-		pos_vel_vec.clear(); // Remove elements from array
+	// Centre of mass of the members, it moves in a straight line
+	double gm = 0.0, cx = 0.0, cy = 0.0, cz = 0.0, cvx = 0.0, cvy = 0.0, cvz = 0.0;
+	for (std::size_t r = 0; r < m; r++) {
+		const std::size_t i = w.rows[r];
+		w.inner_gm[r] = grav_constant * s.mass[i];
+		gm += w.inner_gm[r];
+		cx += w.inner_gm[r] * w.stage.x[i], cy += w.inner_gm[r] * w.stage.y[i], cz += w.inner_gm[r] * w.stage.z[i];
+		cvx += w.inner_gm[r] * w.stage.vx[i], cvy += w.inner_gm[r] * w.stage.vy[i], cvz += w.inner_gm[r] * w.stage.vz[i];
+	} // end for
+	if (m == 0) return NO_ERROR;
+	if (gm == 0.0) {
+		for (const auto& i : w.rows)
+			w.stage.x[i] += dt * w.stage.vx[i], w.stage.y[i] += dt * w.stage.vy[i], w.stage.z[i] += dt * w.stage.vz[i];
 		return NO_ERROR;
 	} // end if
-	else { // Accept the step
-		for (auto i = 0; i < pos_vel_vec.size(); i++) {
-			this->body_at(i)->update_params(pos_vel_vec.at(i)); // Update params
-		}
-		pos_vel_vec.clear(); // Remove elements from array
-
-		if (err * 2 < tol) { // If error is much smaller than tol
-							 // We can increase the time step
-			dt *= 2;
-			return NO_ERROR;
+	cx /= gm, cy /= gm, cz /= gm, cvx /= gm, cvy /= gm, cvz /= gm;
+
+	// Members relative to the centre of mass
+	for (std::size_t r = 0; r < m; r++) {
+		const std::size_t i = w.rows[r];
+		q.x[r] = w.stage.x[i] - cx, q.y[r] = w.stage.y[i] - cy, q.z[r] = w.stage.z[i] - cz;
+		q.vx[r] = w.stage.vx[i] - cvx, q.vy[r] = w.stage.vy[i] - cvy, q.vz[r] = w.stage.vz[i] - cvz;
+	} // end for
+
+	if (m == 2) {
+		// A pair follows the Kepler orbit of its separation, each member stays on its side of the centre of mass
+		double x = q.x[1] - q.x[0], y = q.y[1] - q.y[0], z = q.z[1] - q.z[0];
+		double vx = q.vx[1] - q.vx[0], vy = q.vy[1] - q.vy[0], vz = q.vz[1] - q.vz[0];
+		int retval = kepler_drift(gm, dt, x, y, z, vx, vy, vz);
+		if (retval != NO_ERROR) return retval;
+		const double f0 = -w.inner_gm[1] / gm, f1 = w.inner_gm[0] / gm;
+		q.x[0] = f0 * x, q.y[0] = f0 * y, q.z[0] = f0 * z, q.vx[0] = f0 * vx, q.vy[0] = f0 * vy, q.vz[0] = f0 * vz;
+		q.x[1] = f1 * x, q.y[1] = f1 * y, q.z[1] = f1 * z, q.vx[1] = f1 * vx, q.vy[1] = f1 * vy, q.vz[1] = f1 * vz;
+	}
+	else if (m > 2) {
+		// Velocity Verlet on the pull of the members on each other
+		const double h = dt / sys.substeps;
+		const gravity_block members{ q.x.data(), q.y.data(), q.z.data(), w.inner_gm.data() };
+		auto accelerate = [&]() {
+			std::fill(a.x.begin(), a.x.end(), 0.0), std::fill(a.y.begin(), a.y.end(), 0.0), std::fill(a.z.begin(), a.z.end(), 0.0);
+			direct_summation(members, 0, m, members, 0, m, a.x.data(), a.y.data(), a.z.data());
+		};
+		accelerate();
+		for (int k = 0; k < sys.substeps; k++) {
+			for (std::size_t r = 0; r < m; r++) {
+				q.vx[r] += 0.5 * h * a.x[r], q.vy[r] += 0.5 * h * a.y[r], q.vz[r] += 0.5 * h * a.z[r];
+				q.x[r] += h * q.vx[r], q.y[r] += h * q.vy[r], q.z[r] += h * q.vz[r];
+			} // end for
+			accelerate();
+			for (std::size_t r = 0; r < m; r++) {
+				q.vx[r] += 0.5 * h * a.x[r], q.vy[r] += 0.5 * h * a.y[r], q.vz[r] += 0.5 * h * a.z[r];
+			} // end for
+		} // end for
+	} // end if
+
+	// Back to the frame of the universe around the moved centre of mass
+	cx += dt * cvx, cy += dt * cvy, cz += dt * cvz;
+	for (std::size_t r = 0; r < m; r++) {
+		const std::size_t i = w.rows[r];
+		w.stage.x[i] = cx + q.x[r], w.stage.y[i] = cy + q.y[r], w.stage.z[i] = cz + q.z[r];
+		w.stage.vx[i] = cvx + q.vx[r], w.stage.vy[i] = cvy + q.vy[r], w.stage.vz[i] = cvz + q.vz[r];
+	} // end for
+
+	return NO_ERROR;
+} // end drift_subsystem
+
+int universe::kick_test_particles(const state_view& state, double dt, int central) {
+	integrator_workspace& w = *workspace;
+	particle_store& t = *tracers;
+	const std::size_t m = t.size();
+	if (m == 0) return NO_ERROR;
+
+	// The pull of the central body is left out, and the pull of the others on the central body taken off
+	double gm0 = 0.0, ix = 0.0, iy = 0.0, iz = 0.0;
+	if (central >= 0) {
+		const std::size_t c = static_cast<std::size_t>(central);
+		gm0 = w.gm[c];
+		w.gm[c] = 0.0;
+		for (std::size_t j = 0; j < state.n; j++) {
+			if (w.gm[j] == 0.0) continue;
+			const double dx = state.x[j] - state.x[c], dy = state.y[j] - state.y[c], dz = state.z[j] - state.z[c];
+			const double r2 = dx * dx + dy * dy + dz * dz;
+			const double f = w.gm[j] / (r2 * std::sqrt(r2));
+			ix += f * dx, iy += f * dy, iz += f * dz;
+		} // end for
+	} // end if
+
+	w.test_ax.assign(m, 0.0), w.test_ay.assign(m, 0.0), w.test_az.assign(m, 0.0);
+	const gravity_block targets{ t.x.data(), t.y.data(), t.z.data(), t.mass.data() };
+	const gravity_block sources{ state.x, state.y, state.z, w.gm.data() };
+	compute_accelerations(targets, m, sources, state.n, w.test_ax.data(), w.test_ay.data(), w.test_az.data());
+	if (central >= 0) w.gm[central] = gm0;
+
+	for (std::size_t i = 0; i < m; i++) {
+		if (t.included(i) == false) continue;
+
+		// if the acceleration applied on a test particle is NaN return an error
+		if (w.test_ax[i] != w.test_ax[i] || ix != ix) return ERR_AX_NAN;
+		if (w.test_ay[i] != w.test_ay[i] || iy != iy) return ERR_AY_NAN;
+		if (w.test_az[i] != w.test_az[i] || iz != iz) return ERR_AZ_NAN;
+		t.vx[i] += dt * (w.test_ax[i] - ix), t.vy[i] += dt * (w.test_ay[i] - iy), t.vz[i] += dt * (w.test_az[i] - iz);
+	} // end for
+
+	return NO_ERROR;
+} // end kick_test_particles
+
+void universe::drift_test_particles(double dt) {
+	particle_store& t = *tracers;
+	const std::size_t m = t.size();
+	for (std::size_t i = 0; i < m; i++) {
+		t.x[i] += dt * t.vx[i], t.y[i] += dt * t.vy[i], t.z[i] += dt * t.vz[i];
+	} // end for
+} // end drift_test_particles
+
+int universe::advance_test_particles(const state_view& start, const state_view& end, double dt, int central) {
+	particle_store& t = *tracers;
+	const std::size_t m = t.size();
+	if (m == 0 || dt == 0.0) return NO_ERROR;
+
+	// The masses the bodies pull with, the steps leave other things in gm
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	w.gm.resize(n);
+	for (std::size_t i = 0; i < n; i++) w.gm[i] = s.included(i) ? grav_constant * s.mass[i] : 0.0;
+
+	// A particle inside a body would ask for no substep at all
+	collide_test_particles(start);
+
+	// The step of the bodies can be far longer than a test particle close to one of them can take,
+	// so the particles take substeps short enough for the one falling fastest onto a body
+	thread_pool& p = get_pool();
+	std::vector<double> shortest(p.num_chunks(1), HUGE_VAL);
+	p.parallel_for(m, 1, 1, min_targets_per_thread, [&](std::size_t chunk, std::size_t begin, std::size_t stop) {
+		for (std::size_t i = begin; i < stop; i++) {
+			if (t.included(i) == false) continue;
+			for (std::size_t j = 0; j < n; j++) {
+				// The central body's pull is in the Kepler drift which follows it exactly
+				if (w.gm[j] == 0.0 || static_cast<int>(j) == central) continue;
+				const double dx = t.x[i] - start.x[j], dy = t.y[i] - start.y[j], dz = t.z[i] - start.z[j];
+				const double r2 = dx * dx + dy * dy + dz * dz;
+				shortest[chunk] = std::min(shortest[chunk], r2 * std::sqrt(r2) / w.gm[j]);
+			} // end for
+		} // end for
+	});
+	const double fall = std::sqrt(*std::min_element(shortest.begin(), shortest.end()));
+	const double substeps = std::ceil(std::abs(dt) / (test_eta * fall));
+	if (substeps > test_max_substeps) return ERR_DT_TOO_BIG;
+	const int count = std::max(1, static_cast<int>(substeps));
+	const double h = dt / count;
+	w.test_start.load(t);
+
+	// The bodies at a fraction theta of the step, from the cubic through their start and end positions and velocities
+	phase_arrays& b = w.test_bodies;
+	b.resize(n);
+	auto bodies_at = [&](double theta, std::size_t first, std::size_t last) {
+		const double t2 = theta * theta, t3 = t2 * theta;
+		const double h00 = 2.0 * t3 - 3.0 * t2 + 1.0, h10 = t3 - 2.0 * t2 + theta, h01 = 3.0 * t2 - 2.0 * t3, h11 = t3 - t2;
+		const double d00 = (6.0 * t2 - 6.0 * theta) / dt, d10 = 3.0 * t2 - 4.0 * theta + 1.0, d01 = -d00, d11 = 3.0 * t2 - 2.0 * theta;
+		for (std::size_t j = first; j < last; j++) {
+			b.x[j] = h00 * start.x[j] + h10 * dt * start.vx[j] + h01 * end.x[j] + h11 * dt * end.vx[j];
+			b.y[j] = h00 * start.y[j] + h10 * dt * start.vy[j] + h01 * end.y[j] + h11 * dt * end.vy[j];
+			b.z[j] = h00 * start.z[j] + h10 * dt * start.vz[j] + h01 * end.z[j] + h11 * dt * end.vz[j];
+			b.vx[j] = d00 * start.x[j] + d10 * start.vx[j] + d01 * end.x[j] + d11 * end.vx[j];
+			b.vy[j] = d00 * start.y[j] + d10 * start.vy[j] + d01 * end.y[j] + d11 * end.vy[j];
+			b.vz[j] = d00 * start.z[j] + d10 * start.vz[j] + d01 * end.z[j] + d11 * end.vz[j];
+		} // end for
+	};
+
+	// Yoshida's fourth order drifts and kicks in every substep, each kick from the bodies at its time
+	double theta = 0.0;
+	for (int step = 0; step < count; step++) {
+		for (int k = 0; k <= 3; k++) {
+			const double drift = yoshida_drift[k] * h;
+			if (central < 0) drift_test_particles(drift);
+			else {
+				// Each particle follows its orbit relative to the central body, which moves on between the two times
+				const std::size_t c = static_cast<std::size_t>(central);
+				double from[6], to[6];
+				bodies_at(theta, c, c + 1);
+				for (int q = 0; q < 6; q++) from[q] = component(b, q)[c];
+				bodies_at(theta + yoshida_drift[k] / count, c, c + 1);
+				for (int q = 0; q < 6; q++) to[q] = component(b, q)[c];
+
+				w.status.assign(p.num_chunks(1), NO_ERROR);
+				p.parallel_for(m, 1, 1, min_targets_per_thread, [&](std::size_t chunk, std::size_t begin, std::size_t stop) {
+					for (std::size_t i = begin; i < stop && w.status[chunk] == NO_ERROR; i++) {
+						if (t.included(i) == false) continue;
+						double x = t.x[i] - from[0], y = t.y[i] - from[1], z = t.z[i] - from[2];
+						double vx = t.vx[i] - from[3], vy = t.vy[i] - from[4], vz = t.vz[i] - from[5];
+						w.status[chunk] = kepler_drift(w.gm[c], drift, x, y, z, vx, vy, vz);
+						t.x[i] = to[0] + x, t.y[i] = to[1] + y, t.z[i] = to[2] + z;
+						t.vx[i] = to[3] + vx, t.vy[i] = to[4] + vy, t.vz[i] = to[5] + vz;
+					} // end for
+				});
+				for (int status : w.status)
+					if (status != NO_ERROR) {
+						w.test_start.store(t);
+						return status;
+					} // end if
+			} // end if
+			theta += yoshida_drift[k] / count;
+			if (k == 3) break;
+
+			bodies_at(theta, 0, n);
+			const int retval = kick_test_particles(b, yoshida_kick[k] * h, central);
+			if (retval != NO_ERROR) {
+				w.test_start.store(t);
+				return retval;
+			} // end if
+		} // end for
+	} // end for
+
+	return NO_ERROR;
+} // end advance_test_particles
+
+void universe::collide_test_particles(const state_view& bodies) {
+	particle_store& t = *tracers;
+	const particle_store& s = *particles;
+	const std::size_t m = t.size(), n = s.size();
+	if (m == 0) return;
+
+	// Find the particles inside a body, each chunk of particles in parallel
+	thread_pool& p = get_pool();
+	auto& hits = workspace->collisions;
+	hits.resize(p.num_chunks(collision_chunks_per_thread));
+	for (auto& chunk : hits) chunk.clear();
+	p.parallel_for(m, collision_chunks_per_thread, 1, min_targets_per_thread, [&](std::size_t c, std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (t.included(i) == false) continue;
+			for (std::size_t j = 0; j < n; j++) {
+				if (s.included(j) == false) continue;
+				const double dx = t.x[i] - bodies.x[j], dy = t.y[i] - bodies.y[j], dz = t.z[i] - bodies.z[j];
+				if (dx * dx + dy * dy + dz * dz <= s.radius[j] * s.radius[j]) {
+					hits[c].emplace_back(i, j);
+					break;
+				} // end if
+			} // end for
+		} // end for
+	});
+
+	// The particle is 'deleted', the body does not notice
+	for (const auto& chunk : hits)
+		for (const auto& pair : chunk) {
+			std::cerr << "\nTest particle: " << pair.first << " has hit body: " << objects[pair.second]->name << "\n";
+			t.set_to_zero(pair.first);
+		} // end for
+} // end collide_test_particles
+
+void universe::keep_force(const phase_arrays& state, const phase_arrays& deriv) {
+	integrator_workspace& w = *workspace;
+	w.last.resize(state.x.size());
+	w.last.x = state.x, w.last.y = state.y, w.last.z = state.z;
+	w.last.vx = deriv.vx, w.last.vy = deriv.vy, w.last.vz = deriv.vz;
+	w.last_gm = w.gm;
+	w.last_valid = true;
+} // end keep_force
+
+int universe::compute_jerks(const phase_arrays& state, phase_arrays& aj) {
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	aligned_vector<double>& gm = workspace->gm;
+
+	for (std::size_t i = 0; i < n; i++) {
+		aj.x[i] = 0.0, aj.y[i] = 0.0, aj.z[i] = 0.0;
+		aj.vx[i] = 0.0, aj.vy[i] = 0.0, aj.vz[i] = 0.0;
+		// Bodies no longer in the simulation exert no force
+		gm[i] = s.included(i) ? grav_constant * s.mass[i] : 0.0;
+	} // end for
+
+	// Every pair once, the tiles of a round touch different bodies so they can go to different threads
+	const gravity_block bodies{ state.x.data(), state.y.data(), state.z.data(), gm.data() };
+	const velocity_block v{ state.vx.data(), state.vy.data(), state.vz.data() };
+	thread_pool& p = get_pool();
+	for (std::size_t round = 0; round < pairwise_num_rounds(n); round++)
+		p.parallel_for(pairwise_num_tiles(n, round), 1, 1, 1, [&](std::size_t, std::size_t begin, std::size_t end) {
+			for (std::size_t t = begin; t < end; t++)
+				pairwise_jerk_tile(bodies, v, n, round, t, aj.x.data(), aj.y.data(), aj.z.data(), aj.vx.data(), aj.vy.data(), aj.vz.data());
+		});
+
+	for (std::size_t i = 0; i < n; i++) {
+		// Bodies no longer in the simulation do not move
+		if (s.included(i) == false) {
+			aj.x[i] = 0.0, aj.y[i] = 0.0, aj.z[i] = 0.0;
+			aj.vx[i] = 0.0, aj.vy[i] = 0.0, aj.vz[i] = 0.0;
+			continue;
+		} // end if
+
+		// if the acceleration applied on a body is NaN return an error
+		if (aj.x[i] != aj.x[i]) return ERR_AX_NAN;
+		if (aj.y[i] != aj.y[i]) return ERR_AY_NAN;
+		if (aj.z[i] != aj.z[i]) return ERR_AZ_NAN;
+	} // end for
+
+	return NO_ERROR;
+} // end compute_jerks
+
+template <class Row, int Stages>
+void universe::build_stage(double dt) {
+	integrator_workspace& w = *workspace;
+	const std::size_t n = particles->size();
+
+	// One component at a time so the inner loop is a plain sweep over contiguous arrays
+	for (int c = 0; c < 6; c++) {
+		const double* k[integrator_workspace::max_stages] = {};
+		for (int j = 0; j < Stages; j++) k[j] = component(w.k[j], c);
+		const double* start = component(w.y0, c);
+		double* out = component(w.stage, c);
+		for (std::size_t i = 0; i < n; i++) {
+			double sum = 0.0;
+			weighted_sum<Row, 0, Stages>(sum, k, i);
+			out[i] = start[i] + dt * sum;
+		} // end for
+	} // end for
+} // end build_stage
+
+template <class T, int I>
+int universe::compute_stages(double dt) {
+	static_assert(T::stages <= integrator_workspace::max_stages, "The workspace does not have enough stages for this tableau");
+	integrator_workspace& w = *workspace;
+
+	if constexpr (I == 0) {
+		int retval = compute_derivatives_cached(w.y0, w.k[0]);
+		if (retval != NO_ERROR) return retval;
+		return compute_stages<T, 1>(dt);
+	}
+	else if constexpr (I < T::stages) {
+		build_stage<tableau_a<T, I>, I>(dt);
+		int retval = compute_derivatives(w.stage, w.k[I]);
+		if (retval != NO_ERROR) return retval;
+		return compute_stages<T, I + 1>(dt);
+	}
+	else {
+		return NO_ERROR;
+	} // end if
+} // end compute_stages
+
+template <class Row, int Stages>
+int universe::commit_step(double dt) {
+	// The stage state is y0 + dt * sum(b * k) which is the new state
+	build_stage<Row, Stages>(dt);
+	const int retval = advance_test_particles(workspace->y0, workspace->stage, dt);
+	if (retval != NO_ERROR) return retval;
+	workspace->dense_valid = false;
+	workspace->stage.store(*particles);
+	return NO_ERROR;
+} // end commit_step
+
+template <class T>
+double universe::error_norm(double dt, double atol, double rtol) {
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+
+	// Every component is weighed on its own scale so errors of opposite sign cannot cancel
+	double err = 0.0;
+	std::size_t count = 0;
+	for (int c = 0; c < 6; c++) {
+		const double* k[T::stages];
+		for (int j = 0; j < T::stages; j++) k[j] = component(w.k[j], c);
+		const double* start = component(w.y0, c);
+		const double* end = component(w.stage, c);
+		for (std::size_t i = 0; i < n; i++) {
+			if (s.included(i) == false) continue;
+			double e = 0.0;
+			weighted_sum<tableau_error<T>, 0, T::stages>(e, k, i);
+			const double scale = atol + rtol * std::max(std::abs(start[i]), std::abs(end[i]));
+			err += (dt * e / scale) * (dt * e / scale);
+			count++;
+		} // end for
+	} // end for
+
+	return (count > 0) ? std::sqrt(err / count) : 0.0;
+} // end error_norm
+
+template <class T>
+int universe::step_embedded(double tol, double& dt, double& dt_next) {
+	integrator_workspace& w = *workspace;
+	w.resize(this->num_of_bodies);
+	w.y0.load(*particles);
+	const double atol = (abs_tol > 0.0) ? abs_tol : tol;
+
+	// K1 is at the start of the step so a retry keeps it, and for a first same as last
+	// tableau it is the last stage of the last step if that ended where this one starts
+	int retval = compute_derivatives_cached(w.y0, w.k[0]);
+	if (retval != NO_ERROR) return retval;
+	const double smallest = min_step();
+
+	while (true) {
+		retval = compute_stages<T, 1>(dt);
+		if (retval != NO_ERROR) return retval;
+
+		// The last stage of a first same as last tableau is already at the new state
+		if constexpr (T::fsal == false) build_stage<tableau_b<T>, T::stages>(dt);
+
+		const double err = error_norm<T>(dt, atol, tol);
+		if (err != err) return ERR_OUTSIDE_TOL;
+		if (control_step(err, T::order, dt, dt_next)) break;
+		// A step shrunk towards 0 would end up accepted without moving anything
+		if (std::abs(dt) < smallest) return ERR_DT_TO_SMALL;
+	} // end while
+	if (std::abs(dt_next) < smallest) dt_next = (dt < 0.0) ? -smallest : smallest;
+
+	// Accept the step, every body takes the b update
+	if constexpr (T::fsal) keep_force(w.stage, w.k[T::stages - 1]);
+	retval = advance_test_particles(w.y0, w.stage, dt);
+	if (retval != NO_ERROR) return retval;
+	// Only step_dopri5 keeps a dense output of the step, which it does once this returns
+	w.dense_valid = false;
+	w.stage.store(*particles);
+	return NO_ERROR;
+} // end step_embedded
+
+void universe::keep_dense_output(double dt) {
+	typedef dormand_prince_tableau T;
+	integrator_workspace& w = *workspace;
+	const std::size_t n = particles->size();
+	for (auto& d : w.dense) d.resize(n);
+
+	for (int c = 0; c < 6; c++) {
+		const double* k[T::stages];
+		for (int j = 0; j < T::stages; j++) k[j] = component(w.k[j], c);
+		const double* start = component(w.y0, c);
+		const double* end = component(w.stage, c);
+		double* r[5];
+		for (int j = 0; j < 5; j++) r[j] = component(w.dense[j], c);
+		for (std::size_t i = 0; i < n; i++) {
+			double sum = 0.0;
+			weighted_sum<tableau_dense<T>, 0, T::stages>(sum, k, i);
+			const double diff = end[i] - start[i];
+			const double first = dt * k[0][i] - diff;
+			r[0][i] = start[i];
+			r[1][i] = diff;
+			r[2][i] = first;
+			r[3][i] = diff - dt * k[T::stages - 1][i] - first;
+			r[4][i] = dt * sum;
+		} // end for
+	} // end for
+
+	w.dense_dt = dt;
+	w.dense_valid = true;
+} // end keep_dense_output
+
+int universe::modified_midpoint(int substeps, double dt, phase_arrays& out) {
+	integrator_workspace& w = *workspace;
+	const std::size_t n = particles->size();
+	const double h = dt / substeps;
+	phase_arrays& prev = w.k[2];
+	phase_arrays& cur = w.k[3];
+	phase_arrays& f = w.k[1];
+
+	// z1 = z0 + h f(z0)
+	prev = w.y0;
+	for (std::size_t i = 0; i < n; i++) {
+		cur.x[i] = w.y0.x[i] + h * w.k[0].x[i], cur.y[i] = w.y0.y[i] + h * w.k[0].y[i], cur.z[i] = w.y0.z[i] + h * w.k[0].z[i];
+		cur.vx[i] = w.y0.vx[i] + h * w.k[0].vx[i], cur.vy[i] = w.y0.vy[i] + h * w.k[0].vy[i], cur.vz[i] = w.y0.vz[i] + h * w.k[0].vz[i];
+	} // end for
+
+	// z(m + 1) = z(m - 1) + 2h f(z(m)), the new state overwrites z(m - 1)
+	for (int m = 1; m < substeps; m++) {
+		int retval = compute_derivatives(cur, f);
+		if (retval != NO_ERROR) return retval;
+		for (std::size_t i = 0; i < n; i++) {
+			prev.x[i] += 2.0 * h * f.x[i], prev.y[i] += 2.0 * h * f.y[i], prev.z[i] += 2.0 * h * f.z[i];
+			prev.vx[i] += 2.0 * h * f.vx[i], prev.vy[i] += 2.0 * h * f.vy[i], prev.vz[i] += 2.0 * h * f.vz[i];
+		} // end for
+		std::swap(prev, cur);
+	} // end for
+
+	// Smoothing, y = (z(n) + z(n - 1) + h f(z(n))) / 2
+	int retval = compute_derivatives(cur, f);
+	if (retval != NO_ERROR) return retval;
+	out.resize(n);
+	for (std::size_t i = 0; i < n; i++) {
+		out.x[i] = 0.5 * (cur.x[i] + prev.x[i] + h * f.x[i]);
+		out.y[i] = 0.5 * (cur.y[i] + prev.y[i] + h * f.y[i]);
+		out.z[i] = 0.5 * (cur.z[i] + prev.z[i] + h * f.z[i]);
+		out.vx[i] = 0.5 * (cur.vx[i] + prev.vx[i] + h * f.vx[i]);
+		out.vy[i] = 0.5 * (cur.vy[i] + prev.vy[i] + h * f.vy[i]);
+		out.vz[i] = 0.5 * (cur.vz[i] + prev.vz[i] + h * f.vz[i]);
+	} // end for
+
+	return NO_ERROR;
+} // end modified_midpoint
+
+double universe::min_step() const {
+	const integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+
+	// |v| / |a| is the time the velocity of a body takes to change by about itself, the shortest is the time scale of the system
+	double shortest = HUGE_VAL;
+	for (std::size_t i = 0; i < s.size(); i++) {
+		if (s.included(i) == false) continue;
+		const double v2 = w.y0.vx[i] * w.y0.vx[i] + w.y0.vy[i] * w.y0.vy[i] + w.y0.vz[i] * w.y0.vz[i];
+		const double a2 = w.k[0].vx[i] * w.k[0].vx[i] + w.k[0].vy[i] * w.k[0].vy[i] + w.k[0].vz[i] * w.k[0].vz[i];
+		if (v2 > 0.0 && a2 > 0.0) shortest = std::min(shortest, std::sqrt(v2 / a2));
+	} // end for
+	return (shortest < HUGE_VAL) ? min_step_fraction * shortest : 0.0;
+} // end min_step
+
+bool universe::control_step(double err, int order, double& dt, double& dt_next) {
+	integrator_workspace& w = *workspace;
+
+	if (err > 1.0) { // Reject the step
+		dt *= std::max(step_min_factor, step_safety * std::pow(err, -1.0 / order));
+		w.step_rejected = true;
+		w.rejected++;
+		return false;
+	} // end if
+
+	// Accept, the next step grows with a small error and shrinks if the error is growing
+	const double alpha = 1.0 / order - 0.75 * step_beta;
+	double factor = (err > 0.0) ? step_safety * std::pow(err, -alpha) * std::pow(w.err_old, step_beta) : step_max_factor;
+	factor = std::max(step_min_factor, std::min(step_max_factor, factor));
+	// Do not grow the step straight after a rejection
+	if (w.step_rejected) factor = std::min(factor, 1.0);
+	dt_next = dt * factor;
+
+	w.err_old = std::max(err, 1e-4);
+	w.step_rejected = false;
+	w.accepted++;
+	return true;
+} // end control_step
+
+int universe::step_rkn(const rkn_tableau& method, double tol, double& dt, double& dt_next) {
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	const double atol = (abs_tol > 0.0) ? abs_tol : tol;
+	w.resize(n);
+	w.y0.load(s);
+	w.stage = w.y0;
+
+	// The first stage is at the start of the step so a retry keeps it
+	int retval = compute_derivatives_cached(w.y0, w.k[0]);
+	if (retval != NO_ERROR) return retval;
+	const double smallest = min_step();
+
+	while (true) {
+		// Stage i at x0 + c_i h v0 + h^2 * sum of a_ij * a_j, its acceleration goes in the velocities of k[i]
+		const double h = dt, h2 = dt * dt;
+		for (int i = 1; i < method.stages; i++) {
+			const double* a = method.a + i * (i - 1) / 2;
+			for (std::size_t r = 0; r < n; r++) {
+				double x = 0.0, y = 0.0, z = 0.0;
+				for (int j = 0; j < i; j++) {
+					x += a[j] * w.k[j].vx[r], y += a[j] * w.k[j].vy[r], z += a[j] * w.k[j].vz[r];
+				} // end for
+				w.stage.x[r] = w.y0.x[r] + method.c[i] * h * w.y0.vx[r] + h2 * x;
+				w.stage.y[r] = w.y0.y[r] + method.c[i] * h * w.y0.vy[r] + h2 * y;
+				w.stage.z[r] = w.y0.z[r] + method.c[i] * h * w.y0.vz[r] + h2 * z;
+			} // end for
+			retval = compute_derivatives(w.stage, w.k[i]);
+			if (retval != NO_ERROR) return retval;
+		} // end for
+
+		// x1 = x0 + h v0 + h^2 * sum of b_bar * a and v1 = v0 + h * sum of b * a.
+		// The error norm is the root mean square of the position errors scaled by the tolerances
+		double err = 0.0;
+		std::size_t count = 0;
+		for (std::size_t r = 0; r < n; r++) {
+			double x = 0.0, y = 0.0, z = 0.0, vx = 0.0, vy = 0.0, vz = 0.0, ex = 0.0, ey = 0.0, ez = 0.0;
+			for (int i = 0; i < method.stages; i++) {
+				x += method.b_bar[i] * w.k[i].vx[r], y += method.b_bar[i] * w.k[i].vy[r], z += method.b_bar[i] * w.k[i].vz[r];
+				vx += method.b[i] * w.k[i].vx[r], vy += method.b[i] * w.k[i].vy[r], vz += method.b[i] * w.k[i].vz[r];
+				ex += method.e_bar[i] * w.k[i].vx[r], ey += method.e_bar[i] * w.k[i].vy[r], ez += method.e_bar[i] * w.k[i].vz[r];
+			} // end for
+			w.stage.x[r] = w.y0.x[r] + h * w.y0.vx[r] + h2 * x;
+			w.stage.y[r] = w.y0.y[r] + h * w.y0.vy[r] + h2 * y;
+			w.stage.z[r] = w.y0.z[r] + h * w.y0.vz[r] + h2 * z;
+			w.stage.vx[r] = w.y0.vx[r] + h * vx, w.stage.vy[r] = w.y0.vy[r] + h * vy, w.stage.vz[r] = w.y0.vz[r] + h * vz;
+			if (s.included(r) == false) continue;
+
+			const double sx = atol + tol * std::max(std::abs(w.y0.x[r]), std::abs(w.stage.x[r]));
+			const double sy = atol + tol * std::max(std::abs(w.y0.y[r]), std::abs(w.stage.y[r]));
+			const double sz = atol + tol * std::max(std::abs(w.y0.z[r]), std::abs(w.stage.z[r]));
+			err += (h2 * ex / sx) * (h2 * ex / sx) + (h2 * ey / sy) * (h2 * ey / sy) + (h2 * ez / sz) * (h2 * ez / sz);
+			count += 3;
+		} // end for
+		err = (count > 0) ? std::sqrt(err / count) : 0.0;
+		if (err != err) return ERR_OUTSIDE_TOL;
+
+		if (control_step(err, method.order, dt, dt_next)) break;
+		if (std::abs(dt) < smallest) return ERR_DT_TO_SMALL;
+	} // end while
+	if (std::abs(dt_next) < smallest) dt_next = (dt < 0.0) ? -smallest : smallest;
+
+	retval = advance_test_particles(w.y0, w.stage, dt);
+	if (retval != NO_ERROR) return retval;
+	w.dense_valid = false;
+	w.stage.store(*particles);
+	return check_collisions();
+} // end step_rkn
+
+int universe::step_drift_kick(const double* drift, const double* kick, int kicks, double dt) {
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	w.resize(n);
+	w.stage.load(s);
+
+	for (int k = 0; k <= kicks; k++) {
+		// Drift, x += drift * dt * v
+		if (drift[k] != 0.0) {
+			const double h = drift[k] * dt;
+			for (std::size_t i = 0; i < n; i++) {
+				w.stage.x[i] += h * w.stage.vx[i], w.stage.y[i] += h * w.stage.vy[i], w.stage.z[i] += h * w.stage.vz[i];
+			} // end for
+			drift_test_particles(h);
 		} // end if
-	} // end else
+		if (k == kicks) break;
+
+		// The force at the start of the step is the one at the end of the last step
+		// if nothing has moved or changed mass in between
+		int retval = (k == 0 && drift[0] == 0.0) ? compute_derivatives_cached(w.stage, w.k[0]) : compute_derivatives(w.stage, w.k[0]);
+		if (retval != NO_ERROR) return retval;
+
+		// Kick, v += kick * dt * a
+		const double h = kick[k] * dt;
+		for (std::size_t i = 0; i < n; i++) {
+			w.stage.vx[i] += h * w.k[0].vx[i], w.stage.vy[i] += h * w.k[0].vy[i], w.stage.vz[i] += h * w.k[0].vz[i];
+		} // end for
+		// The test particles are kicked by the bodies at the same positions
+		retval = kick_test_particles(w.stage, h);
+		if (retval != NO_ERROR) return retval;
+	} // end for
+
+	// Keep the last force if it was evaluated at the final positions
+	if (drift[kicks] == 0.0) keep_force(w.stage, w.k[0]);
+	else w.last_valid = false;
+
+	w.dense_valid = false;
+	w.stage.store(*particles);
+	return check_collisions();
+} // end step_drift_kick
+
+int universe::check_collisions() {
+	particle_store& s = *particles;
+	const std::size_t n = s.size();
+
+	// Find the pairs closer than their two radii, each chunk of rows in parallel
+	thread_pool& p = get_pool();
+	auto& hits = workspace->collisions;
+	hits.resize(p.num_chunks(collision_chunks_per_thread));
+	for (auto& chunk : hits) chunk.clear();
+	p.parallel_for(n, collision_chunks_per_thread, 1, min_targets_per_thread, [&](std::size_t c, std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; i++) {
+			if (s.included(i) == false) continue;
+			for (std::size_t j = i + 1; j < n; j++) {
+				if (s.included(j) == false) continue;
+				const double dx = s.x[i] - s.x[j], dy = s.y[i] - s.y[j], dz = s.z[i] - s.z[j];
+				const double r = s.radius[i] + s.radius[j];
+				if (dx * dx + dy * dy + dz * dz <= r * r) hits[c].emplace_back(i, j);
+			} // end for
+		} // end for
+	});
+
+	// If two bodies have collided, 'delete' them
+	// Done in pair order so a body only collides once, as if checked one pair at a time
+	for (const auto& chunk : hits)
+		for (const auto& pair : chunk) {
+			const std::size_t i = pair.first, j = pair.second;
+			// if both bodies include flags are still true
+			if (s.included(i) == true && s.included(j) == true) {
+				std::cerr << "\nBody: " << objects[i]->name << " and body: " << objects[j]->name << " have collided\n";
+				// Set member variables to zero
+				s.set_to_zero(i);
+				s.set_to_zero(j);
+			} // end if
+		} // end for
+	collide_test_particles(s);
+
+	// If result is NaN return error
+	for (std::size_t i = 0; i < n; i++) {
+		if (s.x[i] != s.x[i]) return ERR_X_NAN;
+		if (s.y[i] != s.y[i]) return ERR_Y_NAN;
+		if (s.z[i] != s.z[i]) return ERR_Z_NAN;
+		if (s.vx[i] != s.vx[i]) return ERR_VX_NAN;
+		if (s.vy[i] != s.vy[i]) return ERR_VY_NAN;
+		if (s.vz[i] != s.vz[i]) return ERR_VZ_NAN;
+	} // end for
 
 	return NO_ERROR;
-} // end check_step
+} // end check_collisions
+#pragma endregion
 
+#pragma region public functions
+/*****************************************************************************************************
+PUBLIC FUNCTIONS
+*****************************************************************************************************/
 int universe::step_euler(body* acting_force, double dt) {
 	// If the universe does not exist return error
 	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
@@ -35,6 +1020,10 @@ int universe::step_euler(body* acting_force, double dt) {
 
 	if (acting_force == nullptr) return ERR_BODY_NULLPTR;
 
+	// Each body only feels the acting force, there is no consistent step of the bodies to move test particles over
+	if (this->num_of_test_particles > 0) return ERR_TEST_PARTICLES;
+	workspace->dense_valid = false;
+
 	for (const auto& object : objects)
 		if (object != acting_force) {
 			int retval = object->step_euler(acting_force, dt);
@@ -55,12 +1044,17 @@ int universe::step_euler(double dt) {
 	for (auto i = 0; i < this->num_of_bodies; i++)
 		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
 
-	// For every body in the universe compute the force felt by all other bodies
-	for (const auto& object : objects) {
-		int retval = object->step_euler(this, dt);
-		if (retval != NO_ERROR) return retval;
-	} // end for
-	return NO_ERROR;
+	// Compute the derivatives of every body from the current state, then move them all
+	integrator_workspace& w = *workspace;
+	w.resize(this->num_of_bodies);
+	w.y0.load(*particles);
+
+	int retval = compute_stages<euler_tableau>(dt);
+	if (retval != NO_ERROR) return retval;
+	retval = commit_step<tableau_b<euler_tableau>, euler_tableau::stages>(dt);
+	if (retval != NO_ERROR) return retval;
+
+	return check_collisions();
 } // end step_euler
 
 int universe::step_rk4(body* acting_force, double dt) {
@@ -76,6 +1070,10 @@ int universe::step_rk4(body* acting_force, double dt) {
 
 	if (acting_force == nullptr) return ERR_BODY_NULLPTR;
 
+	// Each body only feels the acting force, there is no consistent step of the bodies to move test particles over
+	if (this->num_of_test_particles > 0) return ERR_TEST_PARTICLES;
+	workspace->dense_valid = false;
+
 	for (const auto& object : objects)
 		if (object != acting_force) {
 			int retval = object->step_rk4(acting_force, dt);
@@ -96,12 +1094,20 @@ int universe::step_rk4(double dt) {
 	for (auto i = 0; i < this->num_of_bodies; i++)
 		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
 
-	// For every body in the universe compute the force felt by all other bodies
-	for (const auto& object : objects) {
-		int retval = object->step_rk4(this, dt);
-		if (retval != NO_ERROR) return retval;
-	} // end for
-	return NO_ERROR;
+	// Calculates Runge-Kutta variables for every body, each stage from the same snapshot
+	integrator_workspace& w = *workspace;
+	w.resize(this->num_of_bodies);
+	w.y0.load(*particles);
+
+	// K1 to K4
+	int retval = compute_stages<rk4_tableau>(dt);
+	if (retval != NO_ERROR) return retval;
+
+	// Updates position and velocity of every body together
+	retval = commit_step<tableau_b<rk4_tableau>, rk4_tableau::stages>(dt);
+	if (retval != NO_ERROR) return retval;
+
+	return check_collisions();
 } // end step_rk4
 
 int universe::step_rkf4(body* acting_force, double dt) {
@@ -117,6 +1123,10 @@ int universe::step_rkf4(body* acting_force, double dt) {
 
 	if (acting_force == nullptr) return ERR_BODY_NULLPTR;
 
+	// Each body only feels the acting force, there is no consistent step of the bodies to move test particles over
+	if (this->num_of_test_particles > 0) return ERR_TEST_PARTICLES;
+	workspace->dense_valid = false;
+
 	for (const auto& object : objects)
 		if (object != acting_force) {
 			int retval = object->step_rkf4(acting_force, dt);
@@ -137,12 +1147,19 @@ int universe::step_rkf4(double dt) {
 	for (auto i = 0; i < this->num_of_bodies; i++)
 		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
 
-	// For every body in the universe compute the force felt by all other bodies
-	for (const auto& object : objects) {
-		int retval = object->step_rkf4(this, dt);
-		if (retval != NO_ERROR) return retval;
-	} // end for
-	return NO_ERROR;
+	// Compute K variables for every body
+	integrator_workspace& w = *workspace;
+	w.resize(this->num_of_bodies);
+	w.y0.load(*particles);
+
+	int retval = compute_stages<rkf45_tableau>(dt);
+	if (retval != NO_ERROR) return retval;
+
+	// Update velocity and position of every body together
+	retval = commit_step<tableau_b_hat<rkf45_tableau>, rkf45_tableau::stages>(dt);
+	if (retval != NO_ERROR) return retval;
+
+	return check_collisions();
 } // end step_rkf4	
 
 int universe::step_rkf5(body* acting_force, double dt) {
@@ -158,6 +1175,10 @@ int universe::step_rkf5(body* acting_force, double dt) {
 
 	if (acting_force == nullptr) return ERR_BODY_NULLPTR;
 
+	// Each body only feels the acting force, there is no consistent step of the bodies to move test particles over
+	if (this->num_of_test_particles > 0) return ERR_TEST_PARTICLES;
+	workspace->dense_valid = false;
+
 	for (const auto& object : objects) 
 		if (object != acting_force) {
 			int retval = object->step_rkf5(acting_force, dt);
@@ -178,12 +1199,19 @@ int universe::step_rkf5(double dt) {
 	for (auto i = 0; i < this->num_of_bodies; i++)
 		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
 
-	// For every body in the universe compute the force felt by all other bodies
-	for (const auto& object : objects) {
-		int retval = object->step_rkf5(this, dt);
-		if (retval != NO_ERROR) return retval;
-	} // end for
-	return NO_ERROR;
+	// Compute K variables for every body
+	integrator_workspace& w = *workspace;
+	w.resize(this->num_of_bodies);
+	w.y0.load(*particles);
+
+	int retval = compute_stages<rkf45_tableau>(dt);
+	if (retval != NO_ERROR) return retval;
+
+	// Update velocity and position of every body together
+	retval = commit_step<tableau_b<rkf45_tableau>, rkf45_tableau::stages>(dt);
+	if (retval != NO_ERROR) return retval;
+
+	return check_collisions();
 } // end step_rkf5	
 
 int universe::step_rkf45(body* acting_force, double tol, double& dt) {
@@ -197,6 +1225,10 @@ int universe::step_rkf45(body* acting_force, double tol, double& dt) {
 	for (auto i = 0; i < this->num_of_bodies; i++)
 		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
 
+	// Each body only feels the acting force, there is no consistent step of the bodies to move test particles over
+	if (this->num_of_test_particles > 0) return ERR_TEST_PARTICLES;
+	workspace->dense_valid = false;
+
 	std::vector<pos_vel_params> p_vec;
 	double err = 0.0;
 
@@ -222,7 +1254,7 @@ int universe::step_rkf45(body* acting_force, double tol, double& dt) {
 	return NO_ERROR;
 } // end step_rkf45
 
-int universe::step_rkf45(double tol, double& dt) {
+int universe::step_rkf45(double tol, double& dt, double& dt_next) {
 	// If the universe does not exist return error
 	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
 
@@ -233,23 +1265,911 @@ int universe::step_rkf45(double tol, double& dt) {
 	for (auto i = 0; i < this->num_of_bodies; i++)
 		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
 
-	std::vector<pos_vel_params> p_vec;
-	double err = 0.0;
+	// Compute K variables for every body, the error is the difference between the RKF4 and RKF5 updates
+	// and an accepted step takes the RKF5 update
+	int retval = step_embedded<rkf45_tableau>(tol, dt, dt_next);
+	if (retval != NO_ERROR) return retval;
 
-	// Add a pos vel params for each body
+	return check_collisions();
+} // end step_rkf45
+
+int universe::step_cash_karp(double tol, double& dt, double& dt_next) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
 	for (auto i = 0; i < this->num_of_bodies; i++)
-		p_vec.emplace_back(pos_vel_params{ 0.0 }); // Create std::vector with pos vel params for all bodies
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
 
-	int i = 0;
-	// For every body in the universe compute the force felt by all other bodies
-	for (const auto& object : objects) {
-		int retval = object->step_rkf45(this, tol, err, dt, p_vec.at(i));
+	int retval = step_embedded<cash_karp_tableau>(tol, dt, dt_next);
+	if (retval != NO_ERROR) return retval;
+
+	return check_collisions();
+} // end step_cash_karp
+
+int universe::step_dopri5(double tol, double& dt, double& dt_next) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// Every accepted step keeps its dense output
+	int retval = step_embedded<dormand_prince_tableau>(tol, dt, dt_next);
+	if (retval != NO_ERROR) return retval;
+	keep_dense_output(dt);
+
+	return check_collisions();
+} // end step_dopri5
+
+int universe::dense_output(double t, phase_arrays& out) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// There has to be a step of the same bodies to interpolate
+	const integrator_workspace& w = *workspace;
+	const std::size_t n = particles->size();
+	if (w.dense_valid == false || w.dense[0].x.size() != n) return ERR_NO_DENSE_OUTPUT;
+
+	// The time has to be inside the step, give or take rounding of the caller's clock
+	double theta = t / w.dense_dt;
+	if (theta < -1e-12 || theta > 1.0 + 1e-12) return ERR_DT_TOO_BIG;
+	theta = std::max(0.0, std::min(1.0, theta));
+
+	out.resize(n);
+	for (int c = 0; c < 6; c++) {
+		const double* r[5];
+		for (int j = 0; j < 5; j++) r[j] = component(w.dense[j], c);
+		double* state = component(out, c);
+		for (std::size_t i = 0; i < n; i++)
+			state[i] = r[0][i] + theta * (r[1][i] + (1.0 - theta) * (r[2][i] + theta * (r[3][i] + (1.0 - theta) * r[4][i])));
+	} // end for
+
+	return NO_ERROR;
+} // end dense_output
+
+int universe::step_rkn54(double tol, double& dt, double& dt_next) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	return step_rkn(rkn54, tol, dt, dt_next);
+} // end step_rkn54
+
+int universe::step_hermite(double eta, double& dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// Acceleration and jerk at the start of the step
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	w.resize(n);
+	w.y0.load(s);
+	phase_arrays& y = w.y0;
+	phase_arrays& p = w.stage;
+	phase_arrays& f0 = w.k[0];
+	phase_arrays& f1 = w.k[1];
+	int retval = compute_jerks(y, f0);
+	if (retval != NO_ERROR) return retval;
+
+	// The first step is eta * |a| / |j| for the body that needs the smallest
+	if (dt <= 0.0) {
+		dt = HUGE_VAL;
+		for (std::size_t i = 0; i < n; i++) {
+			const double a2 = f0.x[i] * f0.x[i] + f0.y[i] * f0.y[i] + f0.z[i] * f0.z[i];
+			const double j2 = f0.vx[i] * f0.vx[i] + f0.vy[i] * f0.vy[i] + f0.vz[i] * f0.vz[i];
+			if (j2 > 0.0) dt = std::min(dt, eta * std::sqrt(a2 / j2));
+		} // end for
+		if (dt == HUGE_VAL) return ERR_NO_ACTING_FORCE;
+	} // end if
+	const double h = dt, h2 = h * h;
+
+	// Predict, x + v h + a h^2 / 2 + j h^3 / 6 and v + a h + j h^2 / 2
+	for (std::size_t i = 0; i < n; i++) {
+		p.x[i] = y.x[i] + h * (y.vx[i] + h * (f0.x[i] / 2.0 + h * f0.vx[i] / 6.0));
+		p.y[i] = y.y[i] + h * (y.vy[i] + h * (f0.y[i] / 2.0 + h * f0.vy[i] / 6.0));
+		p.z[i] = y.z[i] + h * (y.vz[i] + h * (f0.z[i] / 2.0 + h * f0.vz[i] / 6.0));
+		p.vx[i] = y.vx[i] + h * (f0.x[i] + h * f0.vx[i] / 2.0);
+		p.vy[i] = y.vy[i] + h * (f0.y[i] + h * f0.vy[i] / 2.0);
+		p.vz[i] = y.vz[i] + h * (f0.z[i] + h * f0.vz[i] / 2.0);
+	} // end for
+
+	// Evaluate at the prediction
+	retval = compute_jerks(p, f1);
+	if (retval != NO_ERROR) return retval;
+
+	double next = HUGE_VAL;
+	for (std::size_t i = 0; i < n; i++) {
+		if (s.included(i) == false) continue;
+
+		// Correct, v1 = v0 + (a0 + a1) h / 2 + (j0 - j1) h^2 / 12 and x1 = x0 + (v0 + v1) h / 2 + (a0 - a1) h^2 / 12
+		const double vx = y.vx[i] + h * (f0.x[i] + f1.x[i]) / 2.0 + h2 * (f0.vx[i] - f1.vx[i]) / 12.0;
+		const double vy = y.vy[i] + h * (f0.y[i] + f1.y[i]) / 2.0 + h2 * (f0.vy[i] - f1.vy[i]) / 12.0;
+		const double vz = y.vz[i] + h * (f0.z[i] + f1.z[i]) / 2.0 + h2 * (f0.vz[i] - f1.vz[i]) / 12.0;
+		p.x[i] = y.x[i] + h * (y.vx[i] + vx) / 2.0 + h2 * (f0.x[i] - f1.x[i]) / 12.0;
+		p.y[i] = y.y[i] + h * (y.vy[i] + vy) / 2.0 + h2 * (f0.y[i] - f1.y[i]) / 12.0;
+		p.z[i] = y.z[i] + h * (y.vz[i] + vz) / 2.0 + h2 * (f0.z[i] - f1.z[i]) / 12.0;
+		p.vx[i] = vx, p.vy[i] = vy, p.vz[i] = vz;
+
+		// Snap and crackle from the Hermite interpolant, the snap moved to the end of the step
+		double a[3], j[3], snap[3], crackle[3];
+		const double da[3] = { f0.x[i] - f1.x[i], f0.y[i] - f1.y[i], f0.z[i] - f1.z[i] };
+		const double j0[3] = { f0.vx[i], f0.vy[i], f0.vz[i] }, j1[3] = { f1.vx[i], f1.vy[i], f1.vz[i] };
+		a[0] = f1.x[i], a[1] = f1.y[i], a[2] = f1.z[i];
+		for (int c = 0; c < 3; c++) {
+			j[c] = j1[c];
+			crackle[c] = (12.0 * da[c] + 6.0 * h * (j0[c] + j1[c])) / (h2 * h);
+			snap[c] = (-6.0 * da[c] - h * (4.0 * j0[c] + 2.0 * j1[c])) / h2 + h * crackle[c];
+		} // end for
+
+		// Aarseth criterion, dt = sqrt(eta * (|a| |s| + |j|^2) / (|j| |c| + |s|^2))
+		const double a_norm = std::sqrt(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+		const double j_norm = std::sqrt(j[0] * j[0] + j[1] * j[1] + j[2] * j[2]);
+		const double s_norm = std::sqrt(snap[0] * snap[0] + snap[1] * snap[1] + snap[2] * snap[2]);
+		const double c_norm = std::sqrt(crackle[0] * crackle[0] + crackle[1] * crackle[1] + crackle[2] * crackle[2]);
+		const double bottom = j_norm * c_norm + s_norm * s_norm;
+		if (bottom > 0.0) next = std::min(next, std::sqrt(eta * (a_norm * s_norm + j_norm * j_norm) / bottom));
+	} // end for
+
+	// Bodies no longer included keep their state
+	for (std::size_t i = 0; i < n; i++)
+		if (s.included(i) == false) {
+			p.x[i] = y.x[i], p.y[i] = y.y[i], p.z[i] = y.z[i];
+			p.vx[i] = y.vx[i], p.vy[i] = y.vy[i], p.vz[i] = y.vz[i];
+		} // end if
+	retval = advance_test_particles(y, p, h);
+	if (retval != NO_ERROR) return retval;
+	w.dense_valid = false;
+	p.store(*particles);
+
+	// The time step can at most double from one step to the next
+	dt = std::min(next, 2.0 * dt);
+
+	return check_collisions();
+} // end step_hermite
+
+int universe::step_block(double eta, double dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// y0 holds the state of each body at its last update, k[0] the acceleration there,
+	// stage the predicted state of every body and k[1] the targets being updated
+	integrator_workspace& w = *workspace;
+	particle_store& s = *particles;
+	const std::size_t n = s.size();
+	const int deepest = integrator_workspace::max_block_level;
+	const std::uint64_t end = std::uint64_t(1) << deepest;
+	const double unit = dt / static_cast<double>(end);
+	w.resize(n);
+	w.y0.load(s);
+	// y0 is updated body by body, so the start is kept for the test particles
+	if (tracers->size() > 0) w.k[3] = w.y0;
+
+	// Acceleration of every body at the start, kept from the last block step if it ended here
+	bool reuse = (w.block_valid && w.block_force.x.size() == n);
+	for (std::size_t i = 0; i < n; i++) {
+		w.gm[i] = s.included(i) ? grav_constant * s.mass[i] : 0.0;
+		reuse = reuse && w.block_force.x[i] == w.y0.x[i] && w.block_force.y[i] == w.y0.y[i] && w.block_force.z[i] == w.y0.z[i] && w.block_gm[i] == w.gm[i];
+	} // end for
+	int retval = NO_ERROR;
+	if (reuse) w.k[0].vx = w.block_force.vx, w.k[0].vy = w.block_force.vy, w.k[0].vz = w.block_force.vz;
+	else retval = compute_derivatives(w.y0, w.k[0]);
+	if (retval != NO_ERROR) return retval;
+	const gravity_block sources{ w.stage.x.data(), w.stage.y.data(), w.stage.z.data(), w.gm.data() };
+
+	// A body without a step yet gets eta * |a| / |da/dt| from the exact jerk
+	if (w.block_dt.size() != n) w.block_dt.assign(n, 0.0);
+	// The acceleration goes in the positions of k[2], the jerk in the velocities
+	phase_arrays& j = w.k[2];
+	std::fill(j.x.begin(), j.x.end(), 0.0), std::fill(j.y.begin(), j.y.end(), 0.0), std::fill(j.z.begin(), j.z.end(), 0.0);
+	std::fill(j.vx.begin(), j.vx.end(), 0.0), std::fill(j.vy.begin(), j.vy.end(), 0.0), std::fill(j.vz.begin(), j.vz.end(), 0.0);
+	const gravity_block start{ w.y0.x.data(), w.y0.y.data(), w.y0.z.data(), w.gm.data() };
+	const velocity_block start_v{ w.y0.vx.data(), w.y0.vy.data(), w.y0.vz.data() };
+	get_pool().parallel_for(n, 1, 1, min_targets_per_thread, [&](std::size_t, std::size_t begin, std::size_t stop) {
+		for (std::size_t i = begin; i < stop; i++) {
+			if (w.block_dt[i] > 0.0 || s.included(i) == false) continue;
+			direct_summation_jerk(start, start_v, i, i + 1, start, start_v, 0, n,
+				j.x.data(), j.y.data(), j.z.data(), j.vx.data(), j.vy.data(), j.vz.data());
+		} // end for
+	});
+	for (std::size_t i = 0; i < n; i++) {
+		if (w.block_dt[i] > 0.0 || s.included(i) == false) continue;
+		const double a = std::sqrt(w.k[0].vx[i] * w.k[0].vx[i] + w.k[0].vy[i] * w.k[0].vy[i] + w.k[0].vz[i] * w.k[0].vz[i]);
+		const double jerk = std::sqrt(j.vx[i] * j.vx[i] + j.vy[i] * j.vy[i] + j.vz[i] * j.vz[i]);
+		w.block_dt[i] = (jerk > 0.0) ? eta * a / jerk : dt;
+	} // end for
+
+	// Level of each body, the shallowest whose step is no larger than the step it wants
+	auto level_of = [&](double step) {
+		int k = 0;
+		while (k < deepest && dt / static_cast<double>(std::uint64_t(1) << k) > step) k++;
+		return k;
+	};
+	w.level.resize(n), w.tick.assign(n, 0);
+	for (std::size_t i = 0; i < n; i++) w.level[i] = s.included(i) ? level_of(w.block_dt[i]) : 0;
+	w.stage = w.y0;
+
+	std::uint64_t now = 0;
+	while (true) {
+		// The next time any body is due, every body due then is updated together
+		std::uint64_t next = end;
+		for (std::size_t i = 0; i < n; i++)
+			if (s.included(i) && w.tick[i] < end) next = std::min(next, w.tick[i] + (end >> w.level[i]));
+		if (now == end || next > end) break;
+		now = next;
+
+		// Predict every body to now from its last update, x + v t + a t^2 / 2
+		w.rows.clear();
+		for (std::size_t i = 0; i < n; i++) {
+			if (s.included(i) == false) continue;
+			const double t = static_cast<double>(now - w.tick[i]) * unit;
+			const phase_arrays& y = w.y0;
+			const phase_arrays& a = w.k[0];
+			w.stage.x[i] = y.x[i] + t * (y.vx[i] + 0.5 * t * a.vx[i]);
+			w.stage.y[i] = y.y[i] + t * (y.vy[i] + 0.5 * t * a.vy[i]);
+			w.stage.z[i] = y.z[i] + t * (y.vz[i] + 0.5 * t * a.vz[i]);
+			w.stage.vx[i] = y.vx[i] + t * a.vx[i], w.stage.vy[i] = y.vy[i] + t * a.vy[i], w.stage.vz[i] = y.vz[i] + t * a.vz[i];
+			if (w.tick[i] + (end >> w.level[i]) == now) w.rows.push_back(i);
+		} // end for
+
+		// Acceleration of the bodies due now from every predicted body
+		const std::size_t m = w.rows.size();
+		phase_arrays& t = w.k[1];
+		for (std::size_t r = 0; r < m; r++) {
+			const std::size_t i = w.rows[r];
+			t.x[r] = w.stage.x[i], t.y[r] = w.stage.y[i], t.z[r] = w.stage.z[i];
+			t.vx[r] = 0.0, t.vy[r] = 0.0, t.vz[r] = 0.0;
+		} // end for
+		const gravity_block targets{ t.x.data(), t.y.data(), t.z.data(), nullptr }; // Targets only need their positions
+		compute_accelerations(targets, m, sources, n, t.vx.data(), t.vy.data(), t.vz.data());
+
+		// Correct them, v1 = v0 + (a0 + a1) h / 2 and x1 = x0 + (v0 + v1) h / 2 + (a0 - a1) h^2 / 12
+		for (std::size_t r = 0; r < m; r++) {
+			const std::size_t i = w.rows[r];
+			// if the acceleration applied on a body is NaN return an error
+			if (t.vx[r] != t.vx[r]) return ERR_AX_NAN;
+			if (t.vy[r] != t.vy[r]) return ERR_AY_NAN;
+			if (t.vz[r] != t.vz[r]) return ERR_AZ_NAN;
+
+			phase_arrays& y = w.y0;
+			phase_arrays& a = w.k[0];
+			const double h = static_cast<double>(end >> w.level[i]) * unit;
+			const double vx = y.vx[i] + 0.5 * h * (a.vx[i] + t.vx[r]);
+			const double vy = y.vy[i] + 0.5 * h * (a.vy[i] + t.vy[r]);
+			const double vz = y.vz[i] + 0.5 * h * (a.vz[i] + t.vz[r]);
+			y.x[i] += 0.5 * h * (y.vx[i] + vx) + h * h / 12.0 * (a.vx[i] - t.vx[r]);
+			y.y[i] += 0.5 * h * (y.vy[i] + vy) + h * h / 12.0 * (a.vy[i] - t.vy[r]);
+			y.z[i] += 0.5 * h * (y.vz[i] + vz) + h * h / 12.0 * (a.vz[i] - t.vz[r]);
+			y.vx[i] = vx, y.vy[i] = vy, y.vz[i] = vz;
+
+			// The new step from the change in acceleration over this one
+			const double jx = t.vx[r] - a.vx[i], jy = t.vy[r] - a.vy[i], jz = t.vz[r] - a.vz[i];
+			const double da = std::sqrt(jx * jx + jy * jy + jz * jz);
+			a.vx[i] = t.vx[r], a.vy[i] = t.vy[r], a.vz[i] = t.vz[r];
+			w.block_dt[i] = (da > 0.0) ? eta * h * std::sqrt(a.vx[i] * a.vx[i] + a.vy[i] * a.vy[i] + a.vz[i] * a.vz[i]) / da : dt;
+			w.tick[i] = now;
+
+			// A body can drop to a smaller step at any time but only moves up a level
+			// when its time lines up with the larger step
+			const int k = level_of(w.block_dt[i]);
+			if (k > w.level[i]) w.level[i] = k;
+			else if (k < w.level[i] && w.level[i] > 0 && now % (end >> (w.level[i] - 1)) == 0) w.level[i]--;
+		} // end for
+	} // end while
+
+	// Every body is at the end now with the acceleration of its last correction, only the next block step starts from it
+	w.last_valid = false;
+	w.block_force.x = w.y0.x, w.block_force.y = w.y0.y, w.block_force.z = w.y0.z;
+	w.block_force.vx = w.k[0].vx, w.block_force.vy = w.k[0].vy, w.block_force.vz = w.k[0].vz;
+	w.block_gm = w.gm;
+	w.block_valid = true;
+	retval = advance_test_particles(w.k[3], w.y0, dt);
+	if (retval != NO_ERROR) return retval;
+	w.dense_valid = false;
+	w.y0.store(s);
+	return check_collisions();
+} // end step_block
+int universe::step_ias15(double tol, double& dt, double& dt_next) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	const int terms = integrator_workspace::radau_terms;
+	w.resize(n);
+	w.y0.load(s);
+	phase_arrays& y = w.y0;
+	phase_arrays& p = w.stage;
+	phase_arrays& a0 = w.k[0];
+	phase_arrays& a = w.k[1];
+
+	// Start from the expansion of the last step if it was for the same bodies, otherwise from nothing
+	aligned_vector<double>* b = w.radau_b;
+	aligned_vector<double>* g = w.radau_g;
+	aligned_vector<double>* e = w.radau_e;
+	if (w.radau_valid == false || b[0].size() != 3 * n) {
+		for (int k = 0; k < terms; k++) {
+			b[k].assign(3 * n, 0.0), g[k].assign(3 * n, 0.0), e[k].assign(3 * n, 0.0);
+		} // end for
+	} // end if
+
+	// Acceleration at the start of the step, x, y and z rows one after another like the expansion
+	int retval = compute_derivatives(y, a0);
+	if (retval != NO_ERROR) return retval;
+	const double smallest = min_step();
+	const double* pos0[3] = { y.x.data(), y.y.data(), y.z.data() };
+	const double* vel0[3] = { y.vx.data(), y.vy.data(), y.vz.data() };
+	const double* acc0[3] = { a0.vx.data(), a0.vy.data(), a0.vz.data() };
+	const double* acc[3] = { a.vx.data(), a.vy.data(), a.vz.data() };
+	double* pos[3] = { p.x.data(), p.y.data(), p.z.data() };
+
+	while (true) {
+		// g from b, b_k = g_k + sum over j > k of c[j][k] g_j
+		for (std::size_t r = 0; r < 3 * n; r++)
+			for (int k = terms - 1; k >= 0; k--) {
+				double sum = b[k][r];
+				for (int j = k + 1; j < terms; j++) sum -= radau.c[j][k] * g[j][r];
+				g[k][r] = sum;
+			} // end for
+
+		// Predictor-corrector iteration until the last term stops changing
+		double last_change = HUGE_VAL;
+		for (int iteration = 0; iteration < radau_max_iterations; iteration++) {
+			double change = 0.0, scale = 0.0;
+			for (int m = 1; m <= terms; m++) {
+				// Positions at node m, x0 + v0 h t + (h t)^2 (a0 / 2 + sum of b_k t^(k + 1) / ((k + 2)(k + 3)))
+				const double t = radau_h[m], ht = dt * t;
+				for (int c = 0; c < 3; c++)
+					for (std::size_t i = 0; i < n; i++) {
+						const std::size_t r = c * n + i;
+						double sum = 0.0, tk = t;
+						for (int k = 0; k < terms; k++, tk *= t) sum += b[k][r] * tk / ((k + 2) * (k + 3));
+						pos[c][i] = pos0[c][i] + ht * vel0[c][i] + ht * ht * (acc0[c][i] / 2.0 + sum);
+					} // end for
+				retval = compute_derivatives(p, a);
+				if (retval != NO_ERROR) return retval;
+
+				// New divided difference for the node, then move its change onto b
+				for (int c = 0; c < 3; c++)
+					for (std::size_t i = 0; i < n; i++) {
+						const std::size_t r = c * n + i;
+						double gk = (acc[c][i] - acc0[c][i]) / t;
+						for (int j = 1; j < m; j++) gk = (gk - g[j - 1][r]) / (t - radau_h[j]);
+						const double diff = gk - g[m - 1][r];
+						g[m - 1][r] = gk;
+						for (int k = 0; k < m; k++) b[k][r] += radau.c[m - 1][k] * diff;
+						if (m == terms) {
+							change = std::max(change, std::abs(diff));
+							scale = std::max(scale, std::abs(acc[c][i]));
+						} // end if
+					} // end for
+			} // end for
+
+			// Converged once the change is at round off or stops getting smaller
+			const double rel = (scale > 0.0) ? change / scale : 0.0;
+			if (iteration + 1 >= radau_min_iterations && (rel < 1e-16 || rel >= last_change)) break;
+			last_change = rel;
+		} // end for
+
+		// Next time step from the size of the last term, dt * (tol / (|b6| / |a|))^(1/7)
+		double b_max = 0.0, a_max = 0.0;
+		for (int c = 0; c < 3; c++)
+			for (std::size_t i = 0; i < n; i++) {
+				b_max = std::max(b_max, std::abs(b[terms - 1][c * n + i]));
+				a_max = std::max(a_max, std::abs(acc[c][i]));
+			} // end for
+		dt_next = (b_max > 0.0 && a_max > 0.0) ? dt * std::pow(tol * a_max / b_max, 1.0 / 7.0) : dt / radau_safety;
+		if (dt_next != dt_next) return ERR_OUTSIDE_TOL;
+		if (std::abs(dt_next) >= radau_safety * std::abs(dt)) break;
+
+		// Reject the step and try again, b shrunk onto the smaller step as a starting guess
+		const double q = dt_next / dt;
+		for (int k = 0; k < terms; k++) {
+			const double qk = std::pow(q, k + 1);
+			for (std::size_t r = 0; r < 3 * n; r++) b[k][r] *= qk;
+		} // end for
+		dt = dt_next;
+		w.rejected++;
+		if (std::abs(dt) < smallest) return ERR_DT_TO_SMALL;
+	} // end while
+	w.accepted++;
+	dt_next = std::min(std::abs(dt_next), std::abs(dt) / radau_safety) * (dt < 0.0 ? -1.0 : 1.0);
+	if (std::abs(dt_next) < smallest) dt_next = (dt < 0.0) ? -smallest : smallest;
+
+	// Accept the step, x1 = x0 + v0 h + h^2 (a0 / 2 + sum of b_k / ((k + 2)(k + 3))) and v1 = v0 + h (a0 + sum of b_k / (k + 2))
+	double* vel[3] = { p.vx.data(), p.vy.data(), p.vz.data() };
+	for (int c = 0; c < 3; c++)
+		for (std::size_t i = 0; i < n; i++) {
+			const std::size_t r = c * n + i;
+			double sx = 0.0, sv = 0.0;
+			for (int k = 0; k < terms; k++) {
+				sx += b[k][r] / ((k + 2) * (k + 3));
+				sv += b[k][r] / (k + 2);
+			} // end for
+			pos[c][i] = pos0[c][i] + dt * vel0[c][i] + dt * dt * (acc0[c][i] / 2.0 + sx);
+			vel[c][i] = vel0[c][i] + dt * (acc0[c][i] + sv);
+		} // end for
+
+	// Predict b for the next step by moving the polynomial to start at the end of this one,
+	// plus the correction this step needed over its own prediction
+	const double q = dt_next / dt;
+	for (std::size_t r = 0; r < 3 * n; r++) {
+		double bk[terms];
+		for (int k = 0; k < terms; k++) bk[k] = b[k][r];
+		double qk = 1.0;
+		for (int k = 0; k < terms; k++) {
+			// Coefficient of t^(k + 1) in sum of b_m (1 + q t)^(m + 1), binomial(m + 1, k + 1)
+			qk *= q;
+			double sum = 0.0, binomial = 1.0;
+			for (int m = k; m < terms; m++) {
+				sum += binomial * bk[m];
+				binomial = binomial * (m + 2) / (m + 1 - k);
+			} // end for
+			const double predicted = qk * sum;
+			const double correction = w.radau_valid ? bk[k] - e[k][r] : 0.0;
+			e[k][r] = predicted;
+			b[k][r] = predicted + correction;
+		} // end for
+	} // end for
+	w.radau_valid = true;
+
+	retval = advance_test_particles(y, p, dt);
+	if (retval != NO_ERROR) return retval;
+	w.dense_valid = false;
+	p.store(*particles);
+	return check_collisions();
+} // end step_ias15
+
+int universe::step_bulirsch_stoer(double tol, double& dt, double& dt_next) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	w.resize(n);
+	w.table.resize(bs_columns);
+	for (auto& row : w.table) row.resize(n);
+	w.y0.load(s);
+	int retval = compute_derivatives(w.y0, w.k[0]);
+	if (retval != NO_ERROR) return retval;
+	const double atol = (abs_tol > 0.0) ? abs_tol : tol;
+	const double smallest = min_step();
+
+	// The first target column comes from the tolerance, tighter tolerances need higher orders
+	if (w.bs_column == 0)
+		w.bs_column = std::max(2, std::min(bs_columns - 2, static_cast<int>(-std::log10(std::max(tol, 1e-30)) * 0.6 + 1.5)));
+
+	// Work of each column, force evaluations up to and including it
+	double work[bs_columns];
+	work[0] = 1.0 + bs_substeps[0];
+	for (int k = 1; k < bs_columns; k++) work[k] = work[k - 1] + bs_substeps[k];
+
+	while (true) {
+		double h_opt[bs_columns] = {};
+		int converged = -1, last = 0;
+		const int limit = std::min(w.bs_column + 1, bs_columns - 1);
+
+		for (int k = 0; k <= limit; k++) {
+			last = k;
+			retval = modified_midpoint(bs_substeps[k], dt, w.stage);
+			if (retval != NO_ERROR) return retval;
+
+			// Extrapolate the new row to zero step size, T[k][j] = T[k][j-1] + (T[k][j-1] - T[k-1][j-1]) / ((n_k / n_(k-j))^2 - 1)
+			// table[j] holds T[k-1][j] and is replaced by T[k][j] as the row is built
+			double err = 0.0;
+			std::size_t count = 0;
+			for (int c = 0; c < 6; c++) {
+				const double* start = component(w.y0, c);
+				const double* fresh = component(w.stage, c);
+				for (std::size_t i = 0; i < n; i++) {
+					double t = fresh[i], before = t;
+					for (int j = 1; j <= k; j++) {
+						double& slot = component(w.table[j - 1], c)[i];
+						const double old = slot;
+						const double ratio = static_cast<double>(bs_substeps[k]) / bs_substeps[k - j];
+						slot = t;
+						before = t;
+						t += (t - old) / (ratio * ratio - 1.0);
+					} // end for
+					component(w.table[k], c)[i] = t;
+					if (k == 0 || s.included(i) == false) continue;
+					const double scale = atol + tol * std::max(std::abs(start[i]), std::abs(t));
+					err += ((t - before) / scale) * ((t - before) / scale);
+					count++;
+				} // end for
+			} // end for
+			if (k == 0) continue;
+			err = (count > 0) ? std::sqrt(err / count) : 0.0;
+			if (err != err) return ERR_OUTSIDE_TOL;
+
+			// Time step that would just converge in this column
+			const double factor = (err > 0.0) ? bs_safety * std::pow(bs_target / err, 1.0 / (2 * k + 1)) : bs_max_factor;
+			h_opt[k] = dt * std::max(bs_min_factor, std::min(bs_max_factor, factor));
+			if (err <= 1.0) {
+				converged = k;
+				break;
+			} // end if
+		} // end for
+
+		if (converged < 0) {
+			// Not converged by one past the target column, retry with the step the last column asked for
+			dt = h_opt[last];
+			w.rejected++;
+			if (std::abs(dt) < smallest) return ERR_DT_TO_SMALL;
+			continue;
+		} // end if
+
+		// Accept, then pick the column with the least work per unit time for the next step
+		// and go one column higher if the step converged in the highest column it tried
+		int best = converged;
+		for (int k = std::max(1, converged - 1); k <= converged; k++)
+			if (work[k] / std::abs(h_opt[k]) < work[best] / std::abs(h_opt[best])) best = k;
+		dt_next = h_opt[best];
+		if (best == converged && converged == limit && converged < bs_columns - 2) {
+			dt_next = h_opt[best] * work[best + 1] / work[best];
+			best++;
+		} // end if
+		w.bs_column = std::max(1, best);
+		w.accepted++;
+		if (std::abs(dt_next) < smallest) dt_next = (dt < 0.0) ? -smallest : smallest;
+
+		// The last row holds the most extrapolated state
+		retval = advance_test_particles(w.y0, w.table[converged], dt);
 		if (retval != NO_ERROR) return retval;
-		i++;
+		w.dense_valid = false;
+		w.table[converged].store(*particles);
+		break;
+	} // end while
+
+	return check_collisions();
+} // end step_bulirsch_stoer
+
+int universe::step_leapfrog(double dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// Half drift, kick, half drift
+	return step_drift_kick(leapfrog_drift, leapfrog_kick, 1, dt);
+} // end step_leapfrog
+
+int universe::step_verlet(double dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// Half kick, drift, half kick
+	return step_drift_kick(verlet_drift, verlet_kick, 2, dt);
+} // end step_verlet
+
+int universe::step_yoshida4(double dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// Three leapfrog steps of w1 * dt, w0 * dt and w1 * dt with the touching half drifts merged
+	return step_drift_kick(yoshida_drift, yoshida_kick, 3, dt);
+} // end step_yoshida4
+
+int universe::step_hierarchical(double dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	integrator_workspace& w = *workspace;
+	const particle_store& s = *particles;
+	const std::size_t n = s.size();
+	w.resize(n);
+	w.stage.load(s);
+	w.subsystem_of.assign(n, -1);
+	for (std::size_t k = 0; k < subsystems.size(); k++)
+		for (const auto& i : subsystems[k].members) w.subsystem_of[i] = static_cast<int>(k);
+
+	for (int half = 0; half < 2; half++) {
+		// Half kick from the bodies outside each body's own subsystem
+		int retval = compute_external_derivatives(w.stage, w.k[0]);
+		if (retval != NO_ERROR) return retval;
+		const double h = 0.5 * dt;
+		for (std::size_t i = 0; i < n; i++) {
+			w.stage.vx[i] += h * w.k[0].vx[i], w.stage.vy[i] += h * w.k[0].vy[i], w.stage.vz[i] += h * w.k[0].vz[i];
+		} // end for
+		if (half == 1) break;
+
+		// Drift, the bodies in no subsystem move in a straight line and each subsystem around its centre of mass
+		for (std::size_t i = 0; i < n; i++) {
+			if (w.subsystem_of[i] >= 0) continue;
+			w.stage.x[i] += dt * w.stage.vx[i], w.stage.y[i] += dt * w.stage.vy[i], w.stage.z[i] += dt * w.stage.vz[i];
+		} // end for
+		for (const auto& sys : subsystems) {
+			retval = drift_subsystem(sys, dt);
+			if (retval != NO_ERROR) return retval;
+		} // end for
 	} // end for
 
-	// Check if we want to compute the step
-	this->check_step(err, tol, dt, p_vec);
+	// The particle store still holds the start of the step
+	int retval = advance_test_particles(*particles, w.stage, dt);
+	if (retval != NO_ERROR) return retval;
+	w.dense_valid = false;
+	w.stage.store(*particles);
+	return check_collisions();
+} // end step_hierarchical
+
+int universe::step_kepler(body* central, double dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// If the central body is a nullptr, not in this universe or no longer included return error
+	if (central == nullptr) return ERR_NO_ACTING_FORCE;
+	std::size_t c = 0;
+	while (c < objects.size() && objects[c] != central) c++;
+	particle_store& s = *particles;
+	if (c == objects.size() || s.included(c) == false) return ERR_NO_ACTING_FORCE;
+
+	// Every other included body drifts on its own orbit, relative to the fixed central body
+	integrator_workspace& w = *workspace;
+	w.dense_valid = false;
+	const std::size_t n = s.size();
+	const double gm = grav_constant * s.mass[c];
+	const double cx = s.x[c], cy = s.y[c], cz = s.z[c];
+	thread_pool& p = get_pool();
+	w.status.assign(p.num_chunks(1), NO_ERROR);
+	p.parallel_for(n, 1, 1, min_targets_per_thread, [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end && w.status[chunk] == NO_ERROR; i++) {
+			if (i == c || s.included(i) == false) continue;
+			double x = s.x[i] - cx, y = s.y[i] - cy, z = s.z[i] - cz;
+			w.status[chunk] = kepler_drift(gm, dt, x, y, z, s.vx[i], s.vy[i], s.vz[i]);
+			s.x[i] = cx + x, s.y[i] = cy + y, s.z[i] = cz + z;
+		} // end for
+	});
+	for (int status : w.status)
+		if (status != NO_ERROR) return status;
+
+	// and so does every test particle
+	particle_store& t = *tracers;
+	p.parallel_for(t.size(), 1, 1, min_targets_per_thread, [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end && w.status[chunk] == NO_ERROR; i++) {
+			if (t.included(i) == false) continue;
+			double x = t.x[i] - cx, y = t.y[i] - cy, z = t.z[i] - cz;
+			w.status[chunk] = kepler_drift(gm, dt, x, y, z, t.vx[i], t.vy[i], t.vz[i]);
+			t.x[i] = cx + x, t.y[i] = cy + y, t.z[i] = cz + z;
+		} // end for
+	});
+	for (int status : w.status)
+		if (status != NO_ERROR) return status;
+
+	return check_collisions();
+} // end step_kepler
+
+int universe::step_wisdom_holman(body* central, double dt) {
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// If a body in the universe is a nullptr return error
+	for (auto i = 0; i < this->num_of_bodies; i++)
+		if (this->body_at(i) == nullptr) return ERR_BODY_NULLPTR;
+
+	// If the central body is a nullptr, not in this universe or no longer included return error
+	if (central == nullptr) return ERR_NO_ACTING_FORCE;
+	std::size_t c = 0;
+	while (c < objects.size() && objects[c] != central) c++;
+	particle_store& s = *particles;
+	if (c == objects.size() || s.included(c) == false) return ERR_NO_ACTING_FORCE;
+
+	// Centre of mass of every included body, it moves in a straight line
+	const std::size_t n = s.size();
+	double mass = 0.0, cx = 0.0, cy = 0.0, cz = 0.0, cvx = 0.0, cvy = 0.0, cvz = 0.0;
+	for (std::size_t i = 0; i < n; i++) {
+		if (s.included(i) == false) continue;
+		mass += s.mass[i];
+		cx += s.mass[i] * s.x[i], cy += s.mass[i] * s.y[i], cz += s.mass[i] * s.z[i];
+		cvx += s.mass[i] * s.vx[i], cvy += s.mass[i] * s.vy[i], cvz += s.mass[i] * s.vz[i];
+	} // end for
+	cx /= mass, cy /= mass, cz /= mass, cvx /= mass, cvy /= mass, cvz /= mass;
+
+	// Democratic heliocentric coordinates of the other included bodies,
+	// positions relative to the central body and velocities relative to the centre of mass
+	integrator_workspace& w = *workspace;
+	w.rows.clear();
+	for (std::size_t i = 0; i < n; i++)
+		if (i != c && s.included(i)) w.rows.push_back(i);
+	const std::size_t m = w.rows.size();
+	phase_arrays& q = w.stage;
+	phase_arrays& a = w.k[0];
+	q.resize(m), a.resize(m), w.gm.resize(m);
+	for (std::size_t r = 0; r < m; r++) {
+		const std::size_t i = w.rows[r];
+		q.x[r] = s.x[i] - s.x[c], q.y[r] = s.y[i] - s.y[c], q.z[r] = s.z[i] - s.z[c];
+		q.vx[r] = s.vx[i] - cvx, q.vy[r] = s.vy[i] - cvy, q.vz[r] = s.vz[i] - cvz;
+		w.gm[r] = grav_constant * s.mass[i];
+	} // end for
+	const double gm0 = grav_constant * s.mass[c];
+	const gravity_block planets{ q.x.data(), q.y.data(), q.z.data(), w.gm.data() };
+
+	// Kick from the pull of the bodies on each other, not the central body
+	auto kick = [&](double h) -> int {
+		std::fill(a.vx.begin(), a.vx.end(), 0.0);
+		std::fill(a.vy.begin(), a.vy.end(), 0.0);
+		std::fill(a.vz.begin(), a.vz.end(), 0.0);
+		compute_accelerations(planets, m, a.vx.data(), a.vy.data(), a.vz.data());
+		for (std::size_t r = 0; r < m; r++) {
+			if (a.vx[r] != a.vx[r]) return ERR_AX_NAN;
+			if (a.vy[r] != a.vy[r]) return ERR_AY_NAN;
+			if (a.vz[r] != a.vz[r]) return ERR_AZ_NAN;
+			q.vx[r] += h * a.vx[r], q.vy[r] += h * a.vy[r], q.vz[r] += h * a.vz[r];
+		} // end for
+		return NO_ERROR;
+	};
+
+	// Jump, the central body moves with minus the momentum of the others
+	auto jump = [&](double h) {
+		double px = 0.0, py = 0.0, pz = 0.0;
+		for (std::size_t r = 0; r < m; r++) px += w.gm[r] * q.vx[r], py += w.gm[r] * q.vy[r], pz += w.gm[r] * q.vz[r];
+		px *= h / gm0, py *= h / gm0, pz *= h / gm0;
+		for (std::size_t r = 0; r < m; r++) q.x[r] += px, q.y[r] += py, q.z[r] += pz;
+	};
+
+	// Kick, jump, Kepler drift, jump, kick
+	int retval = kick(dt / 2);
+	if (retval != NO_ERROR) return retval;
+	jump(dt / 2);
+
+	thread_pool& p = get_pool();
+	w.status.assign(p.num_chunks(1), NO_ERROR);
+	p.parallel_for(m, 1, 1, min_targets_per_thread, [&](std::size_t chunk, std::size_t begin, std::size_t end) {
+		for (std::size_t r = begin; r < end && w.status[chunk] == NO_ERROR; r++)
+			w.status[chunk] = kepler_drift(gm0, dt, q.x[r], q.y[r], q.z[r], q.vx[r], q.vy[r], q.vz[r]);
+	});
+	for (int status : w.status)
+		if (status != NO_ERROR) return status;
+	cx += dt * cvx, cy += dt * cvy, cz += dt * cvz;
+
+	jump(dt / 2);
+	retval = kick(dt / 2);
+	if (retval != NO_ERROR) return retval;
+
+	// The test particles need the bodies at the start of the step
+	if (tracers->size() > 0) w.y0.load(s);
+	w.dense_valid = false;
+
+	// Back to positions and velocities, the central body sits so the centre of mass is unchanged
+	double mx = 0.0, my = 0.0, mz = 0.0, mvx = 0.0, mvy = 0.0, mvz = 0.0;
+	for (std::size_t r = 0; r < m; r++) {
+		const double mr = s.mass[w.rows[r]];
+		mx += mr * q.x[r], my += mr * q.y[r], mz += mr * q.z[r];
+		mvx += mr * q.vx[r], mvy += mr * q.vy[r], mvz += mr * q.vz[r];
+	} // end for
+	s.x[c] = cx - mx / mass, s.y[c] = cy - my / mass, s.z[c] = cz - mz / mass;
+	s.vx[c] = cvx - mvx / s.mass[c], s.vy[c] = cvy - mvy / s.mass[c], s.vz[c] = cvz - mvz / s.mass[c];
+	for (std::size_t r = 0; r < m; r++) {
+		const std::size_t i = w.rows[r];
+		s.x[i] = s.x[c] + q.x[r], s.y[i] = s.y[c] + q.y[r], s.z[i] = s.z[c] + q.z[r];
+		s.vx[i] = cvx + q.vx[r], s.vy[i] = cvy + q.vy[r], s.vz[i] = cvz + q.vz[r];
+	} // end for
+
+	// The test particles follow their heliocentric orbits with the same kicks as the bodies,
+	// the bodies go back to the start of the step if they cannot
+	retval = advance_test_particles(w.y0, s, dt, static_cast<int>(c));
+	if (retval != NO_ERROR) {
+		w.y0.store(s);
+		return retval;
+	} // end if
+	return check_collisions();
+} // end step_wisdom_holman
+
+int universe::measure_force_error(std::size_t samples, double& max_error, double& rms_error) {
+	max_error = 0.0, rms_error = 0.0;
+
+	// If the universe does not exist return error
+	if (this == nullptr) return ERR_UNIVERSE_NULLPTR;
+
+	// If there are no bodies in the universe return an error
+	if (this->num_of_bodies == 0) return ERR_NO_BODY_IN_UNIVERSE;
+
+	// Accelerations from the current force solver
+	integrator_workspace& w = *workspace;
+	const std::size_t n = particles->size();
+	w.resize(n);
+	w.y0.load(*particles);
+	int retval = compute_derivatives(w.y0, w.k[0]);
+	if (retval != NO_ERROR) return retval;
+
+	// Compare against direct summation for an even spread of bodies
+	const gravity_block bodies{ w.y0.x.data(), w.y0.y.data(), w.y0.z.data(), w.gm.data() };
+	const std::size_t stride = (samples == 0 || samples >= n) ? 1 : n / samples;
+	std::size_t count = 0;
+	for (std::size_t i = 0; i < n; i += stride) {
+		if (particles->included(i) == false) continue;
+		const gravity_block target{ &w.y0.x[i], &w.y0.y[i], &w.y0.z[i], &w.gm[i] };
+		double ax = 0.0, ay = 0.0, az = 0.0;
+		direct_summation(target, 0, 1, bodies, 0, n, &ax, &ay, &az);
+		const double dx = w.k[0].vx[i] - ax, dy = w.k[0].vy[i] - ay, dz = w.k[0].vz[i] - az;
+		const double size = ax * ax + ay * ay + az * az;
+		if (size == 0.0) continue;
+		const double err = std::sqrt((dx * dx + dy * dy + dz * dz) / size);
+		max_error = std::max(max_error, err);
+		rms_error += err * err;
+		count++;
+	} // end for
+	if (count > 0) rms_error = std::sqrt(rms_error / count);
 
 	return NO_ERROR;
-} // end step_rkf45
+} // end measure_force_error
+#pragma endregion
@@ -6,6 +6,11 @@
 
 #include "body.h"
 #include "error.h"
+#include "fmm.h"
+#include "gravity.h"
+#include "integrator.h"
+#include "octree.h"
+#include "thread_pool.h"
 
 // Forward decleration
 class body;
@@ -20,20 +25,270 @@ private:
 	Member variables
 	*********************************************************/
 	std::vector<body*> objects; // List of objects in the universe
+	std::shared_ptr<particle_store> particles; // SoA state of the objects, index i belongs to objects[i]
+	std::shared_ptr<particle_store> tracers; // SoA state of the test particles, they feel the bodies but pull on nothing
+
+	std::shared_ptr<integrator_workspace> workspace; // Scratch arrays for the whole-system integrators
+	std::shared_ptr<thread_pool> pool; // Worker threads for the force loops, created on first use
+	unsigned threads; // Number of threads to use, 0 uses one per core
+	FORCE_SOLVER solver; // How the force on every body is computed
+	double theta; // Opening angle of the Barnes-Hut and FMM trees
+	int expansion; // Expansion order of the FMM
+	double abs_tol; // Absolute tolerance of the adaptive steps, 0 or less uses the tolerance passed to the step
+	std::shared_ptr<octree> tree; // Barnes-Hut tree, rebuilt every time the forces are computed
+	std::shared_ptr<fmm> multipoles; // FMM tree, rebuilt every time the forces are computed
+	std::vector<subsystem> subsystems; // Bound groups of bodies integrated in their own frame by step_hierarchical
 
 	/*********************************************************
-	Private Functions
+	Private Functions - defined in universe.cpp!!
 	*********************************************************/	
 	/// <summary>
-	/// Checks to see if the step will be accepted and updated parameters
+	/// Adds the acceleration of every body due to every other onto ax, ay and az using the current force solver,
+	/// split over the thread pool
+	/// </summary>
+	/// <param name="bodies">The bodies, each is both a target and a source</param>
+	/// <param name="n">The number of bodies</param>
+	/// <param name="ax">Acceleration in the x direction</param>
+	/// <param name="ay">Acceleration in the y direction</param>
+	/// <param name="az">Acceleration in the z direction</param>
+	void compute_accelerations(const gravity_block& bodies, std::size_t n, double* ax, double* ay, double* az);
+
+	/// <summary>
+	/// Adds the acceleration of targets [0, m) due to sources [0, n) onto ax, ay and az, split over the thread pool.
+	/// Used when only some bodies need their force, the trees walk a Barnes-Hut tree of the sources
+	/// since the FMM only computes the force on every body at once
+	/// </summary>
+	/// <param name="targets">The bodies feeling the force</param>
+	/// <param name="m">The number of targets</param>
+	/// <param name="sources">The bodies exerting the force</param>
+	/// <param name="n">The number of sources</param>
+	/// <param name="ax">Acceleration in the x direction, indexed like the targets</param>
+	/// <param name="ay">Acceleration in the y direction, indexed like the targets</param>
+	/// <param name="az">Acceleration in the z direction, indexed like the targets</param>
+	void compute_accelerations(const gravity_block& targets, std::size_t m, const gravity_block& sources, std::size_t n,
+		double* ax, double* ay, double* az);
+
+	/// <summary>
+	/// Computes the derivative of the state of every body from one snapshot of the universe.
+	/// The position derivative is the velocity and the velocity derivative is the acceleration
+	/// due to every other included body. Bodies no longer included have a derivative of 0
+	/// </summary>
+	/// <param name="state">The positions and velocities to evaluate at</param>
+	/// <param name="deriv">The derivatives, passed by reference</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int compute_derivatives(const phase_arrays& state, phase_arrays& deriv);
+
+	/// <summary>
+	/// Same as compute_derivatives, but takes the accelerations from the kept force evaluation
+	/// if it was made at the same positions and masses. The acceleration does not depend on the velocity
+	/// </summary>
+	/// <param name="state">The positions and velocities to evaluate at</param>
+	/// <param name="deriv">The derivatives, passed by reference</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int compute_derivatives_cached(const phase_arrays& state, phase_arrays& deriv);
+
+	/// <summary>
+	/// Same as compute_derivatives but without the pull of the members of a subsystem on each other,
+	/// so each body only feels the bodies outside its own subsystem
 	/// </summary>
-	/// <param name="universe">The universe object</param>
-	/// <param name="err">The error from the calculation</param>
-	/// <param name="tol">The acceptable tolerance on the error</param>
+	/// <param name="state">The positions and velocities to evaluate at</param>
+	/// <param name="deriv">The derivatives, passed by reference</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int compute_external_derivatives(const phase_arrays& state, phase_arrays& deriv);
+
+	/// <summary>
+	/// Moves the members of a subsystem in the stage state for a time dt under their pull on each other alone.
+	/// The centre of mass moves in a straight line, a pair follows its Kepler orbit around it and a larger
+	/// subsystem takes its substeps of velocity Verlet
+	/// </summary>
+	/// <param name="sys">The subsystem</param>
 	/// <param name="dt">The time step</param>
-	/// <param name="pos_vel_vec">The std::vector containing the position and velocity parameters</param>
 	/// <returns>The error code, see error.h for more</returns>
-	int check_step(double err, double tol, double& dt, std::vector<pos_vel_params> pos_vel_vec);
+	int drift_subsystem(const subsystem& sys, double dt);
+
+	/// <summary>
+	/// Moves the velocity of every test particle by dt times its acceleration due to the bodies at their positions in state.
+	/// Only the bodies are summed over so the cost is the number of test particles times the number of bodies.
+	/// Expects workspace->gm to hold the masses of the bodies
+	/// </summary>
+	/// <param name="state">The positions of the bodies</param>
+	/// <param name="dt">The time step</param>
+	/// <param name="central">A body whose pull is left to a Kepler drift, the particles then also feel minus the pull
+	/// of the other bodies on it as in heliocentric coordinates. -1 for none</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int kick_test_particles(const state_view& state, double dt, int central = -1);
+
+	/// <summary>
+	/// Moves the position of every test particle by dt times its velocity
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	void drift_test_particles(double dt);
+
+	/// <summary>
+	/// Moves every test particle over a step the bodies have taken from start to end, for the steps that do not move
+	/// the test particles along with the bodies. The particles take fourth order Yoshida substeps short enough for the
+	/// one closest to a body, kicked by the bodies interpolated between start and end by the cubic through their positions
+	/// and velocities. A particle inside a body at the start is removed first. Returns ERR_DT_TOO_BIG if that would take
+	/// more than 65536 substeps. The particles are left at the start if it fails, so it is called before the bodies are stored
+	/// </summary>
+	/// <param name="start">The state of the bodies at the start of the step</param>
+	/// <param name="end">The state of the bodies at the end of the step</param>
+	/// <param name="dt">The time step</param>
+	/// <param name="central">A body the particles follow their Kepler orbits around during the drift, -1 to drift in a straight line</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int advance_test_particles(const state_view& start, const state_view& end, double dt, int central = -1);
+
+	/// <summary>
+	/// Removes every test particle inside a body from the simulation. A test particle has no size,
+	/// so it hits a body once it is within the body's radius
+	/// </summary>
+	/// <param name="bodies">The positions of the bodies</param>
+	void collide_test_particles(const state_view& bodies);
+
+	/// <summary>
+	/// Keeps the accelerations in deriv and the positions in state they were evaluated at,
+	/// so the next step can start from them. Expects workspace->gm to hold the masses they were evaluated with
+	/// </summary>
+	/// <param name="state">The positions the accelerations were evaluated at</param>
+	/// <param name="deriv">The derivatives, the accelerations are in vx, vy and vz</param>
+	void keep_force(const phase_arrays& state, const phase_arrays& deriv);
+
+	/// <summary>
+	/// Drops the kept forces, for when the way the force is computed changes and they no longer match it
+	/// </summary>
+	void forget_forces() { workspace->last_valid = false; workspace->block_valid = false; }
+
+	/// <summary>
+	/// Computes the acceleration and jerk (its time derivative) of every body from one snapshot of the universe
+	/// in one pass over the pairs. Always summed directly since the trees do not give the jerk.
+	/// Bodies no longer included have an acceleration and jerk of 0
+	/// </summary>
+	/// <param name="state">The positions and velocities to evaluate at</param>
+	/// <param name="aj">The acceleration in x, y and z and the jerk in vx, vy and vz, passed by reference</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int compute_jerks(const phase_arrays& state, phase_arrays& aj);
+
+	/// <summary>
+	/// Sets the stage state to y0 + dt * (Row[0] * k[0] + ... + Row[Stages - 1] * k[Stages - 1]) for every body.
+	/// Row is a row of a tableau from butcher.h, so the sum is unrolled and its zero terms dropped at compile time
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	template <class Row, int Stages>
+	void build_stage(double dt);
+
+	/// <summary>
+	/// Computes the stage derivatives k[I] to k[T::stages - 1] of the tableau T for every body,
+	/// k[0] is evaluated at y0 and each later stage from the stages before it
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code, see error.h for more</returns>
+	template <class T, int I = 0>
+	int compute_stages(double dt);
+
+	/// <summary>
+	/// Sets y0 + dt * (Row[0] * k[0] + ... + Row[Stages - 1] * k[Stages - 1]) as the new state of every body
+	/// and moves the test particles over the step
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code, see error.h for more</returns>
+	template <class Row, int Stages>
+	int commit_step(double dt);
+
+	/// <summary>
+	/// Gets the error norm of an embedded tableau T, the root mean square over every component of every included body
+	/// of dt * (b - b_hat) . k scaled by atol + rtol * max(|y0|, |y1|). Expects the new state y1 in the stage state
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	/// <param name="atol">The absolute tolerance</param>
+	/// <param name="rtol">The relative tolerance</param>
+	/// <returns>The error norm of the step, at most 1 is within the tolerances</returns>
+	template <class T>
+	double error_norm(double dt, double atol, double rtol);
+
+	/// <summary>
+	/// Computes one adaptive step of the embedded tableau T for every body and writes it back, a rejected step is
+	/// retried with a smaller time step first. The step advances with the b weights
+	/// </summary>
+	/// <param name="tol">The relative tolerance</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code, see error.h for more</returns>
+	template <class T>
+	int step_embedded(double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Keeps the dense output of the Dormand-Prince step from y0 to the stage state, with its stages in k
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	void keep_dense_output(double dt);
+
+	/// <summary>
+	/// Takes the whole step y0 to out as the modified midpoint method with a number of substeps,
+	/// finished with Gragg's smoothing step. Expects y0 and its derivative in k[0], uses stage and k[1] to k[3]
+	/// </summary>
+	/// <param name="substeps">The number of substeps, must be even</param>
+	/// <param name="dt">The time step</param>
+	/// <param name="out">The state at the end of the step, passed by reference</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int modified_midpoint(int substeps, double dt, phase_arrays& out);
+
+	/// <summary>
+	/// Accepts or rejects an adaptive step from its error norm with a PI controller. The next time step
+	/// comes from this error and the error of the last accepted step, which damps the oscillation of
+	/// a controller that only looks at the current error. A rejected step is shrunk from its error alone
+	/// and the step after it is not allowed to grow
+	/// </summary>
+	/// <param name="err">The error norm of the step, it is accepted if this is at most 1</param>
+	/// <param name="order">The error scales as dt^order</param>
+	/// <param name="dt">The time step, passed by reference and shrunk if the step is rejected</param>
+	/// <param name="dt_next">The time step to try next, passed by reference and set if the step is accepted</param>
+	/// <returns>Whether the step is accepted</returns>
+	bool control_step(double err, int order, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Gets the smallest time step an adaptive step may shrink to, a small fraction of the shortest |v| / |a| of an
+	/// included body. The adaptive steps return ERR_DT_TO_SMALL rather than retry a rejected step below it, as a step shrunk
+	/// towards 0 has no error and would be accepted without moving anything. An accepted step keeps its result and only
+	/// raises the next time step it proposes to it. Expects the state in y0 and its derivative in k[0]
+	/// </summary>
+	/// <returns>The smallest time step, 0 if no body is moving and accelerated</returns>
+	double min_step() const;
+
+	/// <summary>
+	/// Computes one adaptive step of an embedded Runge-Kutta-Nystrom method for every body.
+	/// Only the positions are carried through the stages since the force does not depend on the velocities
+	/// </summary>
+	/// <param name="method">The coefficients of the method</param>
+	/// <param name="tol">The relative tolerance on the positions</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int step_rkn(const rkn_tableau& method, double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Advances every body with a drift-kick composition, the basis of the symplectic integrators.
+	/// Drift s moves the positions by drift[s] * dt * v, kick s moves the velocities by kick[s] * dt * a.
+	/// The step is drift 0, kick 0, drift 1, ..., kick kicks - 1, drift kicks
+	/// </summary>
+	/// <param name="drift">The drift coefficients, kicks + 1 of them</param>
+	/// <param name="kick">The kick coefficients</param>
+	/// <param name="kicks">The number of kicks, each costs one force evaluation</param>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code, see error.h for more</returns>
+	int step_drift_kick(const double* drift, const double* kick, int kicks, double dt);
+
+	/// <summary>
+	/// Gets the thread pool, creating it with the configured number of threads if needed
+	/// </summary>
+	/// <returns>The thread pool</returns>
+	thread_pool& get_pool();
+
+	/// <summary>
+	/// Checks every pair of bodies and every test particle for collisions and every body for NaN values
+	/// once a step has been committed
+	/// </summary>
+	/// <returns>The error code, see error.h for more</returns>
+	int check_collisions();
 
 public:
 	/*********************************************************
@@ -43,13 +298,13 @@ public:
 	/// Default constructor
 	/// Constructs an empty universe
 	/// </summary>
-	universe() {}
+	universe() : particles(std::make_shared<particle_store>()), tracers(std::make_shared<particle_store>()), workspace(std::make_shared<integrator_workspace>()), pool(nullptr), threads(0), solver(SOLVER_DIRECT), theta(0.5), expansion(4), abs_tol(0.0), tree(std::make_shared<octree>()), multipoles(std::make_shared<fmm>()) {}
 
 	/// <summary>
 	/// Modified constructor
 	/// </summary>
 	/// <param name="object">The body in the universe</param>
-	universe(body* object) { add(object); } // Modified constructor
+	universe(body* object) : particles(std::make_shared<particle_store>()), tracers(std::make_shared<particle_store>()), workspace(std::make_shared<integrator_workspace>()), pool(nullptr), threads(0), solver(SOLVER_DIRECT), theta(0.5), expansion(4), abs_tol(0.0), tree(std::make_shared<octree>()), multipoles(std::make_shared<fmm>()) { add(object); } // Modified constructor
 	
 	/// <summary>
 	/// Destructor
@@ -58,25 +313,124 @@ public:
 
 	/// <summary>
 	/// Removes all planets/stars from the universe
+	/// The bodies keep their current state
 	/// </summary>
-	void clear() { objects.clear(); }
+	void clear();
 
 	/// <summary>
 	/// Adds planet/star to the universe
+	/// The state of the body is moved into the universe's particle store
 	/// </summary>
 	/// <param name="object">The planet/star</param>
-	void add(body* object) { objects.emplace_back(object); }
+	void add(body* object);
+
+	/// <summary>
+	/// Declares a bound subsystem, e.g. a planet and its moons, for step_hierarchical.
+	/// The other integrators treat its members like any other bodies
+	/// </summary>
+	/// <param name="members">The bodies in the subsystem, each must be in this universe and in no other subsystem</param>
+	/// <param name="substeps">Internal steps per outer step, ignored for a pair which follows its Kepler orbit</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int add_subsystem(const std::vector<body*>& members, int substeps);
+
+	/// <summary>
+	/// Removes every subsystem, the bodies stay in the universe
+	/// </summary>
+	void clear_subsystems() { subsystems.clear(); }
+
+	/// <summary>
+	/// Adds a massless test particle, e.g. an asteroid or a piece of debris. It is pulled by the bodies
+	/// but pulls on nothing, and is kept in its own SoA block so many of them cost little.
+	/// The symplectic steps and step_kepler move them along with the bodies, the other whole universe steps move them
+	/// over each accepted step in substeps against the bodies (see advance_test_particles).
+	/// A test particle that comes within the radius of a body is removed from the simulation.
+	/// The steps with an acting force return ERR_TEST_PARTICLES while there are any
+	/// </summary>
+	/// <param name="pos">The position of the test particle</param>
+	/// <param name="vel">The velocity of the test particle</param>
+	/// <returns>The index of the test particle in get_test_particles()</returns>
+	std::size_t add_test_particle(const point3& pos, const vel3& vel) { return tracers->add(pos, vel, 0.0, 0.0, true); }
+
+	/// <summary>
+	/// Removes every test particle
+	/// </summary>
+	void clear_test_particles() { tracers->clear(); }
 
 	/*********************************************************
 	Getters
 	*********************************************************/
 	unsigned __int64 get_num_of_bodies() const { return objects.size(); } // Get the number of bodies in the vector list
 	body* body_at(int i) const { return objects.at(i); } // Get the body at i in the vector list
+	particle_store* get_particles() const { return particles.get(); } // Get the SoA store holding the state of every body
+	particle_store* get_test_particles() const { return tracers.get(); } // Get the SoA store holding the state of every test particle
+	unsigned __int64 get_num_of_test_particles() const { return tracers->size(); } // Get the number of test particles
+	unsigned get_num_threads() const { return threads; } // Get the number of threads used for the force loops, 0 is one per core
+	FORCE_SOLVER get_force_solver() const { return solver; } // Get how the force on every body is computed
+	double get_opening_angle() const { return theta; } // Get the opening angle of the Barnes-Hut and FMM trees
+	int get_expansion_order() const { return expansion; } // Get the expansion order of the FMM
+	double get_absolute_tolerance() const { return abs_tol; } // Get the absolute tolerance of the adaptive steps, 0 or less uses the tolerance passed to the step
+	unsigned __int64 get_num_of_subsystems() const { return subsystems.size(); } // Get the number of subsystems
+	unsigned __int64 get_accepted_steps() const { return workspace->accepted; } // Get the number of adaptive steps accepted since the counters were reset
+	unsigned __int64 get_rejected_steps() const { return workspace->rejected; } // Get the number of adaptive steps rejected since the counters were reset
+
+	/*********************************************************
+	Setters
+	*********************************************************/
+	/// <summary>
+	/// Sets the number of threads the force loops are split over, 0 uses one per core.
+	/// The work is always cut into the same pieces so the results do not depend on the number of threads
+	/// </summary>
+	/// <param name="n">The number of threads including the calling thread</param>
+	void set_num_threads(unsigned n) { threads = n; pool.reset(); }
+
+	/// <summary>
+	/// Sets how the force on every body is computed by the whole-system integrators
+	/// </summary>
+	/// <param name="s">The force solver</param>
+	void set_force_solver(FORCE_SOLVER s) { solver = s; forget_forces(); }
+
+	/// <summary>
+	/// Sets the opening angle of the Barnes-Hut and FMM trees. For Barnes-Hut a cell of side s at distance d is used whole
+	/// when s / d is below it, for the FMM two cells of radii r_a and r_b use their expansions when (r_a + r_b) / d is below it.
+	/// 0 gives the same forces as direct summation at a higher cost, 0.5 is typical, above 1 gets inaccurate quickly
+	/// </summary>
+	/// <param name="angle">The opening angle</param>
+	void set_opening_angle(double angle) { theta = angle; forget_forces(); }
+
+	/// <summary>
+	/// Sets the expansion order of the FMM, clamped to [0, fmm::max_order]. The error of a far interaction
+	/// falls roughly as opening_angle^(order + 1) and the cost grows roughly as order^4
+	/// </summary>
+	/// <param name="order">The expansion order</param>
+	void set_expansion_order(int order) { expansion = order < 0 ? 0 : (order > fmm::max_order ? fmm::max_order : order); forget_forces(); }
+
+	/// <summary>
+	/// Sets the absolute tolerance of the adaptive steps. Each position and velocity is scaled by
+	/// absolute + relative * |value| in the error norm, so the relative tolerance alone fails near 0.
+	/// Used by the embedded Runge-Kutta and Runge-Kutta-Nystrom steps and step_bulirsch_stoer. step_ias15
+	/// bounds the last term of its expansion relative to the acceleration instead and does not use it
+	/// </summary>
+	/// <param name="tol">The absolute tolerance, 0 or less uses the tolerance passed to the step for both</param>
+	void set_absolute_tolerance(double tol) { abs_tol = tol; }
+
+	/// <summary>
+	/// Sets the accepted and rejected step counters back to 0
+	/// </summary>
+	void reset_step_counters() { workspace->accepted = 0, workspace->rejected = 0; }
 
 	/*********************************************************
 	Property definitions (For C# style properties)
 	*********************************************************/
 	__declspec(property(get = get_num_of_bodies)) unsigned __int64 num_of_bodies;	// Number of bodies in universe
+	__declspec(property(get = get_num_threads, put = set_num_threads)) unsigned num_threads;	// Number of threads
+	__declspec(property(get = get_force_solver, put = set_force_solver)) FORCE_SOLVER force_solver;	// Force solver
+	__declspec(property(get = get_opening_angle, put = set_opening_angle)) double opening_angle;	// Opening angle
+	__declspec(property(get = get_expansion_order, put = set_expansion_order)) int expansion_order;	// Expansion order
+	__declspec(property(get = get_absolute_tolerance, put = set_absolute_tolerance)) double absolute_tolerance;	// Absolute tolerance
+	__declspec(property(get = get_num_of_test_particles)) unsigned __int64 num_of_test_particles;	// Number of test particles
+	__declspec(property(get = get_num_of_subsystems)) unsigned __int64 num_of_subsystems;	// Number of subsystems
+	__declspec(property(get = get_accepted_steps)) unsigned __int64 accepted_steps;	// Accepted adaptive steps
+	__declspec(property(get = get_rejected_steps)) unsigned __int64 rejected_steps;	// Rejected adaptive steps
 
 	/*********************************************************
 	Methods for computation - defined in universe.cpp!!
@@ -93,6 +447,7 @@ public:
 	/// <summary>
 	/// Computes the next step in the simulation using the Euler method
 	/// for all planets in the universe with all bodies acting as a force
+	/// All bodies are advanced together from the same snapshot
 	/// </summary>
 	/// <param name="dt">The time step</param>
 	/// <returns>The error code. See error.h for more info</returns>
@@ -110,6 +465,7 @@ public:
 	/// <summary>
 	/// Computes the next step in the simulation using the Runge Kutta fourth order method
 	/// for all planets in the universe with all bodies acting as a force
+	/// Every stage is computed for all bodies from the same snapshot
 	/// </summary>
 	/// <param name="dt">The time step</param>
 	/// <returns>The error code. See error.h for more info</returns>
@@ -127,6 +483,7 @@ public:
 	/// <summary>
 	/// Computes the next step in the simulation using the Runge Kutta Fehlberg fourth order method
 	/// for all planets in the universe with all bodies acting as a force
+	/// Every stage is computed for all bodies from the same snapshot
 	/// </summary>
 	/// <param name="dt">The time step</param>
 	/// <returns>The error code. See error.h for more info</returns>
@@ -143,6 +500,7 @@ public:
 	/// <summary>
 	/// Computes the next step in the simulation using the Runge Kutta Fehlberg fifth order method
 	/// for all planets in the universe with all bodies acting as a force
+	/// Every stage is computed for all bodies from the same snapshot
 	/// </summary>
 	/// <param name="dt">The time step</param>
 	/// <returns>The error code. See error.h for more info</returns>
@@ -160,10 +518,187 @@ public:
 	/// <summary>
 	/// Computes the next step in the simulation using the Runge Kutta Fehlberg fifth order method with an adaptive time step
 	/// for all planets in the universe with all bodies acting as a force
+	/// Every stage is computed for all bodies from the same snapshot and the step is
+	/// only written back to the bodies once it is accepted, a rejected step is retried with a smaller time step
 	/// </summary>
-	/// <param name="dt">The time step, for the adaptive method this needs to be passed by reference</param>
+	/// <param name="tol">The relative tolerance on every position and velocity, see absolute_tolerance</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code. See error.h for more info. ERR_DT_TO_SMALL if a rejected step would be retried too short</returns>
+	int step_rkf45(double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the Cash-Karp fifth order method with an embedded fourth order
+	/// error estimate and an adaptive time step for all planets in the universe with all bodies acting as a force
+	/// Same step control as step_rkf45, only the tableau differs
+	/// </summary>
+	/// <param name="tol">The relative tolerance on every position and velocity, see absolute_tolerance</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code. See error.h for more info. ERR_DT_TO_SMALL if a rejected step would be retried too short</returns>
+	int step_cash_karp(double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the Dormand-Prince fifth order method with an embedded fourth order
+	/// error estimate and an adaptive time step for all planets in the universe with all bodies acting as a force
+	/// The last stage of a step is the derivative at its end, so the next step starts from it and costs six force
+	/// evaluations rather than seven. A rejected step is retried with a smaller time step before anything is written back.
+	/// Every accepted step keeps a dense output, see dense_output
+	/// </summary>
+	/// <param name="tol">The relative tolerance on every position and velocity, see absolute_tolerance</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code. See error.h for more info. ERR_DT_TO_SMALL if a rejected step would be retried too short</returns>
+	int step_dopri5(double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Gets the state of every body at a time inside the last step taken by step_dopri5, from its fourth order
+	/// dense output. Lets output be written at fixed times without cutting the steps short to land on them.
+	/// Any other step that moves the bodies drops the dense output, ERR_NO_DENSE_OUTPUT is returned until the next step_dopri5
+	/// </summary>
+	/// <param name="t">The time since the start of the last step, between 0 and the time step that was taken</param>
+	/// <param name="out">The positions and velocities at that time, passed by reference</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int dense_output(double t, phase_arrays& out);
+
+	/// <summary>
+	/// Computes the next step in the simulation using Nystrom's fifth order Runge-Kutta-Nystrom method with an
+	/// embedded fourth order error estimate and an adaptive time step
+	/// for all planets in the universe with all bodies acting as a force
+	/// Four force evaluations per step against six for RKF45, with the same step control
+	/// </summary>
+	/// <param name="tol">The relative tolerance on every position, see absolute_tolerance</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code. See error.h for more info. ERR_DT_TO_SMALL if a rejected step would be retried too short</returns>
+	int step_rkn54(double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the fourth order Hermite predictor-corrector
+	/// for all planets in the universe with all bodies acting as a force
+	/// The state is predicted with a Taylor series in the acceleration and jerk, which are evaluated again there
+	/// and used to correct it. Two force and jerk evaluations per step.
+	/// The next time step comes from the Aarseth criterion, the smallest over the bodies
+	/// </summary>
+	/// <param name="eta">The accuracy parameter, about 0.02 is typical</param>
+	/// <param name="dt">The time step, passed by reference and set to the next time step. 0 or less picks the first one</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_hermite(double eta, double& dt);
+
+	/// <summary>
+	/// Computes the next step in the simulation with individual block time steps
+	/// for all planets in the universe with all bodies acting as a force
+	/// Each body is advanced by dt / 2^k at a time with its own level k, so a fast body (e.g. the Moon) takes many small
+	/// steps while the slow ones take few. When a body is updated the others are predicted to that time from their last update.
+	/// The update is a second order predictor-corrector and the step of a body is eta * |a| / |da/dt|.
+	/// All bodies reach the end of dt together
+	/// </summary>
+	/// <param name="eta">The accuracy parameter, about 0.01 gives 600 steps per orbit</param>
+	/// <param name="dt">The time step, the largest step any body takes</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_block(double eta, double dt);
+
+	/// <summary>
+	/// Computes the next step in the simulation using IAS15, a 15th order Gauss-Radau method with an adaptive time step
+	/// for all planets in the universe with all bodies acting as a force
+	/// The acceleration over the step is a polynomial fitted at 7 Radau nodes and refined by predictor-corrector
+	/// iteration, starting from the polynomial of the last step. A step whose last term is too large compared to
+	/// the acceleration is retried with a smaller time step before anything is written back.
+	/// The tolerance is relative to the acceleration, absolute_tolerance does not apply
+	/// </summary>
+	/// <param name="tol">The largest allowed |b6| / |a|, 1e-9 is about machine precision for most orbits</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code. See error.h for more info. ERR_DT_TO_SMALL if a rejected step would be retried too short</returns>
+	int step_ias15(double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the Gragg-Bulirsch-Stoer method
+	/// for all planets in the universe with all bodies acting as a force
+	/// The step is taken with the modified midpoint method for 2, 4, 6, ... substeps and extrapolated to
+	/// zero substep size. The number of columns and the time step are both picked to do the least work per unit time,
+	/// so smooth orbits get long, high order steps. A step that does not converge is retried with a smaller time step
+	/// </summary>
+	/// <param name="tol">The relative tolerance on every position and velocity, see absolute_tolerance</param>
+	/// <param name="dt">The time step to try, passed by reference and set to the time step that was taken</param>
+	/// <param name="dt_next">The time step to try next, passed by reference</param>
+	/// <returns>The error code. See error.h for more info. ERR_DT_TO_SMALL if a rejected step would be retried too short</returns>
+	int step_bulirsch_stoer(double tol, double& dt, double& dt_next);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the leapfrog (drift-kick-drift) method
+	/// for all planets in the universe with all bodies acting as a force
+	/// Second order and symplectic, so the energy error stays bounded over long runs. One force evaluation per step
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_leapfrog(double dt);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the velocity Verlet (kick-drift-kick) method
+	/// for all planets in the universe with all bodies acting as a force
+	/// Second order and symplectic. The force at the end of a step is reused at the start of the next
+	/// so it costs one force evaluation per step unless the bodies are changed in between
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_verlet(double dt);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the Yoshida / Forest-Ruth fourth order method
+	/// for all planets in the universe with all bodies acting as a force
+	/// Three leapfrog steps of sizes w1 * dt, w0 * dt and w1 * dt, fourth order and symplectic.
+	/// Three force evaluations per step
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_yoshida4(double dt);
+
+	/// <summary>
+	/// Moves every planet in the universe along its exact Kepler orbit around ONE body being the acting force,
+	/// the same problem as the step_*(body* acting_force, double dt) methods but solved in closed form.
+	/// The central body stays where it is and the planets do not pull on each other, so dt can be any length
+	/// and costs one Kepler solve per body
+	/// </summary>
+	/// <param name="central">The body being the acting force, usually a star</param>
+	/// <param name="dt">The time to move for, can be negative</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_kepler(body* central, double dt);
+
+	/// <summary>
+	/// Computes the next step in the simulation with every subsystem integrated in its own frame
+	/// for all planets in the universe with all bodies acting as a force
+	/// Kick-drift-kick, where the kicks are the pull of the bodies outside each body's own subsystem, which includes the
+	/// tides on a subsystem, and the drift moves each subsystem's centre of mass in a straight line while its members
+	/// orbit each other with their own internal time step. The outer time step only has to resolve the orbits
+	/// of the centres of mass, so a moon does not hold the whole system to its short period.
+	/// Second order and symplectic, two force evaluations per step
+	/// </summary>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_hierarchical(double dt);
+
+	/// <summary>
+	/// Computes the next step in the simulation using the Wisdom-Holman method
+	/// for all planets in the universe with all bodies acting as a force
+	/// Each body follows its exact Kepler orbit around the central body and the pull of the other bodies
+	/// is added as kicks, so the step only has to resolve the perturbations rather than the orbits.
+	/// Uses democratic heliocentric coordinates, second order and symplectic. One force evaluation per step
+	/// </summary>
+	/// <param name="central">The dominant body, usually a star</param>
+	/// <param name="dt">The time step</param>
+	/// <returns>The error code. See error.h for more info</returns>
+	int step_wisdom_holman(body* central, double dt);
+
+	/// <summary>
+	/// Measures the error of the force solver against direct summation at the current state.
+	/// The error of a body is |a_solver - a_direct| / |a_direct|
+	/// </summary>
+	/// <param name="samples">The number of bodies to check, spread evenly through the universe. 0 checks every body</param>
+	/// <param name="max_error">The largest error, passed by reference</param>
+	/// <param name="rms_error">The root mean square error, passed by reference</param>
 	/// <returns>The error code. See error.h for more info</returns>
-	int step_rkf45(double tol, double& dt);
+	int measure_force_error(std::size_t samples, double& max_error, double& rms_error);
 }; // end class universe
 
 /// <summary>
@@ -4,6 +4,8 @@ import numpy as np
 import pandas as pd
 from matplotlib import animation
 
+from trajectory import trajectory, is_trajectory
+
 colour_list = ('red', 'orange', 'blue', 'lawngreen', 'aqua', 'purple', 'chocolate', 'lightblue', 'fuchsia',
                'khaki')  # Add more colours if you want too
 
@@ -25,60 +27,66 @@ class plot_traj:
 
         # Open file
         self.filename = filename
-        # Open and unpack, names, masses, radii and number of bodies and steps info
-        f = open(self.filename, 'r')
-
-        # For every line in the file, if the line contains the header read the next line
-        # and assign the variable
-        for x in f:
-            if x.startswith('NUM_BODIES'):
-                self.number_of_bodies = int(f.readline())
-            if x.startswith('NUM_STEPS'):
-                self.number_of_steps = int(f.readline().strip('\n'))
-            if x.startswith('NAMES'):
-                i = 0
-                while i < self.number_of_bodies:
-                    # To separate names on a new line they contain \n which needs to be stripped
-                    self.names.append(f.readline().strip('\n'))
-                    i += 1
-
-            if x.startswith('MASSES'):
-                i = 0
-                while i < self.number_of_bodies:
-                    self.masses.append(float(f.readline()))
-                    i += 1
-
-            if x.startswith('RADII'):
-                i = 0
-                while i < self.number_of_bodies:
-                    self.radii.append(float(f.readline()))
-                    i += 1
-        # Close file
-        f.close()
-
-        # Open dataframe to the trajectories information
-        self.df = pd.read_csv(self.filename, skiprows=3 * self.number_of_bodies + 10)
-
-        # Add time points to Array
-        for t in range(self.number_of_steps):
-            self.time_list.append(float(self.df.iloc[t]['Step No']))
-
-        # Remove the two unnecessary columns (could be done in C++)
-        # Unnamed: creates a column called 'Unnamed: n' where n is the number of bodies * 6 + 1
-        self.df = self.df.drop(columns=['Step No', 'Unnamed: ' + str(self.number_of_bodies * 6 + 1)])
+        if is_trajectory(self.filename):
+            # Binary trajectory file, the frames are memory mapped rather than parsed
+            traj = trajectory(self.filename)
+            self.names, self.masses, self.radii = traj.names, traj.masses, traj.radii
+            self.number_of_bodies, self.number_of_steps = traj.number_of_bodies, traj.number_of_steps
+            # Columns of the mapping, only the pages that are used are ever read
+            self.time_list = traj.time
+            self.x_list = [traj.x[:, i] for i in range(self.number_of_bodies)]
+            self.y_list = [traj.y[:, i] for i in range(self.number_of_bodies)]
+        else:
+            # Open and unpack, names, masses, radii and number of bodies and steps info
+            f = open(self.filename, 'r')
+
+            # For every line in the file, if the line contains the header read the next line
+            # and assign the variable
+            for x in f:
+                if x.startswith('NUM_BODIES'):
+                    self.number_of_bodies = int(f.readline())
+                if x.startswith('NUM_STEPS'):
+                    self.number_of_steps = int(f.readline().strip('\n'))
+                if x.startswith('NAMES'):
+                    i = 0
+                    while i < self.number_of_bodies:
+                        # To separate names on a new line they contain \n which needs to be stripped
+                        self.names.append(f.readline().strip('\n'))
+                        i += 1
+
+                if x.startswith('MASSES'):
+                    i = 0
+                    while i < self.number_of_bodies:
+                        self.masses.append(float(f.readline()))
+                        i += 1
+
+                if x.startswith('RADII'):
+                    i = 0
+                    while i < self.number_of_bodies:
+                        self.radii.append(float(f.readline()))
+                        i += 1
+            # Close file
+            f.close()
+
+            # Open dataframe to the trajectories information
+            # The NUM_STEPS lines after the trajectories are read as rows too, so only the steps are kept
+            df = pd.read_csv(self.filename, skiprows=3 * self.number_of_bodies + 10).iloc[:self.number_of_steps]
+            self.time_list = df['Step No'].astype(float).to_numpy()
+            self.x_list = [df[name + 'x'].to_numpy() for name in self.names]
+            self.y_list = [df[name + 'y'].to_numpy() for name in self.names]
 
         # Set the x limit any y limits for the data frame
         min_array_x, max_array_x, min_array_y, max_array_y = [], [], [], []
         for i in range(len(self.names)):
             # Gets the X values of the bodies
-            column = self.df[self.names[i] + "x"]
+            column = self.x_list[i]
             # Gets the min and max values and appends them
             min_value_x = column.min()
             max_value_x = column.max()
             min_array_x.append(min_value_x)
             max_array_x.append(max_value_x)
             # Gets the Y values of the bodies
-            column = self.df[self.names[i] + "y"]
+            column = self.y_list[i]
             min_value_y = column.min()
             max_value_y = column.max()
             min_array_y.append(min_value_y)
@@ -147,11 +155,9 @@ class plot_traj:
         if self.frame % self.skip_frames == 0:
             for x in range(len(self.data_list)):
                 # Set sphere to be planet
-                self.data_list[x].set_data(self.df.at[self.frame, self.names[x] + 'x'],
-                                              self.df.at[self.frame, self.names[x] + 'y'])
+                self.data_list[x].set_data(self.x_list[x][self.frame:self.frame + 1], self.y_list[x][self.frame:self.frame + 1])
                 # set data for bodies tails
-                self.line_list[x].set_data(self.df.loc[0:self.frame, self.names[x] + 'x'],
-                                              self.df.loc[0:self.frame, self.names[x] + 'y'])
+                self.line_list[x].set_data(self.x_list[x][0:self.frame + 1], self.y_list[x][0:self.frame + 1])
 
             self.time_text.set_text(str(round(self.time_list[self.frame] / 365.0, 2)) + " years ("
                                     + str(round(self.time_list[self.frame], 2)) + " days)")
@@ -0,0 +1,69 @@
+import struct
+
+import numpy as np
+import pandas as pd
+
+# Reader for the binary trajectory files written by trajectory_writer (see C++/SolarSystem/trajectory.h)
+# The frames are mapped with numpy.memmap rather than read, so opening a file of any size is near instant
+# and only the pages that are plotted are ever loaded from disk
+
+MAGIC = b'SSTRAJ\x00\x00'
+VERSION = 1
+COMPRESSED_VERSION = 2  # Frames in compressed blocks, these have to be converted to VERSION first
+HEADER = struct.Struct('<8sIIQQQ')  # magic, version, number of bodies, number of frames, data offset, frame bytes
+
+
+def is_trajectory(filename):
+    # True if the file starts with the magic of a binary trajectory file
+    with open(filename, 'rb') as f:
+        return f.read(len(MAGIC)) == MAGIC
+
+
+class trajectory:
+    def __init__(self, filename):
+        self.filename = filename
+        with open(self.filename, 'rb') as f:
+            magic, self.version, self.number_of_bodies, number_of_frames, data_offset, frame_bytes = \
+                HEADER.unpack(f.read(HEADER.size))
+            if magic == MAGIC and self.version == COMPRESSED_VERSION:
+                raise ValueError(self.filename + ' is compressed, convert it with "SolarSystem '
+                                 + self.filename + ' out.traj" first')
+            if magic != MAGIC or self.version != VERSION:
+                raise ValueError(self.filename + ' is not a version ' + str(VERSION) + ' trajectory file')
+            n = self.number_of_bodies
+            self.masses = list(struct.unpack('<%dd' % n, f.read(8 * n)))
+            self.radii = list(struct.unpack('<%dd' % n, f.read(8 * n)))
+            self.names = []
+            for _ in range(n):
+                length, = struct.unpack('<I', f.read(4))
+                self.names.append(f.read(length).decode('utf-8'))
+            f.seek(0, 2)
+            file_bytes = f.tell()
+
+        # A run that stopped before its writer was closed still has every frame it completed
+        self.number_of_steps = (file_bytes - data_offset) // frame_bytes
+        if 0 < number_of_frames < self.number_of_steps:
+            self.number_of_steps = number_of_frames
+
+        # Every frame is time, x[n], y[n], z[n], vx[n], vy[n], vz[n]
+        if self.number_of_steps > 0:
+            self.frames = np.memmap(self.filename, dtype='<f8', mode='r', offset=data_offset,
+                                    shape=(self.number_of_steps, 1 + 6 * n))
+        else:
+            # numpy.memmap cannot map nothing, a run that wrote no frames gets an empty array
+            self.frames = np.zeros((0, 1 + 6 * n), dtype='<f8')
+        self.time = self.frames[:, 0]
+        self.x, self.y, self.z = self.frames[:, 1:1 + n], self.frames[:, 1 + n:1 + 2 * n], self.frames[:, 1 + 2 * n:1 + 3 * n]
+        self.vx, self.vy = self.frames[:, 1 + 3 * n:1 + 4 * n], self.frames[:, 1 + 4 * n:1 + 5 * n]
+        self.vz = self.frames[:, 1 + 5 * n:1 + 6 * n]
+
+    def to_dataframe(self):
+        # The trajectories with the same column names as the text format, e.g. 'Earthx'
+        # pandas copies the columns into one block, so this reads the whole file into memory.
+        # For large files index x, y and z directly instead, as plot_2d.py and plot_3d.py do
+        columns = {'Step No': self.time}
+        for i in range(self.number_of_bodies):
+            for quantity, values in (('x', self.x), ('y', self.y), ('z', self.z),
+                                     ('vx', self.vx), ('vy', self.vy), ('vz', self.vz)):
+                columns[self.names[i] + quantity] = values[:, i]
+        return pd.DataFrame(columns, copy=False)